@@ -63,7 +63,12 @@ void DumpGenericSyntax()
 	printf("\tUseful for handling dependencies inside the service itself.\n\n");
 
 	printf("status\n");
-	printf("\tRetrieve basic service manager information.\n\n");
+	printf("\tRetrieve basic service manager information.\n");
+#if !(defined(_WIN32) || defined(_WIN64) || defined(__WIN32__) || defined(__WINDOWS__))
+	printf("\tSpecify 'all' instead of 'service-name' to list every running\n\tservice.  *NIX/*BSD/Mac only.\n");
+	printf("\tIncludes fork to exec, exec to ready, stop, and reload latencies.\n\t*NIX/*BSD/Mac only.\n");
+#endif
+	printf("\n");
 
 	printf("configfile\n");
 	printf("\tOutputs the location of the server manager configuration file.\n\n");
@@ -72,6 +77,28 @@ void DumpGenericSyntax()
 	printf("\tRuns the service.\n");
 	printf("\tMost useful when -debug is specified, which runs the service as\n\ta simple console/terminal application.\n\n");
 
+#if !(defined(_WIN32) || defined(_WIN64) || defined(__WIN32__) || defined(__WINDOWS__))
+	printf("supervise\n");
+	printf("\tRuns several installed services from a single service manager.\n");
+	printf("\tSpecify 'all' or a list of service names instead of 'service-name'.\n");
+	printf("\tstart, stop, restart, reload, and status talk to the supervisor\n\twhile it runs.\n");
+	printf("\t*NIX/*BSD/Mac only.\n\n");
+
+	printf("rollingrestart\n");
+	printf("\tRestarts the copies of the executable of a service (-instances)\n\tone at a time or -maxunavailable at a time.  Waits for each copy to\n\tbe ready before moving on to the next and stops at the first copy\n\tthat fails to start or become ready.\n");
+	printf("\t*NIX/*BSD/Mac only.\n\n");
+
+	printf("trace\n");
+	printf("\tOutputs the state machine transitions recorded by -trace.\n");
+	printf("\t*NIX/*BSD/Mac only.\n\n");
+
+	printf("registry\n");
+	printf("\tBuilds a compiled registry of all installed services.\n");
+	printf("\tSpecify 'build' or 'remove' instead of 'service-name'.\n");
+	printf("\tsupervise all and service info lookups read the single registry\n\tfile instead of every service info file.  install, uninstall, and\n\taddaction keep it up to date.  Rebuild it after adding service\n\tinfo files by hand.\n");
+	printf("\t*NIX/*BSD/Mac only.\n\n");
+#endif
+
 	printf("addaction\n");
 	printf("\tAdds a custom service manager action.\n");
 	printf("\tUseful for actions such as 'configtest'.\n");
@@ -86,7 +113,7 @@ void DumpGenericSyntax()
 
 	// NOTE:  Windows automatically writes service start/stop/restart events of the service itself to the Event Log.
 	printf("-log=File\n");
-	printf("\tWrites management information (start, stop, reload, etc.) to the\n\tspecified log file.  You are on your own for log rotation.\n");
+	printf("\tWrites management information (start, stop, reload, etc.) to the\n\tspecified log file.  Log rotation is only built in on *NIX/*BSD/Mac\n\t(see -logmaxsize).  Elsewhere, you are on your own for log rotation.\n");
 	printf("\tInstall and run only.\n\n");
 
 	printf("-wait[=Milliseconds]\n");
@@ -292,7 +319,12 @@ bool ProcessArgs(int argc, TCHAR **argv)
 
 			return false;
 		}
-		else if (!_tcsnicmp(argv[x], _T("-nixuser="), 9) || !_tcsnicmp(argv[x], _T("-nixgroup="), 10))
+		else if (!_tcsnicmp(argv[x], _T("-nixuser="), 9) || !_tcsnicmp(argv[x], _T("-nixgroup="), 10) || !_tcsnicmp(argv[x], _T("-killwait="), 10) || !_tcsnicmp(argv[x], _T("-ready="), 7) || !_tcsnicmp(argv[x], _T("-listen="), 8) || !_tcsnicmp(argv[x], _T("-overlap="), 9) || !_tcsnicmp(argv[x], _T("-stdout="), 8) || !_tcsnicmp(argv[x], _T("-stderr="), 8) || !_tcsicmp(argv[x], _T("-timestamps")) || !_tcsnicmp(argv[x], _T("-logmaxsize="), 12) || !_tcsnicmp(argv[x], _T("-logkeep="), 9) || !_tcsnicmp(argv[x], _T("-loginterval="), 13) || !_tcsicmp(argv[x], _T("-logcompress")) || !_tcsnicmp(argv[x], _T("-metrics="), 9) || !_tcsnicmp(argv[x], _T("-metricsinterval="), 17) || !_tcsnicmp(argv[x], _T("-trace="), 7) || !_tcsnicmp(argv[x], _T("-restart="), 9) || !_tcsnicmp(argv[x], _T("-restartdelay="), 14) || !_tcsnicmp(argv[x], _T("-restartmaxdelay="), 17) || !_tcsnicmp(argv[x], _T("-restartlimit="), 14) || !_tcsnicmp(argv[x], _T("-restartwindow="), 15) || !_tcsnicmp(argv[x], _T("-killmode="), 10) ||
+			!_tcsnicmp(argv[x], _T("-cpumax="), 8) || !_tcsnicmp(argv[x], _T("-memorymax="), 11) || !_tcsnicmp(argv[x], _T("-memoryhigh="), 12) || !_tcsnicmp(argv[x], _T("-ioweight="), 10) || !_tcsnicmp(argv[x], _T("-pidsmax="), 9) ||
+			!_tcsnicmp(argv[x], _T("-cpus="), 6) || !_tcsnicmp(argv[x], _T("-numa="), 6) || !_tcsnicmp(argv[x], _T("-sched="), 7) || !_tcsnicmp(argv[x], _T("-nice="), 6) || !_tcsnicmp(argv[x], _T("-ioprio="), 8) ||
+			!_tcsnicmp(argv[x], _T("-rlimit="), 8) || !_tcsnicmp(argv[x], _T("-oomscoreadj="), 13) ||
+			!_tcsnicmp(argv[x], _T("-instances="), 11) || !_tcsicmp(argv[x], _T("-pininstances")) || !_tcsnicmp(argv[x], _T("-maxunavailable="), 16) ||
+			!_tcsnicmp(argv[x], _T("-health="), 8) || !_tcsnicmp(argv[x], _T("-healthinterval="), 16) || !_tcsnicmp(argv[x], _T("-healthtimeout="), 15) || !_tcsnicmp(argv[x], _T("-healththreshold="), 17))
 		{
 			// *NIX-only options.  Ignore.
 		}
@@ -379,6 +411,16 @@ bool GetServiceInfoStr(const char *Key, UTF8::UTF8MixedVar<char[8192]> &DestBuff
 	return Found;
 }
 
+// Returns how much of a timeout is left.  GetTickCount() wraps every 49.7 days but the unsigned difference stays correct.
+DWORD GetStateTimeLeft(DWORD StartTS, DWORD Amount)
+{
+	if (Amount == INFINITE)  return INFINITE;
+
+	DWORD Elapsed = ::GetTickCount() - StartTS;
+
+	return (Elapsed >= Amount ? 0 : Amount - Elapsed);
+}
+
 int RunMain(int argc, TCHAR **argv)
 {
 	// Load configuration information.
@@ -459,7 +501,7 @@ int RunMain(int argc, TCHAR **argv)
 
 	size_t CurrState = 0, NextState = 0;
 	PROCESS_INFORMATION ProcInfo = {0};
-	DWORD StateTimeLeft;
+	DWORD StateStartTS = 0, StateTimeLeft;
 
 	do
 	{
@@ -527,6 +569,9 @@ int RunMain(int argc, TCHAR **argv)
 			case 5:
 			case 6:
 			{
+				// Timeouts are measured from when the state was entered so early wakeups don't eat into them.
+				StateTimeLeft = GetStateTimeLeft(StateStartTS, GxApp.MxWaitAmount);
+
 				if (::WaitForSingleObject(ProcInfo.hProcess, (CurrState == 1 || StateTimeLeft > 2000 ? 2000 : StateTimeLeft)) == WAIT_OBJECT_0)
 				{
 					// Process completed.
@@ -541,7 +586,7 @@ int RunMain(int argc, TCHAR **argv)
 						TempFile.Close();
 
 						CurrState = 4;
-						StateTimeLeft = GxApp.MxWaitAmount;
+						StateStartTS = ::GetTickCount();
 					}
 					else
 					{
@@ -556,17 +601,13 @@ int RunMain(int argc, TCHAR **argv)
 					if (CurrState != 4 && CurrState != 5)
 					{
 						CurrState = 5;
-						StateTimeLeft = GxApp.MxWaitAmount;
+						StateStartTS = ::GetTickCount();
 					}
-					else
+					else if (!GetStateTimeLeft(StateStartTS, GxApp.MxWaitAmount))
 					{
-						StateTimeLeft -= (StateTimeLeft > 2000 ? 2000 : StateTimeLeft);
-						if (!StateTimeLeft)
-						{
-							// Force the process to terminate since the timeout has expired.
-							NextState = (CurrState == 4 ? 100 : 0);
-							CurrState = 2;
-						}
+						// Force the process to terminate since the timeout has expired.
+						NextState = (CurrState == 4 ? 100 : 0);
+						CurrState = 2;
 					}
 				}
 				else if (UTF8::File::Exists(NotifyReloadFilename.MxStr))
@@ -575,27 +616,23 @@ int RunMain(int argc, TCHAR **argv)
 					if (CurrState != 6)
 					{
 						CurrState = 6;
-						StateTimeLeft = GxApp.MxWaitAmount;
+						StateStartTS = ::GetTickCount();
 					}
-					else
+					else if (!GetStateTimeLeft(StateStartTS, GxApp.MxWaitAmount))
 					{
-						StateTimeLeft -= (StateTimeLeft > 2000 ? 2000 : StateTimeLeft);
-						if (!StateTimeLeft)
+						// Stop the process since it didn't respond in time to reload.
+						if (TempFile.Open(NotifyStopFilename.MxStr, O_CREAT | O_WRONLY))
+						{
+							TempFile.Close();
+
+							CurrState = 5;
+							StateStartTS = ::GetTickCount();
+						}
+						else
 						{
-							// Stop the process since it didn't respond in time to reload.
-							if (TempFile.Open(NotifyStopFilename.MxStr, O_CREAT | O_WRONLY))
-							{
-								TempFile.Close();
-
-								CurrState = 5;
-								StateTimeLeft = GxApp.MxWaitAmount;
-							}
-							else
-							{
-								// Force terminate the process since communication is not possible.
-								CurrState = 2;
-								NextState = 0;
-							}
+							// Force terminate the process since communication is not possible.
+							CurrState = 2;
+							NextState = 0;
 						}
 					}
 				}
@@ -1407,12 +1444,54 @@ int _tmain(int argc, TCHAR **argv)
 
 // Linux, Mac, and most other OSes.
 #include "sync/sync_event.h"
+#include "sync/sync_sharedmem.h"
 #include "templates/fast_find_replace.h"
+#include "templates/packed_ordered_hash.h"
 
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <pwd.h>
 #include <grp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <cstddef>
+#include <cctype>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+
+#ifndef __NR_pidfd_open
+	#define __NR_pidfd_open   434
+#endif
+#ifndef __NR_close_range
+	#define __NR_close_range   436
+#endif
+#ifndef CLOSE_RANGE_CLOEXEC
+	#define CLOSE_RANGE_CLOEXEC   (1U << 2)
+#endif
+
+// From <numaif.h> and <linux/ioprio.h>, which aren't always installed.
+#ifndef MPOL_PREFERRED
+	#define MPOL_PREFERRED    1
+	#define MPOL_BIND         2
+	#define MPOL_INTERLEAVE   3
+#endif
+#define IOPRIO_CLASS_SHIFT   13
+#define IOPRIO_WHO_PROCESS   1
+#endif
+
+#ifndef MSG_NOSIGNAL
+	#define MSG_NOSIGNAL   0
+#endif
 
 #ifdef __APPLE__
 #pragma message("Compiling for Mac OSX...")
@@ -1442,15 +1521,266 @@ void DumpSyntax(char *currfile)
 	printf("-nixgroup=Groupname\n");
 	printf("\tSets the group of the new process.\n");
 	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-killwait=Milliseconds\n");
+	printf("\tThe amount of time, in milliseconds, to wait for the process to\n\texit after sending SIGTERM before sending SIGKILL.\n");
+	printf("\tThe default is 3000.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-killmode=Mode\n");
+	printf("\tWhat force termination and SIGKILL reach.  'process' is the\n\tprocess only.  'group' starts the process in its own process group\n\tand signals the whole group.  'cgroup' (Linux cgroup v2 only) also\n\tmoves each process into its own cgroup below the cgroup of the\n\tservice manager, which catches processes that leave the group.\n\tProcesses left behind when the process exits are sent SIGTERM and\n\tthen SIGKILL before it is started again.\n");
+	printf("\tThe default is 'group'.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-cpumax=Quota Period\n");
+	printf("-memorymax=Bytes\n");
+	printf("-memoryhigh=Bytes\n");
+	printf("-ioweight=Weight\n");
+	printf("-pidsmax=Number\n");
+	printf("\tcgroup v2 resource limits.  Written as-is to cpu.max, memory.max,\n\tmemory.high, io.weight, and pids.max of a cgroup for the service\n\t(e.g. -cpumax=\"50000 100000\" for half a CPU, -memorymax=512M).\n\tImplies -killmode=cgroup.  The service manager moves itself into a\n\tleaf cgroup when that is required to enable the controllers.\n");
+	printf("\tInstall and run only.  Linux only.\n\n");
+
+	printf("-cpus=List\n");
+	printf("\tRestricts the process to the specified CPUs (e.g. 2-3,6).\n");
+	printf("\tInstall and run only.  Linux only.\n\n");
+
+	printf("-numa=[Policy:]Nodes\n");
+	printf("\tThe NUMA memory policy of the process.  Policy is 'bind'\n\t(default), 'preferred', or 'interleave'.  'bind' also restricts the\n\tprocess to the CPUs of the nodes unless -cpus is used.\n");
+	printf("\tInstall and run only.  Linux only.\n\n");
+
+	printf("-sched=Policy[:Priority]\n");
+	printf("\tThe scheduling policy of the process.  One of 'other', 'batch',\n\t'idle', 'fifo:Priority', or 'rr:Priority' (1 to 99).\n");
+	printf("\tInstall and run only.  Linux only.\n\n");
+
+	printf("-nice=Level\n");
+	printf("\tThe nice level of the process (-20 to 19).\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-ioprio=Class[:Level]\n");
+	printf("\tThe I/O priority of the process.  One of 'realtime:Level',\n\t'best-effort:Level' (0 to 7, lower is more important), or 'idle'.\n");
+	printf("\tInstall and run only.  Linux only.\n\n");
+
+	printf("-rlimit=Resource=Soft[:Hard]\n");
+	printf("\tA resource limit of the process.  Resource is one of 'as', 'core',\n\t'cpu', 'data', 'fsize', 'memlock', 'nofile', 'nproc', 'stack',\n\t'rtprio', 'msgqueue', or 'nice'.  Soft and Hard are numbers or\n\t'unlimited'.  Hard defaults to Soft.  May be used more than once\n\t(e.g. -rlimit=nofile=65536 -rlimit=core=0).\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-oomscoreadj=Value\n");
+	printf("\tThe oom_score_adj of the process (-1000 to 1000).  Higher values\n\tmake the process the first choice of the OOM killer.\n");
+	printf("\tInstall and run only.  Linux only.\n\n");
+
+	printf("-instances=Num\n");
+	printf("\tRuns Num copies of the executable, each with its own restart\n\thandling.  Each copy gets SERVICEMANAGER_INSTANCE (0 to Num - 1) and\n\tSERVICEMANAGER_INSTANCES in its environment.  Copies 1 and up are\n\tnamed 'service-name@N' and add '@N' to the PID, log, notification,\n\toutput, and trace filenames.  TCP listening sockets use SO_REUSEPORT\n\tso every copy gets its own accept queue.  stop, start, restart, and\n\treload apply to every copy and complete when every copy is done.\n");
+	printf("\tThe default is 1.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-pininstances\n");
+	printf("\tPins each copy of the executable to its own CPU.  The CPUs come\n\tfrom -cpus or -numa when used.\n");
+	printf("\tInstall and run only.  Linux only.\n\n");
+
+	printf("-maxunavailable=Num\n");
+	printf("\tThe number of copies of the executable that rollingrestart takes\n\tout of service at a time.\n");
+	printf("\tThe default is 1.\n");
+	printf("\trollingrestart only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-ready=Milliseconds\n");
+	printf("\tEnables readiness notification.  The process receives a\n\tNOTIFY_SOCKET environment variable and sends 'READY=1' to it\n\t(sd_notify() compatible) once it is ready.  start and waitfor\n\twait for readiness for up to the specified amount of time.\n");
+	printf("\tThe PID file is written when the process is ready.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-health=Probe\n");
+	printf("\tChecks that the process is healthy once it is ready and restarts\n\tit after too many failed checks in a row.  'tcp:host:port' and\n\t'unix:/path' pass when a connection can be made.  'file:/path'\n\tpasses when the file was modified within the interval plus the\n\ttimeout (e.g. a heartbeat file).  'action:Name' runs a custom action\n\t(see addaction) as the user of the process with SERVICEMANAGER_PID\n\tset and passes when it exits with 0.  A process that fails is sent\n\tSIGTERM and then SIGKILL (-killwait) since it might not notice the\n\tnotification files.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-healthinterval=Milliseconds\n");
+	printf("-healthtimeout=Milliseconds\n");
+	printf("-healththreshold=Num\n");
+	printf("\tThe time between health checks, how long a check may take, and the\n\tnumber of failed checks in a row that restarts the process.  The\n\tdefaults are 10000, 2000, and 3.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-listen=Addresses\n");
+	printf("\tA comma-separated list of 'tcp:host:port', 'tcp:[ipv6]:port',\n\t'tcp:*:port', or 'unix:/path' addresses.  The service manager binds\n\tthem once and passes them to every process as file descriptors 3\n\tand up with LISTEN_FDS and LISTEN_PID (sd_listen_fds() compatible).\n\tConnections queue up instead of being refused during restarts.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-overlap=Milliseconds\n");
+	printf("\tEnables overlapped restarts.  restart and reload timeouts start a\n\tnew process before stopping the current one.  The current process\n\tis sent SIGTERM once the new process signals readiness (-ready) or,\n\twithout readiness notification, after the specified amount of time.\n");
+	printf("\tBest used with -listen so both processes share the same sockets.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-stdout=Target\n");
+	printf("-stderr=Target\n");
+	printf("\tCaptures the standard output/error of the process.  Target is\n\t'log' for the service manager log file or a filename to append to.\n\tThe default is to discard output.  When both streams have the same\n\ttarget, they share a single pipe and stay in order.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-timestamps\n");
+	printf("\tPrefixes each captured line of output with a timestamp.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-logmaxsize=Bytes\n");
+	printf("-loginterval=Seconds\n");
+	printf("\tRotates the log file when it reaches the specified size and/or\n\tthe specified amount of time after it was opened.  The log file is\n\trenamed to File.1 (File.1 to File.2, etc.) and reopened.\n\tSending SIGHUP to the service manager reopens the log file for use\n\twith external log rotation tools (no copytruncate needed).\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-logkeep=Num\n");
+	printf("\tThe number of rotated log files to keep.  The default is 5.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-logcompress\n");
+	printf("\tCompresses rotated log files with gzip in the background.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-metrics=File\n");
+	printf("\tPeriodically writes service metrics (restarts, exits, forced\n\tterminations, time spent in each state, reload latency, etc.) to\n\tthe specified file in Prometheus text format for a textfile\n\tcollector.  Services supervised together that use the same file\n\tshare it.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-metricsinterval=Seconds\n");
+	printf("\tHow often to write the metrics file.  The default is 15.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-restart=Policy\n");
+	printf("\tHow to restart the process when it exits on its own.  'immediate'\n\trestarts right away.  'fixed' waits until -restartdelay has passed\n\tsince the process was started.  'backoff' doubles the delay after\n\tevery quick exit up to -restartmaxdelay with random jitter and\n\tresets once the process stays up for -restartmaxdelay.\n");
+	printf("\tThe default is 'fixed'.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-restartdelay=Milliseconds\n");
+	printf("-restartmaxdelay=Milliseconds\n");
+	printf("\tThe restart delay and the backoff cap.  The defaults are 1000 and\n\t60000.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-restartlimit=Num\n");
+	printf("-restartwindow=Seconds\n");
+	printf("\tMarks the service as failed and stops restarting it after Num\n\trestarts within the window.  start clears the failure.  The default\n\tlimit is 0 (unlimited) and the default window is 60.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+
+	printf("-trace=File\n");
+	printf("\tAppends a binary record of every state machine transition to the\n\tspecified file.  Use the trace action to view it.\n");
+	printf("\tInstall and run only.  *NIX/*BSD/Mac only.\n\n");
+}
+
+// cgroup v2 resource limits.  Each one is a service info key, the file it is written to, and the controller it needs.
+#define CGROUP_LIMIT_CPU_MAX      0
+#define CGROUP_LIMIT_MEMORY_MAX   1
+#define CGROUP_LIMIT_MEMORY_HIGH  2
+#define CGROUP_LIMIT_IO_WEIGHT    3
+#define CGROUP_LIMIT_PIDS_MAX     4
+#define CGROUP_LIMIT_NUM          5
+
+struct CgroupLimitDef
+{
+	const char *MxKey;
+	const char *MxFilename;
+	const char *MxController;
+};
+
+const CgroupLimitDef GxCgroupLimitDefs[CGROUP_LIMIT_NUM] = {
+	{ "cpu_max", "cpu.max", "cpu" },
+	{ "memory_max", "memory.max", "memory" },
+	{ "memory_high", "memory.high", "memory" },
+	{ "io_weight", "io.weight", "io" },
+	{ "pids_max", "pids.max", "pids" }
+};
+
+// CPU, memory, and scheduler placement of the process.  Each one is a service info key.
+#define PLACEMENT_CPUS     0
+#define PLACEMENT_NUMA     1
+#define PLACEMENT_SCHED    2
+#define PLACEMENT_NICE     3
+#define PLACEMENT_IOPRIO   4
+#define PLACEMENT_NUM      5
+
+const char *GxPlacementKeys[PLACEMENT_NUM] = { "cpus", "numa", "sched", "nice", "ioprio" };
+
+// Resource limits.  The service info key is "rlimit_" followed by the name.
+#define RLIMIT_DEFS_MAX   16
+
+struct RLimitDef
+{
+	const char *MxName;
+	int MxResource;
+};
+
+const RLimitDef GxRLimitDefs[] = {
+	{ "as", RLIMIT_AS },
+	{ "core", RLIMIT_CORE },
+	{ "cpu", RLIMIT_CPU },
+	{ "data", RLIMIT_DATA },
+	{ "fsize", RLIMIT_FSIZE },
+	{ "memlock", RLIMIT_MEMLOCK },
+	{ "nofile", RLIMIT_NOFILE },
+	{ "nproc", RLIMIT_NPROC },
+	{ "stack", RLIMIT_STACK },
+#ifdef RLIMIT_RTPRIO
+	{ "rtprio", RLIMIT_RTPRIO },
+#endif
+#ifdef RLIMIT_MSGQUEUE
+	{ "msgqueue", RLIMIT_MSGQUEUE },
+#endif
+#ifdef RLIMIT_NICE
+	{ "nice", RLIMIT_NICE },
+#endif
+};
+
+const size_t GxNumRLimitDefs = sizeof(GxRLimitDefs) / sizeof(GxRLimitDefs[0]);
+
+// Finds the limit for "name=...".  Returns GxNumRLimitDefs when there isn't one.
+size_t GetRLimitDef(const char *Str)
+{
+	size_t x, y;
+
+	for (x = 0; x < GxNumRLimitDefs; x++)
+	{
+		y = strlen(GxRLimitDefs[x].MxName);
+		if (!strncasecmp(Str, GxRLimitDefs[x].MxName, y) && Str[y] == '=')  break;
+	}
+
+	return x;
 }
 
 // Some globals to make life easier for debug vs. service modes of operation.
-Sync::Event GxStopEvent, GxWakeupEvent;
+Sync::Event GxStopEvent;
+
+// Signal handlers write a byte to the wakeup pipe so the main loop can sleep in poll() without missing a signal.
+int GxWakeupPipe[2] = { -1, -1 };
+
+// On Linux, handled signals are blocked and read from a signalfd instead (no signal handler races).
+int GxSignalFD = -1;
+sigset_t GxSignalMask, GxOrigSignalMask;
+void (*GxSignalHandlers[NSIG])(int);
 
 class AppInitState
 {
 public:
 	std::uint32_t MxWaitAmount = INFINITE;
+	std::uint32_t MxKillWaitAmount = 3000;
+	char *MxKillModeStr = NULL;
+	char *MxCgroupLimitStrs[CGROUP_LIMIT_NUM] = { NULL, NULL, NULL, NULL, NULL };
+	char *MxPlacementStrs[PLACEMENT_NUM] = { NULL, NULL, NULL, NULL, NULL };
+	char *MxRLimitStrs[RLIMIT_DEFS_MAX] = { NULL };
+	char *MxOOMScoreAdjStr = NULL;
+	std::uint32_t MxReadyTimeout = 0;
+	std::uint32_t MxOverlapAmount = 0;
+	std::uint32_t MxInstances = 1;
+	bool MxPinInstances = false;
+	std::uint32_t MxMaxUnavailable = 1;
+	char *MxHealthStr = NULL;
+	std::uint32_t MxHealthInterval = 10000;
+	std::uint32_t MxHealthTimeout = 2000;
+	std::uint32_t MxHealthThreshold = 3;
+	char *MxListenStr = NULL;
+	char *MxStdoutStr = NULL;
+	char *MxStderrStr = NULL;
+	bool MxOutputTimestamps = false;
+	std::uint64_t MxLogMaxSize = 0;
+	std::uint32_t MxLogKeep = 5;
+	std::uint32_t MxLogInterval = 0;
+	bool MxLogCompress = false;
+	char *MxMetricsStr = NULL;
+	std::uint32_t MxMetricsInterval = 15;
+	char *MxTraceStr = NULL;
+	char *MxRestartStr = NULL;
+	std::uint32_t MxRestartDelay = 1000;
+	std::uint32_t MxRestartMaxDelay = 60000;
+	std::uint32_t MxRestartLimit = 0;
+	std::uint32_t MxRestartWindow = 60;
 	char *MxPIDFileStr = NULL;
 	char *MxLogFileStr = NULL;
 	char *MxStartDir = NULL;
@@ -1484,6 +1814,58 @@ bool ProcessArgs(int argc, char **argv)
 		else if (!strncasecmp(argv[x], "-dir=", 5))  GxApp.MxStartDir = argv[x] + 5;
 		else if (!strncasecmp(argv[x], "-nixuser=", 9))  GxApp.MxUserStr = argv[x] + 9;
 		else if (!strncasecmp(argv[x], "-nixgroup=", 10))  GxApp.MxGroupStr = argv[x] + 10;
+		else if (!strncasecmp(argv[x], "-killwait=", 10))  GxApp.MxKillWaitAmount = atoi(argv[x] + 10);
+		else if (!strncasecmp(argv[x], "-killmode=", 10))  GxApp.MxKillModeStr = argv[x] + 10;
+		else if (!strncasecmp(argv[x], "-cpumax=", 8))  GxApp.MxCgroupLimitStrs[CGROUP_LIMIT_CPU_MAX] = argv[x] + 8;
+		else if (!strncasecmp(argv[x], "-memorymax=", 11))  GxApp.MxCgroupLimitStrs[CGROUP_LIMIT_MEMORY_MAX] = argv[x] + 11;
+		else if (!strncasecmp(argv[x], "-memoryhigh=", 12))  GxApp.MxCgroupLimitStrs[CGROUP_LIMIT_MEMORY_HIGH] = argv[x] + 12;
+		else if (!strncasecmp(argv[x], "-ioweight=", 10))  GxApp.MxCgroupLimitStrs[CGROUP_LIMIT_IO_WEIGHT] = argv[x] + 10;
+		else if (!strncasecmp(argv[x], "-pidsmax=", 9))  GxApp.MxCgroupLimitStrs[CGROUP_LIMIT_PIDS_MAX] = argv[x] + 9;
+		else if (!strncasecmp(argv[x], "-cpus=", 6))  GxApp.MxPlacementStrs[PLACEMENT_CPUS] = argv[x] + 6;
+		else if (!strncasecmp(argv[x], "-numa=", 6))  GxApp.MxPlacementStrs[PLACEMENT_NUMA] = argv[x] + 6;
+		else if (!strncasecmp(argv[x], "-sched=", 7))  GxApp.MxPlacementStrs[PLACEMENT_SCHED] = argv[x] + 7;
+		else if (!strncasecmp(argv[x], "-nice=", 6))  GxApp.MxPlacementStrs[PLACEMENT_NICE] = argv[x] + 6;
+		else if (!strncasecmp(argv[x], "-ioprio=", 8))  GxApp.MxPlacementStrs[PLACEMENT_IOPRIO] = argv[x] + 8;
+		else if (!strncasecmp(argv[x], "-rlimit=", 8))
+		{
+			size_t y = GetRLimitDef(argv[x] + 8);
+			if (y == GxNumRLimitDefs)
+			{
+				printf("Unknown resource limit '%s'.\n\n", argv[x] + 8);
+
+				DumpSyntax(argv[0]);
+
+				return false;
+			}
+
+			GxApp.MxRLimitStrs[y] = argv[x] + 9 + strlen(GxRLimitDefs[y].MxName);
+		}
+		else if (!strncasecmp(argv[x], "-oomscoreadj=", 13))  GxApp.MxOOMScoreAdjStr = argv[x] + 13;
+		else if (!strncasecmp(argv[x], "-ready=", 7))  GxApp.MxReadyTimeout = atoi(argv[x] + 7);
+		else if (!strncasecmp(argv[x], "-listen=", 8))  GxApp.MxListenStr = argv[x] + 8;
+		else if (!strncasecmp(argv[x], "-overlap=", 9))  GxApp.MxOverlapAmount = atoi(argv[x] + 9);
+		else if (!strncasecmp(argv[x], "-instances=", 11))  GxApp.MxInstances = atoi(argv[x] + 11);
+		else if (!strcasecmp(argv[x], "-pininstances"))  GxApp.MxPinInstances = true;
+		else if (!strncasecmp(argv[x], "-maxunavailable=", 16))  GxApp.MxMaxUnavailable = atoi(argv[x] + 16);
+		else if (!strncasecmp(argv[x], "-health=", 8))  GxApp.MxHealthStr = argv[x] + 8;
+		else if (!strncasecmp(argv[x], "-healthinterval=", 16))  GxApp.MxHealthInterval = atoi(argv[x] + 16);
+		else if (!strncasecmp(argv[x], "-healthtimeout=", 15))  GxApp.MxHealthTimeout = atoi(argv[x] + 15);
+		else if (!strncasecmp(argv[x], "-healththreshold=", 17))  GxApp.MxHealthThreshold = atoi(argv[x] + 17);
+		else if (!strncasecmp(argv[x], "-stdout=", 8))  GxApp.MxStdoutStr = argv[x] + 8;
+		else if (!strncasecmp(argv[x], "-stderr=", 8))  GxApp.MxStderrStr = argv[x] + 8;
+		else if (!strcasecmp(argv[x], "-timestamps"))  GxApp.MxOutputTimestamps = true;
+		else if (!strncasecmp(argv[x], "-logmaxsize=", 12))  GxApp.MxLogMaxSize = strtoull(argv[x] + 12, NULL, 10);
+		else if (!strncasecmp(argv[x], "-logkeep=", 9))  GxApp.MxLogKeep = atoi(argv[x] + 9);
+		else if (!strncasecmp(argv[x], "-loginterval=", 13))  GxApp.MxLogInterval = atoi(argv[x] + 13);
+		else if (!strcasecmp(argv[x], "-logcompress"))  GxApp.MxLogCompress = true;
+		else if (!strncasecmp(argv[x], "-metrics=", 9))  GxApp.MxMetricsStr = argv[x] + 9;
+		else if (!strncasecmp(argv[x], "-metricsinterval=", 17))  GxApp.MxMetricsInterval = atoi(argv[x] + 17);
+		else if (!strncasecmp(argv[x], "-trace=", 7))  GxApp.MxTraceStr = argv[x] + 7;
+		else if (!strncasecmp(argv[x], "-restart=", 9))  GxApp.MxRestartStr = argv[x] + 9;
+		else if (!strncasecmp(argv[x], "-restartdelay=", 14))  GxApp.MxRestartDelay = atoi(argv[x] + 14);
+		else if (!strncasecmp(argv[x], "-restartmaxdelay=", 17))  GxApp.MxRestartMaxDelay = atoi(argv[x] + 17);
+		else if (!strncasecmp(argv[x], "-restartlimit=", 14))  GxApp.MxRestartLimit = atoi(argv[x] + 14);
+		else if (!strncasecmp(argv[x], "-restartwindow=", 15))  GxApp.MxRestartWindow = atoi(argv[x] + 15);
 		else if (!strcasecmp(argv[x], "-?"))
 		{
 			DumpSyntax(argv[0]);
@@ -1521,121 +1903,579 @@ bool ProcessArgs(int argc, char **argv)
 	return true;
 }
 
-bool OpenServiceInfoFile(UTF8::File &DestFile, int Flags, StaticMixedVar<char[8192]> &TempBuffer)
+// Last modification time in nanoseconds.  Whole seconds miss edits made within the same second.
+inline std::uint64_t GetFileStatMTime(const UTF8::File::FileStat &TempStat)
 {
-	StaticMixedVar<char[8192]> TempBuffer2;
-	size_t y;
+#ifdef __APPLE__
+	return (std::uint64_t)TempStat.st_mtimespec.tv_sec * 1000000000ULL + (std::uint64_t)TempStat.st_mtimespec.tv_nsec;
+#else
+	return (std::uint64_t)TempStat.st_mtim.tv_sec * 1000000000ULL + (std::uint64_t)TempStat.st_mtim.tv_nsec;
+#endif
+}
 
-	// Locate service info file.
-	y = sizeof(TempBuffer.MxStr);
-	if (!UTF8::AppInfo::GetSystemAppStorageDir(TempBuffer.MxStr, y, "servicemanager"))
+// Parsed service info file.  Loaded once and indexed by lowercase key so lookups don't rescan the file.
+class ServiceInfoTable
+{
+public:
+	ServiceInfoTable() : MxData(NULL), MxKeys(32), MxSize(0), MxMTime(0), MxInode(0)
 	{
-		printf("Error:  Unable to retrieve system application storage directory location.\n");
-
-		return false;
 	}
-	TempBuffer.SetSize(y - 1);
-	TempBuffer.AppendStr(GxApp.MxServiceName);
 
-	if (!DestFile.Open(TempBuffer.MxStr, Flags))
+	~ServiceInfoTable()
 	{
-		printf("Error:  Unable to open '%s'.\n", TempBuffer.MxStr);
+		if (MxData != NULL)  delete[] MxData;
+	}
 
-		return false;
+	// Returns true if the file on disk still matches the loaded copy.
+	inline bool IsCurrent(const UTF8::File::FileStat &TempStat) const
+	{
+		return (MxData != NULL && (std::uint64_t)TempStat.st_size == MxSize && GetFileStatMTime(TempStat) == MxMTime && (std::uint64_t)TempStat.st_ino == MxInode);
 	}
 
-	return true;
-}
+	bool Load(const char *Filename, const UTF8::File::FileStat &TempStat)
+	{
+		char *Data;
+		size_t DataSize;
 
-bool GetServiceInfoStr(const char *Key, StaticMixedVar<char[8192]> &DestBuffer, bool IgnoreKeyNotFound = false)
-{
-	StaticMixedVar<char[8192]> TempBuffer;
-	UTF8::File TempFile;
-	if (!OpenServiceInfoFile(TempFile, O_RDONLY, TempBuffer))  return false;
+		if (!UTF8::File::LoadEntireFile(Filename, Data, DataSize))  return false;
 
-	bool Found = false;
-	size_t y2 = strlen(Key);
-	while (!Found && TempFile.GetCurrPos() < TempFile.GetMaxPos())
+		Load(Data, DataSize, (std::uint64_t)TempStat.st_size, GetFileStatMTime(TempStat), (std::uint64_t)TempStat.st_ino);
+
+		delete[] Data;
+
+		return true;
+	}
+
+	void Load(const char *Data, size_t DataSize, std::uint64_t Size, std::uint64_t MTime, std::uint64_t Inode)
 	{
-		char *TempStr = TempFile.LineInput();
-		if (!strncasecmp(Key, TempStr, y2) && TempStr[y2] == '=')
+		size_t x, y, y2;
+
+		// Split into lines in place.  The extra byte terminates the last line.
+		MxData = new char[DataSize + 1];
+		memcpy(MxData, Data, DataSize);
+		MxData[DataSize] = '\0';
+
+		StaticMixedVar<char[256]> TempKey;
+		for (x = 0; x < DataSize; x = y + 1)
 		{
-			DestBuffer.SetStr(TempStr + y2 + 1);
+			for (y = x; y < DataSize && MxData[y] != '\n'; y++)
+			{
+				if (MxData[y] == '\0')  MxData[y] = ' ';
+			}
+			MxData[y] = '\0';
+			if (y > x && MxData[y - 1] == '\r')  MxData[y - 1] = '\0';
 
-			Found = true;
+			// Index the key.  The first occurrence wins.
+			for (y2 = x; y2 < y && MxData[y2] != '='; y2++);
+			if (y2 == x || y2 == y || y2 - x >= sizeof(TempKey.MxStr))  continue;
+
+			TempKey.SetData(MxData + x, y2 - x);
+			for (size_t x2 = 0; x2 < TempKey.MxStrPos; x2++)  TempKey.MxStr[x2] = (char)tolower(TempKey.MxStr[x2]);
+
+			if (MxKeys.Find(TempKey.MxStr, TempKey.MxStrPos) == NULL)  MxKeys.Set(TempKey.MxStr, TempKey.MxStrPos, MxData + y2 + 1);
 		}
 
-		delete[] TempStr;
+		MxSize = Size;
+		MxMTime = MTime;
+		MxInode = Inode;
 	}
 
-	if (!Found && !IgnoreKeyNotFound)  printf("Warning:  Unable to find '%s' in '%s'.\n", Key, TempBuffer.MxStr);
+	const char *Get(const char *Key)
+	{
+		StaticMixedVar<char[256]> TempKey;
+		size_t y = strlen(Key);
 
-	TempFile.Close();
+		if (y >= sizeof(TempKey.MxStr))  return NULL;
 
-	return Found;
+		TempKey.SetData(Key, y);
+		for (size_t x = 0; x < y; x++)  TempKey.MxStr[x] = (char)tolower(TempKey.MxStr[x]);
+
+		PackedOrderedHashNode<char *> *Node = MxKeys.Find(TempKey.MxStr, y);
+
+		return (Node != NULL ? Node->Value : NULL);
+	}
+
+private:
+	// Deny copy constructor and assignment operator.
+	ServiceInfoTable(const ServiceInfoTable &);
+	ServiceInfoTable &operator=(const ServiceInfoTable &);
+
+	char *MxData;
+	PackedOrderedHashNoCopy<char *> MxKeys;
+	std::uint64_t MxSize, MxMTime, MxInode;
+};
+
+// Service info tables by service name.  Cached across restarts and reloaded only when the file changes.
+PackedOrderedHashNoCopy<ServiceInfoTable *> GxServiceInfoCache;
+
+void InvalidateServiceInfo(const char *ServiceName)
+{
+	PackedOrderedHashNode<ServiceInfoTable *> *Node = GxServiceInfoCache.Find(ServiceName, strlen(ServiceName));
+	if (Node == NULL)  return;
+
+	delete Node->Value;
+	GxServiceInfoCache.Unset(Node);
 }
 
-// Takes a string as input and attempts to parse it into command-line arguments.
-// This is fast and mostly functional, not precisely flawless.
-// Destroys TempBuffer in the process.
-char **ExtractArgs(StaticMixedVar<char[8192]> &TempBuffer)
+// Compiled service registry.  A single versioned binary file holding every service info file so bulk startup opens one file.
+// Layout:  Header, then one Record per service followed by the NUL-terminated name and the raw service info file data.
+// Records start on 8 byte boundaries.  Native byte order since the registry never leaves the machine.
+#define SERVICE_REGISTRY_MAGIC    "SMREGIST"
+#define SERVICE_REGISTRY_VERSION  1
+#define SERVICE_REGISTRY_FILENAME "registry.dat"
+
+struct ServiceRegistryHeader
 {
-	// Count the number of arguments.
-	size_t x, NumArgs = 0, State = 0;
+	char MxMagic[8];
+	std::uint32_t MxVersion;
+	std::uint32_t MxNumServices;
+};
 
-	for (x = 0; x < TempBuffer.MxStrPos; x++)
+struct ServiceRegistryRecord
+{
+	std::uint64_t MxSize;
+	std::uint64_t MxMTime;
+	std::uint64_t MxInode;
+	std::uint32_t MxNameSize;
+	std::uint32_t MxDataSize;
+};
+
+class ServiceRegistry
+{
+public:
+	ServiceRegistry() : MxData(NULL), MxDataSize(0), MxRecords(64), MxOpenAttempted(false)
 	{
-		switch (State)
+	}
+
+	~ServiceRegistry()
+	{
+		Close();
+	}
+
+	static bool GetFilename(StaticMixedVar<char[8192]> &TempBuffer)
+	{
+		size_t y = sizeof(TempBuffer.MxStr);
+		if (!UTF8::AppInfo::GetSystemAppStorageDir(TempBuffer.MxStr, y, "servicemanager"))  return false;
+		TempBuffer.SetSize(y - 1);
+		TempBuffer.AppendStr(SERVICE_REGISTRY_FILENAME);
+
+		return true;
+	}
+
+	// Maps the registry into memory.  Returns false when there is no usable registry.  Only tried once per process.
+	bool Open()
+	{
+		if (MxOpenAttempted)  return (MxData != NULL);
+		MxOpenAttempted = true;
+
+		StaticMixedVar<char[8192]> TempBuffer;
+		if (!GetFilename(TempBuffer))  return false;
+
+		int fd = open(TempBuffer.MxStr, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)  return false;
+
+		struct stat TempStat;
+		if (fstat(fd, &TempStat) < 0 || (size_t)TempStat.st_size < sizeof(ServiceRegistryHeader))
 		{
-			case 0:
-			{
-				// Looking for the start of the next argument.
-				if (TempBuffer.MxStr[x] != ' ' && TempBuffer.MxStr[x] != '\t')
-				{
-					NumArgs++;
+			close(fd);
 
-					if (TempBuffer.MxStr[x] == '\'')  State = 1;
-					else if (TempBuffer.MxStr[x] == '\\')  State = 2;
-					else  State = 3;
-				}
+			return false;
+		}
 
-				break;
-			}
-			case 1:
-			{
-				// Looking for a matching single-quote character.
-				if (TempBuffer.MxStr[x] == '\'')  State = 3;
+		void *Data = mmap(NULL, (size_t)TempStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (Data == MAP_FAILED)  return false;
 
-				break;
-			}
-			case 2:
-			{
-				// Escaped character found.
-				State = 3;
+		MxData = (char *)Data;
+		MxDataSize = (size_t)TempStat.st_size;
 
-				break;
-			}
-			case 3:
+		// Validate and index the records.  A registry from another version is ignored.
+		const ServiceRegistryHeader *Header = (const ServiceRegistryHeader *)MxData;
+		bool Valid = (!memcmp(Header->MxMagic, SERVICE_REGISTRY_MAGIC, sizeof(Header->MxMagic)) && Header->MxVersion == SERVICE_REGISTRY_VERSION);
+
+		size_t Pos = sizeof(ServiceRegistryHeader);
+		for (std::uint32_t x = 0; Valid && x < Header->MxNumServices; x++)
+		{
+			const ServiceRegistryRecord *Record = (const ServiceRegistryRecord *)(MxData + Pos);
+
+			if (MxDataSize - Pos < sizeof(ServiceRegistryRecord) || !Record->MxNameSize || MxDataSize - Pos - sizeof(ServiceRegistryRecord) < (size_t)Record->MxNameSize + Record->MxDataSize || GetName(Record)[Record->MxNameSize - 1] != '\0')  Valid = false;
+			else
 			{
-				if (TempBuffer.MxStr[x] == ' ' || TempBuffer.MxStr[x] == '\t')  State = 0;
-				else if (TempBuffer.MxStr[x] == '\'')  State = 1;
-				else if (TempBuffer.MxStr[x] == '\\')  State = 2;
+				MxRecords.Set(GetName(Record), Record->MxNameSize - 1, Record);
 
-				break;
+				Pos += GetRecordSize(Record);
+				if (Pos > MxDataSize)  Pos = MxDataSize;
 			}
 		}
-	}
 
-	if (!NumArgs)  return NULL;
+		if (!Valid)
+		{
+			printf("Warning:  Ignoring invalid or outdated service registry '%s'.\n", TempBuffer.MxStr);
 
-	char **Result = new char *[NumArgs + 1];
-	NumArgs = 0;
-	size_t x2 = 0;
-	State = 0;
+			Close();
 
-	for (x = 0; x < TempBuffer.MxStrPos; x++)
+			return false;
+		}
+
+		return true;
+	}
+
+	void Close()
 	{
-		switch (State)
+		if (MxData != NULL)
+		{
+			munmap(MxData, MxDataSize);
+
+			MxData = NULL;
+			MxDataSize = 0;
+		}
+
+		size_t Pos = MxRecords.GetNextPos();
+		PackedOrderedHashNode<const ServiceRegistryRecord *> *Node;
+		while ((Node = MxRecords.Next(Pos)) != NULL)  MxRecords.Unset(Node);
+	}
+
+	inline size_t GetNumServices() { return MxRecords.GetSize(); }
+
+	const ServiceRegistryRecord *Find(const char *ServiceName)
+	{
+		if (!Open())  return NULL;
+
+		PackedOrderedHashNode<const ServiceRegistryRecord *> *Node = MxRecords.Find(ServiceName, strlen(ServiceName));
+
+		return (Node != NULL ? Node->Value : NULL);
+	}
+
+	// Iterates over the records.  Initialize Pos to GetNextPos() to start at the beginning.
+	const ServiceRegistryRecord *Next(size_t &Pos)
+	{
+		if (!Open())  return NULL;
+
+		PackedOrderedHashNode<const ServiceRegistryRecord *> *Node = MxRecords.Next(Pos);
+
+		return (Node != NULL ? Node->Value : NULL);
+	}
+
+	inline size_t GetNextPos() { return MxRecords.GetNextPos(); }
+
+	static inline const char *GetName(const ServiceRegistryRecord *Record) { return (const char *)(Record + 1); }
+	static inline const char *GetData(const ServiceRegistryRecord *Record) { return GetName(Record) + Record->MxNameSize; }
+	static inline size_t GetRecordSize(const ServiceRegistryRecord *Record) { return (sizeof(ServiceRegistryRecord) + Record->MxNameSize + Record->MxDataSize + 7) & ~(size_t)7; }
+
+	// Returns true if the record still matches the service info file on disk.
+	static inline bool IsCurrent(const ServiceRegistryRecord *Record, const UTF8::File::FileStat &TempStat)
+	{
+		return (Record->MxSize == (std::uint64_t)TempStat.st_size && Record->MxMTime == GetFileStatMTime(TempStat) && Record->MxInode == (std::uint64_t)TempStat.st_ino);
+	}
+
+	// Rewrites the registry with the current service info file for ServiceName (removed if the file no longer exists).
+	// A NULL ServiceName rebuilds the registry from every service info file.  Does nothing if Create is false and there is no registry.
+	static bool Update(const char *ServiceName, bool Create = false)
+	{
+		StaticMixedVar<char[8192]> TempBuffer, TempBuffer2, TempBuffer3;
+		size_t y;
+
+		if (!GetFilename(TempBuffer))
+		{
+			printf("Error:  Unable to retrieve system application storage directory location.\n");
+
+			return false;
+		}
+
+		if (!Create && !UTF8::File::Exists(TempBuffer.MxStr))  return true;
+
+		TempBuffer2.SetStr(TempBuffer.MxStr);
+		TempBuffer2.AppendStr(".tmp");
+
+		UTF8::File TempFile;
+		if (!TempFile.Open(TempBuffer2.MxStr, O_CREAT | O_WRONLY | O_TRUNC, UTF8::File::ShareBoth, 0644))
+		{
+			printf("Error:  Unable to create '%s'.\n", TempBuffer2.MxStr);
+
+			return false;
+		}
+
+		ServiceRegistryHeader Header;
+		memcpy(Header.MxMagic, SERVICE_REGISTRY_MAGIC, sizeof(Header.MxMagic));
+		Header.MxVersion = SERVICE_REGISTRY_VERSION;
+		Header.MxNumServices = 0;
+
+		bool Result = TempFile.Write((const std::uint8_t *)&Header, sizeof(Header), y);
+
+		TempBuffer3.SetSize(TempBuffer.MxStrPos - strlen(SERVICE_REGISTRY_FILENAME));
+		memcpy(TempBuffer3.MxStr, TempBuffer.MxStr, TempBuffer3.MxStrPos);
+		TempBuffer3.MxStr[TempBuffer3.MxStrPos] = '\0';
+		size_t BaseSize = TempBuffer3.MxStrPos;
+
+		if (ServiceName != NULL)
+		{
+			// Copy every other record from the existing registry.
+			ServiceRegistry TempRegistry;
+			TempRegistry.Open();
+			size_t Pos = TempRegistry.GetNextPos();
+			const ServiceRegistryRecord *Record;
+			while (Result && (Record = TempRegistry.Next(Pos)) != NULL)
+			{
+				if (!strcmp(GetName(Record), ServiceName))  continue;
+
+				Result = WriteRecord(TempFile, Record, GetName(Record), GetData(Record));
+				Header.MxNumServices++;
+			}
+
+			TempBuffer3.AppendStr(ServiceName);
+			if (Result && UTF8::File::Exists(TempBuffer3.MxStr))
+			{
+				Result = AddServiceInfoFile(TempFile, ServiceName, TempBuffer3.MxStr);
+				Header.MxNumServices++;
+			}
+		}
+		else
+		{
+			// Service info files don't have a file extension.
+			UTF8::Dir TempDir;
+			if (!TempDir.Open(TempBuffer3.MxStr))  Result = false;
+			else
+			{
+				StaticMixedVar<char[8192]> TempBuffer4;
+				while (Result && TempDir.Read(TempBuffer4.MxStr, sizeof(TempBuffer4.MxStr)))
+				{
+					if (strchr(TempBuffer4.MxStr, '.') != NULL)  continue;
+
+					TempBuffer3.SetSize(BaseSize);
+					TempBuffer3.AppendStr(TempBuffer4.MxStr);
+
+					Result = AddServiceInfoFile(TempFile, TempBuffer4.MxStr, TempBuffer3.MxStr);
+					Header.MxNumServices++;
+				}
+
+				TempDir.Close();
+			}
+		}
+
+		// Finalize the header.
+		if (Result)  Result = (TempFile.Seek(UTF8::File::SeekStart, 0) && TempFile.Write((const std::uint8_t *)&Header, sizeof(Header), y));
+
+		TempFile.Close();
+
+		// Swap in the new registry.  Readers with the old one mapped keep working.
+		if (Result)  Result = UTF8::File::Move(TempBuffer2.MxStr, TempBuffer.MxStr);
+
+		if (!Result)
+		{
+			printf("Error:  Unable to update '%s'.\n", TempBuffer.MxStr);
+
+			UTF8::File::Delete(TempBuffer2.MxStr);
+		}
+
+		return Result;
+	}
+
+private:
+	// Deny copy constructor and assignment operator.
+	ServiceRegistry(const ServiceRegistry &);
+	ServiceRegistry &operator=(const ServiceRegistry &);
+
+	static bool WriteRecord(UTF8::File &TempFile, const ServiceRegistryRecord *Record, const char *Name, const char *Data)
+	{
+		const char Padding[8] = { 0 };
+		size_t y;
+
+		return (TempFile.Write((const std::uint8_t *)Record, sizeof(ServiceRegistryRecord), y) &&
+			TempFile.Write((const std::uint8_t *)Name, Record->MxNameSize, y) &&
+			TempFile.Write((const std::uint8_t *)Data, Record->MxDataSize, y) &&
+			TempFile.Write((const std::uint8_t *)Padding, GetRecordSize(Record) - sizeof(ServiceRegistryRecord) - Record->MxNameSize - Record->MxDataSize, y));
+	}
+
+	static bool AddServiceInfoFile(UTF8::File &TempFile, const char *ServiceName, const char *Filename)
+	{
+		UTF8::File::FileStat TempStat;
+		char *Data;
+		size_t DataSize;
+
+		if (!UTF8::File::Stat(TempStat, Filename) || !UTF8::File::LoadEntireFile(Filename, Data, DataSize))
+		{
+			printf("Error:  Unable to open '%s'.\n", Filename);
+
+			return false;
+		}
+
+		ServiceRegistryRecord Record;
+		Record.MxSize = (std::uint64_t)TempStat.st_size;
+		Record.MxMTime = GetFileStatMTime(TempStat);
+		Record.MxInode = (std::uint64_t)TempStat.st_ino;
+		Record.MxNameSize = (std::uint32_t)strlen(ServiceName) + 1;
+		Record.MxDataSize = (std::uint32_t)DataSize;
+
+		bool Result = WriteRecord(TempFile, &Record, ServiceName, Data);
+
+		delete[] Data;
+
+		return Result;
+	}
+
+	char *MxData;
+	size_t MxDataSize;
+	PackedOrderedHashNoCopy<const ServiceRegistryRecord *> MxRecords;
+	bool MxOpenAttempted;
+};
+
+ServiceRegistry GxServiceRegistry;
+
+bool OpenServiceInfoFile(UTF8::File &DestFile, int Flags, StaticMixedVar<char[8192]> &TempBuffer, const char *ServiceName = NULL)
+{
+	StaticMixedVar<char[8192]> TempBuffer2;
+	size_t y;
+
+	// Locate service info file.
+	y = sizeof(TempBuffer.MxStr);
+	if (!UTF8::AppInfo::GetSystemAppStorageDir(TempBuffer.MxStr, y, "servicemanager"))
+	{
+		printf("Error:  Unable to retrieve system application storage directory location.\n");
+
+		return false;
+	}
+	TempBuffer.SetSize(y - 1);
+	TempBuffer.AppendStr(ServiceName != NULL ? ServiceName : GxApp.MxServiceName);
+
+	// Writes invalidate any cached copy of the service info.
+	if (Flags & (O_WRONLY | O_RDWR))  InvalidateServiceInfo(ServiceName != NULL ? ServiceName : GxApp.MxServiceName);
+
+	if (!DestFile.Open(TempBuffer.MxStr, Flags))
+	{
+		printf("Error:  Unable to open '%s'.\n", TempBuffer.MxStr);
+
+		return false;
+	}
+
+	return true;
+}
+
+// Returns the parsed service info table, loading or reloading the file as needed.
+ServiceInfoTable *GetServiceInfoTable(StaticMixedVar<char[8192]> &TempBuffer, const char *ServiceName = NULL)
+{
+	size_t y;
+
+	if (ServiceName == NULL)  ServiceName = GxApp.MxServiceName;
+
+	// Locate service info file.
+	y = sizeof(TempBuffer.MxStr);
+	if (!UTF8::AppInfo::GetSystemAppStorageDir(TempBuffer.MxStr, y, "servicemanager"))
+	{
+		printf("Error:  Unable to retrieve system application storage directory location.\n");
+
+		return NULL;
+	}
+	TempBuffer.SetSize(y - 1);
+	TempBuffer.AppendStr(ServiceName);
+
+	UTF8::File::FileStat TempStat;
+	if (!UTF8::File::Stat(TempStat, TempBuffer.MxStr))
+	{
+		InvalidateServiceInfo(ServiceName);
+
+		printf("Error:  Unable to open '%s'.\n", TempBuffer.MxStr);
+
+		return NULL;
+	}
+
+	PackedOrderedHashNode<ServiceInfoTable *> *Node = GxServiceInfoCache.Find(ServiceName, strlen(ServiceName));
+	if (Node != NULL && Node->Value->IsCurrent(TempStat))  return Node->Value;
+
+	// Prefer the compiled registry copy unless the file has been changed since the registry was built.
+	ServiceInfoTable *Table = new ServiceInfoTable;
+	const ServiceRegistryRecord *Record = GxServiceRegistry.Find(ServiceName);
+	if (Record != NULL && ServiceRegistry::IsCurrent(Record, TempStat))  Table->Load(ServiceRegistry::GetData(Record), Record->MxDataSize, Record->MxSize, Record->MxMTime, Record->MxInode);
+	else if (!Table->Load(TempBuffer.MxStr, TempStat))
+	{
+		delete Table;
+		InvalidateServiceInfo(ServiceName);
+
+		printf("Error:  Unable to open '%s'.\n", TempBuffer.MxStr);
+
+		return NULL;
+	}
+
+	if (Node == NULL)  Node = GxServiceInfoCache.Set(ServiceName, strlen(ServiceName));
+	else  delete Node->Value;
+	Node->Value = Table;
+
+	return Table;
+}
+
+bool GetServiceInfoStr(const char *Key, StaticMixedVar<char[8192]> &DestBuffer, bool IgnoreKeyNotFound = false, const char *ServiceName = NULL)
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+	ServiceInfoTable *Table = GetServiceInfoTable(TempBuffer, ServiceName);
+	if (Table == NULL)  return false;
+
+	const char *Value = Table->Get(Key);
+	if (Value != NULL)  DestBuffer.SetStr(Value);
+	else if (!IgnoreKeyNotFound)  printf("Warning:  Unable to find '%s' in '%s'.\n", Key, TempBuffer.MxStr);
+
+	return (Value != NULL);
+}
+
+// Takes a string as input and attempts to parse it into command-line arguments.
+// This is fast and mostly functional, not precisely flawless.
+// Destroys TempBuffer in the process.
+char **ExtractArgs(StaticMixedVar<char[8192]> &TempBuffer)
+{
+	// Count the number of arguments.
+	size_t x, NumArgs = 0, State = 0;
+
+	for (x = 0; x < TempBuffer.MxStrPos; x++)
+	{
+		switch (State)
+		{
+			case 0:
+			{
+				// Looking for the start of the next argument.
+				if (TempBuffer.MxStr[x] != ' ' && TempBuffer.MxStr[x] != '\t')
+				{
+					NumArgs++;
+
+					if (TempBuffer.MxStr[x] == '\'')  State = 1;
+					else if (TempBuffer.MxStr[x] == '\\')  State = 2;
+					else  State = 3;
+				}
+
+				break;
+			}
+			case 1:
+			{
+				// Looking for a matching single-quote character.
+				if (TempBuffer.MxStr[x] == '\'')  State = 3;
+
+				break;
+			}
+			case 2:
+			{
+				// Escaped character found.
+				State = 3;
+
+				break;
+			}
+			case 3:
+			{
+				if (TempBuffer.MxStr[x] == ' ' || TempBuffer.MxStr[x] == '\t')  State = 0;
+				else if (TempBuffer.MxStr[x] == '\'')  State = 1;
+				else if (TempBuffer.MxStr[x] == '\\')  State = 2;
+
+				break;
+			}
+		}
+	}
+
+	if (!NumArgs)  return NULL;
+
+	char **Result = new char *[NumArgs + 1];
+	NumArgs = 0;
+	size_t x2 = 0;
+	State = 0;
+
+	for (x = 0; x < TempBuffer.MxStrPos; x++)
+	{
+		switch (State)
 		{
 			case 0:
 			{
@@ -1695,163 +2535,6415 @@ char **ExtractArgs(StaticMixedVar<char[8192]> &TempBuffer)
 	return Result;
 }
 
-int GxLastSignal = -1;
-void CtrlHandler(int signum)
+std::uint64_t GetMonotonicMilliseconds()
 {
-	if (GxLastSignal != signum)
-	{
-		printf("Attempting clean shutdown.  Please wait.\n");
+	struct timespec TempTime;
 
-		GxStopEvent.Fire();
-		GxWakeupEvent.Fire();
+	if (clock_gettime(CLOCK_MONOTONIC, &TempTime) < 0)  return 0;
 
-		GxLastSignal = signum;
-	}
-	else
-	{
-		// User really wants to quit.
-		signal(signum, SIG_DFL);
-		raise(signum);
-	}
+	return ((std::uint64_t)TempTime.tv_sec * 1000) + ((std::uint64_t)TempTime.tv_nsec / 1000000);
 }
 
-void WakeupHandler(int signum)
+std::uint64_t GetMonotonicMicroseconds()
 {
-	GxWakeupEvent.Fire();
+	struct timespec TempTime;
 
-	GxLastSignal = signum;
+	if (clock_gettime(CLOCK_MONOTONIC, &TempTime) < 0)  return 0;
+
+	return ((std::uint64_t)TempTime.tv_sec * 1000000) + ((std::uint64_t)TempTime.tv_nsec / 1000);
 }
 
-int main(int argc, char **argv)
+std::uint64_t GetUnixMicroseconds()
 {
-	if (!ProcessArgs(argc, argv))  return 1;
+	struct timespec TempTime;
 
-	if (!strcasecmp(GxApp.MxMainAction, "install"))
+	if (clock_gettime(CLOCK_REALTIME, &TempTime) < 0)  return 0;
+
+	return ((std::uint64_t)TempTime.tv_sec * 1000000) + ((std::uint64_t)TempTime.tv_nsec / 1000);
+}
+
+// Copies a string into a new[] allocated buffer.
+char *CopyStr(const char *Str)
+{
+	size_t y = strlen(Str);
+	char *Result = new char[y + 1];
+	memcpy(Result, Str, y + 1);
+
+	return Result;
+}
+
+bool InitWakeupPipe()
+{
+	if (pipe(GxWakeupPipe) < 0)  return false;
+
+	for (size_t x = 0; x < 2; x++)
 	{
-		if (GxDebug)
-		{
-			printf("The -debug option is not allowed for the install action.\n\n");
+		fcntl(GxWakeupPipe[x], F_SETFD, FD_CLOEXEC);
+		fcntl(GxWakeupPipe[x], F_SETFL, fcntl(GxWakeupPipe[x], F_GETFL) | O_NONBLOCK);
+	}
 
-			DumpSyntax(argv[0]);
+	return true;
+}
 
-			return 1;
-		}
+// Async signal safe.
+void FireWakeup()
+{
+	int TempErrno = errno;
+
+	if (GxSignalFD < 0 && GxWakeupPipe[1] > -1 && write(GxWakeupPipe[1], "W", 1) < 0)  {}
+
+	errno = TempErrno;
+}
+
+// Routes a signal to a handler.  Call InitSignalFD() after all handlers have been set.
+void SetSignalHandler(int signum, void (*Handler)(int))
+{
+	GxSignalHandlers[signum] = Handler;
+	signal(signum, Handler);
+
+#ifdef __linux__
+	sigaddset(&GxSignalMask, signum);
+#endif
+}
+
+// Blocks the handled signals and delivers them via a signalfd instead.  Falls back to regular signal handlers on failure.
+bool InitSignalFD()
+{
+#ifdef __linux__
+	if (sigprocmask(SIG_BLOCK, &GxSignalMask, &GxOrigSignalMask) < 0)  return false;
+
+	GxSignalFD = signalfd(-1, &GxSignalMask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (GxSignalFD < 0)
+	{
+		sigprocmask(SIG_SETMASK, &GxOrigSignalMask, NULL);
+
+		return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Undoes InitSignalFD() in a forked child.  The signal mask survives execv().
+void ResetSignalMask()
+{
+#ifdef __linux__
+	if (GxSignalFD > -1)  sigprocmask(SIG_SETMASK, &GxOrigSignalMask, NULL);
+#endif
+}
+
+// Dispatches signals that were read from the signalfd.  Returns true if at least one signal was read.
+bool ProcessSignalFDEvents()
+{
+#ifdef __linux__
+	struct signalfd_siginfo TempInfo[16];
+	ssize_t y;
+	bool Result = false;
+
+	while ((y = read(GxSignalFD, TempInfo, sizeof(TempInfo))) >= (ssize_t)sizeof(struct signalfd_siginfo))
+	{
+		for (size_t x = 0; x < (size_t)y / sizeof(struct signalfd_siginfo); x++)
+		{
+			int signum = (int)TempInfo[x].ssi_signo;
+
+			if (signum > 0 && signum < NSIG && GxSignalHandlers[signum] != NULL)  GxSignalHandlers[signum](signum);
+		}
+
+		Result = true;
+	}
+
+	return Result;
+#else
+	return false;
+#endif
+}
+
+// Returns a file descriptor that becomes readable when the process exits.  Returns -1 if the OS doesn't support it.
+int OpenProcessFD(pid_t ProcessID)
+{
+#ifdef __linux__
+	return (int)syscall(__NR_pidfd_open, ProcessID, 0);
+#else
+	(void)ProcessID;
+
+	return -1;
+#endif
+}
+
+// The cgroup v2 directory the service manager started in.  Services get their cgroups below it.
+// Determined once since the service manager may move itself into a leaf cgroup later.
+char *GxCgroupBaseDir = NULL;
+
+bool InitCgroupBaseDir()
+{
+#ifdef __linux__
+	StaticMixedVar<char[8192]> TempBuffer;
+	const char *BaseDir;
+	char Line[4096];
+
+	// Hybrid hierarchies mount cgroup v2 at a separate location.
+	if (access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0)  BaseDir = "/sys/fs/cgroup";
+	else if (access("/sys/fs/cgroup/unified/cgroup.controllers", F_OK) == 0)  BaseDir = "/sys/fs/cgroup/unified";
+	else  return false;
+
+	FILE *fp = fopen("/proc/self/cgroup", "r");
+	if (fp == NULL)  return false;
+
+	TempBuffer.SetStr("");
+	while (fgets(Line, sizeof(Line), fp) != NULL)
+	{
+		if (!strncmp(Line, "0::", 3))
+		{
+			size_t y = strlen(Line);
+			if (y && Line[y - 1] == '\n')  Line[y - 1] = '\0';
+
+			TempBuffer.SetStr(BaseDir);
+			if (strcmp(Line + 3, "/"))  TempBuffer.AppendStr(Line + 3);
+
+			break;
+		}
+	}
+
+	fclose(fp);
+
+	if (!TempBuffer.MxStrPos)  return false;
+
+	GxCgroupBaseDir = CopyStr(TempBuffer.MxStr);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Writes a value to a cgroup or /proc file.  Only uses open() and write() so a child process can use it between fork() and exec().
+bool WriteKernelFile(const char *Filename, const char *Str)
+{
+	int TempFD = open(Filename, O_WRONLY | O_CLOEXEC);
+	if (TempFD < 0)  return false;
+
+	size_t y = strlen(Str);
+	bool Result = (write(TempFD, Str, y) == (ssize_t)y);
+
+	int TempErr = errno;
+	close(TempFD);
+	errno = TempErr;
+
+	return Result;
+}
+
+// Reads a value from a cgroup file.  Key selects a line from a flat keyed file (e.g. "usage_usec" in cpu.stat).
+bool ReadCgroupValue(const char *Dir, const char *Filename, const char *Key, std::uint64_t &Result)
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+	char Line[256];
+	size_t y = (Key != NULL ? strlen(Key) : 0);
+	bool Found = false;
+
+	TempBuffer.SetStr(Dir);
+	TempBuffer.AppendChar('/');
+	TempBuffer.AppendStr(Filename);
+
+	FILE *fp = fopen(TempBuffer.MxStr, "r");
+	if (fp == NULL)  return false;
+
+	while (!Found && fgets(Line, sizeof(Line), fp) != NULL)
+	{
+		if (Key == NULL)  Found = true;
+		else if (!strncmp(Line, Key, y) && Line[y] == ' ')  Found = true;
+
+		if (Found)  Result = strtoull(Line + (Key != NULL ? y + 1 : 0), NULL, 10);
+	}
+
+	fclose(fp);
+
+	return Found;
+}
+
+// Controllers have to be enabled in the parent cgroup before a cgroup gets their files.
+bool EnableCgroupController(const char *Controller)
+{
+	StaticMixedVar<char[8192]> TempBuffer, TempBuffer2;
+
+	TempBuffer.SetStr(GxCgroupBaseDir);
+	TempBuffer.AppendStr("/cgroup.subtree_control");
+
+	TempBuffer2.SetStr("+");
+	TempBuffer2.AppendStr(Controller);
+
+	if (WriteKernelFile(TempBuffer.MxStr, TempBuffer2.MxStr))  return true;
+
+	// A cgroup other than the root can't both contain processes and have controllers enabled.  Move the service manager into a leaf and try again.
+	if (errno != EBUSY)  return false;
+
+	StaticMixedVar<char[8192]> TempBuffer3;
+
+	TempBuffer3.SetStr(GxCgroupBaseDir);
+	TempBuffer3.AppendStr("/servicemanager-supervisor");
+	if (mkdir(TempBuffer3.MxStr, 0755) < 0 && errno != EEXIST)  return false;
+
+	TempBuffer3.AppendStr("/cgroup.procs");
+	if (!WriteKernelFile(TempBuffer3.MxStr, "0"))  return false;
+
+	return WriteKernelFile(TempBuffer.MxStr, TempBuffer2.MxStr);
+}
+
+// Set when the service manager itself was started by a systemd Type=notify unit.
+char *GxSystemdNotifySocket = NULL;
+
+// Sends a state change (e.g. "READY=1") to systemd.  Does nothing when not running under a Type=notify unit.
+void SendSystemdNotify(const char *Message)
+{
+	if (GxSystemdNotifySocket == NULL)  return;
+
+	struct sockaddr_un TempAddr;
+	size_t y = strlen(GxSystemdNotifySocket);
+
+	// '@' denotes an abstract socket.
+	if (y < 2 || y >= sizeof(TempAddr.sun_path) || (GxSystemdNotifySocket[0] != '/' && GxSystemdNotifySocket[0] != '@'))  return;
+
+	memset(&TempAddr, 0, sizeof(TempAddr));
+	TempAddr.sun_family = AF_UNIX;
+	memcpy(TempAddr.sun_path, GxSystemdNotifySocket, y);
+	if (TempAddr.sun_path[0] == '@')  TempAddr.sun_path[0] = '\0';
+	else  y++;
+
+	int TempFD = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (TempFD < 0)  return;
+
+	if (sendto(TempFD, Message, strlen(Message), MSG_NOSIGNAL, (struct sockaddr *)&TempAddr, (socklen_t)(offsetof(struct sockaddr_un, sun_path) + y)) < 0)  {}
+
+	close(TempFD);
+}
+
+// Keeps the service manager's own file descriptors (log files, event loop, etc.) out of a forked child that is about to execv().
+void SetInheritedFDsCloseOnExec()
+{
+#ifdef __linux__
+	if (syscall(__NR_close_range, 3, ~0U, CLOSE_RANGE_CLOEXEC) == 0)  return;
+#endif
+
+	long MaxFD = sysconf(_SC_OPEN_MAX);
+	if (MaxFD < 0 || MaxFD > 65536)  MaxFD = 65536;
+
+	for (int x = 3; x < (int)MaxFD; x++)  fcntl(x, F_SETFD, FD_CLOEXEC);
+}
+
+int GxLastSignal = -1;
+void CtrlHandler(int signum)
+{
+	if (GxLastSignal != signum)
+	{
+		printf("Attempting clean shutdown.  Please wait.\n");
+
+		GxStopEvent.Fire();
+		FireWakeup();
+
+		GxLastSignal = signum;
+	}
+	else
+	{
+		// User really wants to quit.
+		signal(signum, SIG_DFL);
+
+#ifdef __linux__
+		sigset_t TempMask;
+		sigemptyset(&TempMask);
+		sigaddset(&TempMask, signum);
+		sigprocmask(SIG_UNBLOCK, &TempMask, NULL);
+#endif
+
+		raise(signum);
+	}
+}
+
+void WakeupHandler(int signum)
+{
+	FireWakeup();
+
+	GxLastSignal = signum;
+}
+
+// SIGHUP reopens the log files (e.g. after an external log rotation tool renamed them).
+volatile sig_atomic_t GxReopenLogs = 0;
+void ReopenLogsHandler(int signum)
+{
+	GxReopenLogs = 1;
+
+	WakeupHandler(signum);
+}
+
+// Writes log records from a background thread so a slow log disk doesn't stall supervision.
+// Records are formatted once by the caller into a bounded ring buffer and written in batches with writev().
+// Overflow policy:  When the ring buffer is full, new records are dropped instead of blocking the caller.
+// The number of dropped records is logged once there is room again.
+class LogWriter
+{
+public:
+	LogWriter();
+	~LogWriter();
+
+	bool Start(size_t BufferSize);
+	void Stop();
+
+	// Queues a timestamped line for the file descriptor.  Writes directly when the thread isn't running (e.g. in a forked child).
+	void Write(int FD, const char *Message);
+
+	// Queues captured output as-is, optionally prefixed with a timestamp.  Never waits for the thread.  Returns false when the data was dropped.
+	bool WriteOutput(int FD, const char *Data, size_t Size, bool Timestamp);
+
+	// Waits until all queued records have been written.
+	void Flush();
+
+private:
+	// Deny copy constructor and assignment operator.
+	LogWriter(const LogWriter &);
+	LogWriter &operator=(const LogWriter &);
+
+	struct RecordHeader
+	{
+		int MxFD;
+		std::uint32_t MxSize;
+	};
+
+	static void *ThreadMain(void *Data);
+	void Run();
+
+	size_t GetTimePrefix();
+	bool QueueRecord(int FD, const char *Prefix, size_t PrefixSize, const char *Message, size_t MessageSize, bool NewLine = true);
+	void QueueDroppedRecord();
+
+	pthread_t MxThread;
+	pthread_mutex_t MxLock;
+	pthread_cond_t MxWorkCond, MxIdleCond;
+	pid_t MxPID;
+	bool MxRunning, MxStopping;
+
+	// Ring buffer.  Records never wrap.  Space left at the end that is too small for the next record is skipped.
+	char *MxBuffer;
+	size_t MxBufferSize, MxHead, MxTail, MxUsed;
+
+	size_t MxDropped;
+	int MxDroppedFD;
+
+	// The timestamp prefix only changes once per second.
+	time_t MxPrefixTime;
+	char MxPrefix[64];
+	size_t MxPrefixSize;
+};
+
+LogWriter::LogWriter() : MxPID(0), MxRunning(false), MxStopping(false), MxBuffer(NULL), MxBufferSize(0), MxHead(0), MxTail(0), MxUsed(0), MxDropped(0), MxDroppedFD(-1), MxPrefixTime(0), MxPrefixSize(0)
+{
+	pthread_mutex_init(&MxLock, NULL);
+	pthread_cond_init(&MxWorkCond, NULL);
+	pthread_cond_init(&MxIdleCond, NULL);
+}
+
+LogWriter::~LogWriter()
+{
+	Stop();
+
+	pthread_cond_destroy(&MxIdleCond);
+	pthread_cond_destroy(&MxWorkCond);
+	pthread_mutex_destroy(&MxLock);
+
+	delete[] MxBuffer;
+}
+
+bool LogWriter::Start(size_t BufferSize)
+{
+	if (MxRunning)  return true;
+
+	if (MxBuffer == NULL)
+	{
+		MxBuffer = new char[BufferSize];
+		MxBufferSize = BufferSize;
+	}
+
+	MxHead = 0;
+	MxTail = 0;
+	MxUsed = 0;
+	MxStopping = false;
+	MxPID = getpid();
+
+	// The thread must not handle any signals.  The main thread does that.
+	sigset_t TempMask, TempOrigMask;
+	sigfillset(&TempMask);
+	pthread_sigmask(SIG_SETMASK, &TempMask, &TempOrigMask);
+
+	MxRunning = (pthread_create(&MxThread, NULL, ThreadMain, this) == 0);
+
+	pthread_sigmask(SIG_SETMASK, &TempOrigMask, NULL);
+
+	return MxRunning;
+}
+
+void LogWriter::Stop()
+{
+	if (!MxRunning || getpid() != MxPID)  return;
+
+	// Make room to report any dropped records.
+	Flush();
+
+	pthread_mutex_lock(&MxLock);
+	if (MxDropped)  QueueDroppedRecord();
+	MxStopping = true;
+	pthread_cond_signal(&MxWorkCond);
+	pthread_mutex_unlock(&MxLock);
+
+	pthread_join(MxThread, NULL);
+
+	MxRunning = false;
+}
+
+void LogWriter::Flush()
+{
+	if (!MxRunning || getpid() != MxPID)  return;
+
+	pthread_mutex_lock(&MxLock);
+	while (MxUsed)  pthread_cond_wait(&MxIdleCond, &MxLock);
+	pthread_mutex_unlock(&MxLock);
+}
+
+size_t LogWriter::GetTimePrefix()
+{
+	time_t CurrTime = time(NULL);
+
+	if (CurrTime != MxPrefixTime || !MxPrefixSize)
+	{
+		MxPrefixTime = CurrTime;
+		MxPrefixSize = strftime(MxPrefix, sizeof(MxPrefix) - 1, "%Y-%m-%d %H:%M:%S\t", localtime(&CurrTime));
+	}
+
+	return MxPrefixSize;
+}
+
+void LogWriter::Write(int FD, const char *Message)
+{
+	if (FD < 0)  return;
+
+	size_t MessageSize = strlen(Message);
+
+	// Forked children can't rely on the thread (or the lock) so they write directly.
+	if (!MxRunning || getpid() != MxPID)
+	{
+		StaticMixedVar<char[8192]> TempBuffer;
+		char TempPrefix[64];
+		time_t CurrTime = time(NULL);
+
+		strftime(TempPrefix, sizeof(TempPrefix) - 1, "%Y-%m-%d %H:%M:%S\t", localtime(&CurrTime));
+
+		TempBuffer.SetStr(TempPrefix);
+		TempBuffer.AppendStr(Message);
+		TempBuffer.AppendChar('\n');
+
+		if (write(FD, TempBuffer.MxStr, TempBuffer.MxStrPos) < 0)  {}
+
+		return;
+	}
+
+	pthread_mutex_lock(&MxLock);
+
+	if (MxDropped)  QueueDroppedRecord();
+
+	if (MxDropped || !QueueRecord(FD, MxPrefix, GetTimePrefix(), Message, MessageSize))
+	{
+		MxDropped++;
+		MxDroppedFD = FD;
+	}
+
+	pthread_mutex_unlock(&MxLock);
+}
+
+bool LogWriter::WriteOutput(int FD, const char *Data, size_t Size, bool Timestamp)
+{
+	if (FD < 0 || !Size)  return true;
+
+	if (!MxRunning || getpid() != MxPID)
+	{
+		if (Timestamp)
+		{
+			char TempPrefix[64];
+			time_t CurrTime = time(NULL);
+
+			strftime(TempPrefix, sizeof(TempPrefix) - 1, "%Y-%m-%d %H:%M:%S\t", localtime(&CurrTime));
+
+			if (write(FD, TempPrefix, strlen(TempPrefix)) < 0)  {}
+		}
+
+		if (write(FD, Data, Size) < 0)  {}
+
+		return true;
+	}
+
+	bool Result;
+
+	pthread_mutex_lock(&MxLock);
+
+	if (MxDropped)  QueueDroppedRecord();
+
+	Result = (!MxDropped && QueueRecord(FD, MxPrefix, (Timestamp ? GetTimePrefix() : 0), Data, Size, false));
+	if (!Result)
+	{
+		MxDropped++;
+		MxDroppedFD = FD;
+	}
+
+	pthread_mutex_unlock(&MxLock);
+
+	return Result;
+}
+
+// Called with the lock held.
+void LogWriter::QueueDroppedRecord()
+{
+	StaticMixedVar<char[256]> TempBuffer, TempBuffer2;
+
+	TempBuffer.SetStr("Log buffer full.  ");
+	Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)MxDropped);
+	TempBuffer.AppendStr(TempBuffer2.MxStr);
+	TempBuffer.AppendStr(" log message(s) dropped.");
+
+	if (QueueRecord(MxDroppedFD, MxPrefix, GetTimePrefix(), TempBuffer.MxStr, TempBuffer.MxStrPos))  MxDropped = 0;
+}
+
+// Called with the lock held.
+bool LogWriter::QueueRecord(int FD, const char *Prefix, size_t PrefixSize, const char *Message, size_t MessageSize, bool NewLine)
+{
+	RecordHeader TempHeader;
+	size_t RecordSize = sizeof(TempHeader) + PrefixSize + MessageSize + (NewLine ? 1 : 0);
+	size_t Pos;
+
+	if (!MxUsed)
+	{
+		MxHead = 0;
+		MxTail = 0;
+	}
+
+	if (MxUsed && MxHead <= MxTail)
+	{
+		// Between the head and the tail.
+		if (RecordSize > MxTail - MxHead)  return false;
+
+		Pos = MxHead;
+	}
+	else if (RecordSize <= MxBufferSize - MxHead)
+	{
+		// At the end.
+		Pos = MxHead;
+	}
+	else if (RecordSize < MxTail)
+	{
+		// Skip the rest of the buffer and start over at the beginning.
+		if (MxBufferSize - MxHead >= sizeof(TempHeader))
+		{
+			TempHeader.MxFD = -1;
+			TempHeader.MxSize = 0;
+			memcpy(MxBuffer + MxHead, &TempHeader, sizeof(TempHeader));
+		}
+
+		MxUsed += MxBufferSize - MxHead;
+
+		Pos = 0;
+	}
+	else
+	{
+		return false;
+	}
+
+	TempHeader.MxFD = FD;
+	TempHeader.MxSize = (std::uint32_t)RecordSize;
+	memcpy(MxBuffer + Pos, &TempHeader, sizeof(TempHeader));
+	memcpy(MxBuffer + Pos + sizeof(TempHeader), Prefix, PrefixSize);
+	memcpy(MxBuffer + Pos + sizeof(TempHeader) + PrefixSize, Message, MessageSize);
+	if (NewLine)  MxBuffer[Pos + RecordSize - 1] = '\n';
+
+	MxHead = Pos + RecordSize;
+	if (MxHead == MxBufferSize)  MxHead = 0;
+
+	if (!MxUsed)  pthread_cond_signal(&MxWorkCond);
+	MxUsed += RecordSize;
+
+	return true;
+}
+
+void *LogWriter::ThreadMain(void *Data)
+{
+	((LogWriter *)Data)->Run();
+
+	return NULL;
+}
+
+void LogWriter::Run()
+{
+	struct iovec TempIOV[64];
+	RecordHeader TempHeader;
+	size_t Pos, Avail, Consumed, NumIOV;
+	int FD;
+
+	pthread_mutex_lock(&MxLock);
+
+	do
+	{
+		while (!MxUsed && !MxStopping)  pthread_cond_wait(&MxWorkCond, &MxLock);
+
+		if (!MxUsed)  break;
+
+		// The queued records are only touched by this thread until they are released below.
+		Pos = MxTail;
+		Avail = MxUsed;
+
+		pthread_mutex_unlock(&MxLock);
+
+		// Write consecutive records for the same file descriptor with a single writev().
+		Consumed = 0;
+		NumIOV = 0;
+		FD = -1;
+		while (Consumed < Avail && NumIOV < sizeof(TempIOV) / sizeof(TempIOV[0]))
+		{
+			if (MxBufferSize - Pos >= sizeof(TempHeader))  memcpy(&TempHeader, MxBuffer + Pos, sizeof(TempHeader));
+			else  TempHeader.MxFD = -1;
+
+			if (TempHeader.MxFD < 0)
+			{
+				// Skipped space at the end.
+				Consumed += MxBufferSize - Pos;
+				Pos = 0;
+
+				continue;
+			}
+
+			if (NumIOV && TempHeader.MxFD != FD)  break;
+
+			FD = TempHeader.MxFD;
+			TempIOV[NumIOV].iov_base = MxBuffer + Pos + sizeof(TempHeader);
+			TempIOV[NumIOV].iov_len = TempHeader.MxSize - sizeof(TempHeader);
+			NumIOV++;
+
+			Consumed += TempHeader.MxSize;
+			Pos += TempHeader.MxSize;
+			if (Pos == MxBufferSize)  Pos = 0;
+		}
+
+		if (NumIOV && writev(FD, TempIOV, (int)NumIOV) < 0)  {}
+
+		pthread_mutex_lock(&MxLock);
+
+		MxTail = Pos;
+		MxUsed -= Consumed;
+
+		if (!MxUsed)  pthread_cond_broadcast(&MxIdleCond);
+	} while (1);
+
+	pthread_cond_broadcast(&MxIdleCond);
+	pthread_mutex_unlock(&MxLock);
+}
+
+// One writer thread serves the log files of every service.
+LogWriter GxLogWriter;
+
+// Writes metrics files from a background thread so a slow disk doesn't stall supervision.
+// Each file is written to a temporary file and renamed into place so collectors never see a partial file.
+// Only the latest contents of each file are kept.  A newer snapshot replaces one that hasn't been written yet.
+class MetricsWriter
+{
+public:
+	MetricsWriter();
+	~MetricsWriter();
+
+	bool Start();
+	void Stop();
+
+	// Queues the contents of a metrics file and takes ownership of Data.  Writes directly when the thread isn't running.
+	void Write(const char *Filename, char *Data, size_t DataSize);
+
+private:
+	// Deny copy constructor and assignment operator.
+	MetricsWriter(const MetricsWriter &);
+	MetricsWriter &operator=(const MetricsWriter &);
+
+	struct PendingFile
+	{
+		char *MxFilename;
+		char *MxData;
+		size_t MxDataSize;
+	};
+
+	static void *ThreadMain(void *Data);
+	void Run();
+
+	static void WriteFile(const char *Filename, const char *Data, size_t DataSize);
+
+	pthread_t MxThread;
+	pthread_mutex_t MxLock;
+	pthread_cond_t MxWorkCond;
+	pid_t MxPID;
+	bool MxRunning, MxStopping;
+
+	PendingFile *MxPending;
+	size_t MxNumPending, MxMaxPending;
+};
+
+MetricsWriter::MetricsWriter() : MxPID(0), MxRunning(false), MxStopping(false), MxPending(NULL), MxNumPending(0), MxMaxPending(0)
+{
+	pthread_mutex_init(&MxLock, NULL);
+	pthread_cond_init(&MxWorkCond, NULL);
+}
+
+MetricsWriter::~MetricsWriter()
+{
+	Stop();
+
+	pthread_cond_destroy(&MxWorkCond);
+	pthread_mutex_destroy(&MxLock);
+
+	for (size_t x = 0; x < MxNumPending; x++)
+	{
+		delete[] MxPending[x].MxFilename;
+		delete[] MxPending[x].MxData;
+	}
+
+	delete[] MxPending;
+}
+
+bool MetricsWriter::Start()
+{
+	if (MxRunning)  return true;
+
+	MxStopping = false;
+	MxPID = getpid();
+
+	// The thread must not handle any signals.  The main thread does that.
+	sigset_t TempMask, TempOrigMask;
+	sigfillset(&TempMask);
+	pthread_sigmask(SIG_SETMASK, &TempMask, &TempOrigMask);
+
+	MxRunning = (pthread_create(&MxThread, NULL, ThreadMain, this) == 0);
+
+	pthread_sigmask(SIG_SETMASK, &TempOrigMask, NULL);
+
+	return MxRunning;
+}
+
+void MetricsWriter::Stop()
+{
+	if (!MxRunning || getpid() != MxPID)  return;
+
+	// The thread writes out anything still pending before it exits.
+	pthread_mutex_lock(&MxLock);
+	MxStopping = true;
+	pthread_cond_signal(&MxWorkCond);
+	pthread_mutex_unlock(&MxLock);
+
+	pthread_join(MxThread, NULL);
+
+	MxRunning = false;
+}
+
+void MetricsWriter::Write(const char *Filename, char *Data, size_t DataSize)
+{
+	if (!MxRunning || getpid() != MxPID)
+	{
+		WriteFile(Filename, Data, DataSize);
+
+		delete[] Data;
+
+		return;
+	}
+
+	pthread_mutex_lock(&MxLock);
+
+	size_t x;
+	for (x = 0; x < MxNumPending && strcmp(MxPending[x].MxFilename, Filename); x++);
+
+	if (x < MxNumPending)
+	{
+		// Replace the snapshot that hasn't been written yet.
+		delete[] MxPending[x].MxData;
+	}
+	else
+	{
+		if (MxNumPending == MxMaxPending)
+		{
+			size_t NewMaxPending = (MxMaxPending ? MxMaxPending * 2 : 4);
+			PendingFile *NewPending = new PendingFile[NewMaxPending];
+
+			for (size_t x2 = 0; x2 < MxNumPending; x2++)  NewPending[x2] = MxPending[x2];
+
+			delete[] MxPending;
+			MxPending = NewPending;
+			MxMaxPending = NewMaxPending;
+		}
+
+		MxPending[x].MxFilename = CopyStr(Filename);
+		MxNumPending++;
+	}
+
+	MxPending[x].MxData = Data;
+	MxPending[x].MxDataSize = DataSize;
+
+	pthread_cond_signal(&MxWorkCond);
+	pthread_mutex_unlock(&MxLock);
+}
+
+void *MetricsWriter::ThreadMain(void *Data)
+{
+	((MetricsWriter *)Data)->Run();
+
+	return NULL;
+}
+
+void MetricsWriter::Run()
+{
+	PendingFile TempFile;
+
+	pthread_mutex_lock(&MxLock);
+
+	do
+	{
+		while (!MxNumPending && !MxStopping)  pthread_cond_wait(&MxWorkCond, &MxLock);
+
+		if (!MxNumPending)  break;
+
+		// Take the oldest file.
+		TempFile = MxPending[0];
+		MxNumPending--;
+		for (size_t x = 0; x < MxNumPending; x++)  MxPending[x] = MxPending[x + 1];
+
+		pthread_mutex_unlock(&MxLock);
+
+		WriteFile(TempFile.MxFilename, TempFile.MxData, TempFile.MxDataSize);
+
+		delete[] TempFile.MxFilename;
+		delete[] TempFile.MxData;
+
+		pthread_mutex_lock(&MxLock);
+	} while (1);
+
+	pthread_mutex_unlock(&MxLock);
+}
+
+void MetricsWriter::WriteFile(const char *Filename, const char *Data, size_t DataSize)
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+	UTF8::File TempFile;
+	size_t y;
+
+	TempBuffer.SetStr(Filename);
+	TempBuffer.AppendStr(".tmp");
+
+	if (!TempFile.Open(TempBuffer.MxStr, O_CREAT | O_WRONLY | O_TRUNC, UTF8::File::ShareBoth, 0644))  return;
+
+	bool Result = TempFile.Write((const std::uint8_t *)Data, DataSize, y);
+
+	TempFile.Close();
+
+	if (!Result || rename(TempBuffer.MxStr, Filename) < 0)  UTF8::File::Delete(TempBuffer.MxStr);
+}
+
+// One writer thread serves the metrics files of every service.
+MetricsWriter GxMetricsWriter;
+
+
+// Implemented by anything that wants to know when a file descriptor becomes readable.
+class EventHandler
+{
+public:
+	virtual ~EventHandler()  {}
+
+	virtual void HandleEvent(int FD) = 0;
+};
+
+// A minimal reactor.  Uses epoll on Linux and poll() everywhere else.
+class EventLoop
+{
+public:
+	EventLoop() : MxHandlers(NULL), MxNumHandlers(0),
+#ifdef __linux__
+		MxEpollFD(-1)
+#else
+		MxPollFDs(NULL), MxNumFDs(0), MxMaxFDs(0)
+#endif
+	{
+	}
+
+	~EventLoop()
+	{
+#ifdef __linux__
+		if (MxEpollFD > -1)  close(MxEpollFD);
+#else
+		delete[] MxPollFDs;
+#endif
+
+		delete[] MxHandlers;
+	}
+
+	bool Init()
+	{
+#ifdef __linux__
+		MxEpollFD = epoll_create1(EPOLL_CLOEXEC);
+
+		return (MxEpollFD > -1);
+#else
+		return true;
+#endif
+	}
+
+	// Writable watches for the file descriptor to become writable instead (e.g. a connect() in progress).
+	bool Add(int FD, EventHandler *Handler, bool Writable = false)
+	{
+		if (FD < 0)  return false;
+
+		// Handlers are indexed by file descriptor.
+		if ((size_t)FD >= MxNumHandlers)
+		{
+			size_t NumHandlers = (MxNumHandlers ? MxNumHandlers : 64);
+			while ((size_t)FD >= NumHandlers)  NumHandlers *= 2;
+
+			EventHandler **Handlers = new EventHandler *[NumHandlers];
+			for (size_t x = 0; x < NumHandlers; x++)  Handlers[x] = (x < MxNumHandlers ? MxHandlers[x] : NULL);
+
+			delete[] MxHandlers;
+			MxHandlers = Handlers;
+			MxNumHandlers = NumHandlers;
+		}
+
+#ifdef __linux__
+		struct epoll_event TempEvent;
+
+		TempEvent.events = (Writable ? EPOLLOUT : EPOLLIN);
+		TempEvent.data.u64 = 0;
+		TempEvent.data.fd = FD;
+
+		if (epoll_ctl(MxEpollFD, EPOLL_CTL_ADD, FD, &TempEvent) < 0)  return false;
+#else
+		size_t x;
+		for (x = 0; x < MxNumFDs && MxPollFDs[x].fd > -1; x++);
+
+		if (x == MxMaxFDs)
+		{
+			MxMaxFDs = (MxMaxFDs ? MxMaxFDs * 2 : 16);
+
+			struct pollfd *PollFDs = new struct pollfd[MxMaxFDs];
+			if (MxNumFDs)  memcpy(PollFDs, MxPollFDs, sizeof(struct pollfd) * MxNumFDs);
+
+			delete[] MxPollFDs;
+			MxPollFDs = PollFDs;
+		}
+
+		MxPollFDs[x].fd = FD;
+		MxPollFDs[x].events = (Writable ? POLLOUT : POLLIN);
+		MxPollFDs[x].revents = 0;
+
+		if (x == MxNumFDs)  MxNumFDs++;
+#endif
+
+		MxHandlers[FD] = Handler;
+
+		return true;
+	}
+
+	// Call before closing the file descriptor.
+	void Remove(int FD)
+	{
+		if (FD < 0 || (size_t)FD >= MxNumHandlers || MxHandlers[FD] == NULL)  return;
+
+		MxHandlers[FD] = NULL;
+
+#ifdef __linux__
+		struct epoll_event TempEvent;
+
+		epoll_ctl(MxEpollFD, EPOLL_CTL_DEL, FD, &TempEvent);
+#else
+		for (size_t x = 0; x < MxNumFDs; x++)
+		{
+			if (MxPollFDs[x].fd == FD)  MxPollFDs[x].fd = -1;
+		}
+#endif
+	}
+
+	// Waits up to Timeout milliseconds for file descriptors to become readable (or writable) and calls their handlers.
+	// Returns false on timeout.
+	bool Wait(std::uint32_t Timeout)
+	{
+		int TempTimeout = (Timeout == INFINITE ? -1 : (Timeout > 0x7FFFFFFF ? 0x7FFFFFFF : (int)Timeout));
+		int FD;
+
+#ifdef __linux__
+		struct epoll_event TempEvents[64];
+
+		int Result = epoll_wait(MxEpollFD, TempEvents, sizeof(TempEvents) / sizeof(struct epoll_event), TempTimeout);
+		if (Result <= 0)  return (Result < 0);
+
+		for (int x = 0; x < Result; x++)
+		{
+			FD = TempEvents[x].data.fd;
+
+			if ((size_t)FD < MxNumHandlers && MxHandlers[FD] != NULL)  MxHandlers[FD]->HandleEvent(FD);
+		}
+#else
+		int Result = poll(MxPollFDs, (nfds_t)MxNumFDs, TempTimeout);
+		if (Result <= 0)  return (Result < 0);
+
+		// Handlers may add and remove file descriptors.
+		for (size_t x = 0; x < MxNumFDs; x++)
+		{
+			if (MxPollFDs[x].fd > -1 && MxPollFDs[x].revents)
+			{
+				FD = MxPollFDs[x].fd;
+				MxPollFDs[x].revents = 0;
+
+				if ((size_t)FD < MxNumHandlers && MxHandlers[FD] != NULL)  MxHandlers[FD]->HandleEvent(FD);
+			}
+		}
+#endif
+
+		return true;
+	}
+
+private:
+	// Deny copy constructor and assignment operator.
+	EventLoop(const EventLoop &);
+	EventLoop &operator=(const EventLoop &);
+
+	EventHandler **MxHandlers;
+	size_t MxNumHandlers;
+
+#ifdef __linux__
+	int MxEpollFD;
+#else
+	struct pollfd *MxPollFDs;
+	size_t MxNumFDs, MxMaxFDs;
+#endif
+};
+
+// A monotonic deadline in milliseconds.  Data identifies the owner.
+class Timer
+{
+public:
+	Timer(void *Data) : MxTS(0), MxPos(0), MxData(Data)
+	{
+	}
+
+	std::uint64_t MxTS;
+
+	// Position in the queue plus one.  0 when not queued.
+	size_t MxPos;
+
+	void *MxData;
+};
+
+// Owns every deadline of an event loop.  A binary min-heap so the next deadline is always at the top and scheduling,
+// rescheduling, and cancelling a timer are O(log n).
+class TimerQueue
+{
+public:
+	TimerQueue() : MxTimers(NULL), MxNumTimers(0), MxMaxTimers(0)
+	{
+	}
+
+	~TimerQueue()
+	{
+		delete[] MxTimers;
+	}
+
+	// Schedules, reschedules, or cancels (TS = 0) a timer.
+	void Set(Timer *TempTimer, std::uint64_t TS)
+	{
+		if (!TS)
+		{
+			if (TempTimer->MxPos)  Remove(TempTimer->MxPos - 1);
+
+			TempTimer->MxTS = 0;
+
+			return;
+		}
+
+		if (!TempTimer->MxPos)
+		{
+			if (MxNumTimers == MxMaxTimers)
+			{
+				MxMaxTimers = (MxMaxTimers ? MxMaxTimers * 2 : 16);
+
+				Timer **Timers = new Timer *[MxMaxTimers];
+				for (size_t x = 0; x < MxNumTimers; x++)  Timers[x] = MxTimers[x];
+
+				delete[] MxTimers;
+				MxTimers = Timers;
+			}
+
+			TempTimer->MxTS = TS;
+			TempTimer->MxPos = MxNumTimers + 1;
+			MxTimers[MxNumTimers++] = TempTimer;
+
+			SiftUp(MxNumTimers - 1);
+		}
+		else if (TS != TempTimer->MxTS)
+		{
+			bool Earlier = (TS < TempTimer->MxTS);
+
+			TempTimer->MxTS = TS;
+
+			if (Earlier)  SiftUp(TempTimer->MxPos - 1);
+			else  SiftDown(TempTimer->MxPos - 1);
+		}
+	}
+
+	// Returns 0 when nothing is scheduled.
+	inline std::uint64_t GetNextTS() const
+	{
+		return (MxNumTimers ? MxTimers[0]->MxTS : 0);
+	}
+
+	// Removes and returns the earliest timer that has expired.  Returns NULL when none have.
+	Timer *PopExpired(std::uint64_t CurrTS)
+	{
+		if (!MxNumTimers || MxTimers[0]->MxTS > CurrTS)  return NULL;
+
+		Timer *Result = MxTimers[0];
+
+		Remove(0);
+		Result->MxTS = 0;
+
+		return Result;
+	}
+
+private:
+	// Deny copy constructor and assignment operator.
+	TimerQueue(const TimerQueue &);
+	TimerQueue &operator=(const TimerQueue &);
+
+	inline void Place(size_t Pos, Timer *TempTimer)
+	{
+		MxTimers[Pos] = TempTimer;
+		TempTimer->MxPos = Pos + 1;
+	}
+
+	void SiftUp(size_t Pos)
+	{
+		Timer *TempTimer = MxTimers[Pos];
+
+		while (Pos && MxTimers[(Pos - 1) / 2]->MxTS > TempTimer->MxTS)
+		{
+			Place(Pos, MxTimers[(Pos - 1) / 2]);
+			Pos = (Pos - 1) / 2;
+		}
+
+		Place(Pos, TempTimer);
+	}
+
+	void SiftDown(size_t Pos)
+	{
+		Timer *TempTimer = MxTimers[Pos];
+		size_t Child;
+
+		while ((Child = Pos * 2 + 1) < MxNumTimers)
+		{
+			if (Child + 1 < MxNumTimers && MxTimers[Child + 1]->MxTS < MxTimers[Child]->MxTS)  Child++;
+			if (MxTimers[Child]->MxTS >= TempTimer->MxTS)  break;
+
+			Place(Pos, MxTimers[Child]);
+			Pos = Child;
+		}
+
+		Place(Pos, TempTimer);
+	}
+
+	void Remove(size_t Pos)
+	{
+		MxTimers[Pos]->MxPos = 0;
+
+		MxNumTimers--;
+		if (Pos == MxNumTimers)  return;
+
+		// Move the last timer into the hole and restore the heap in whichever direction it needs.
+		Timer *TempTimer = MxTimers[MxNumTimers];
+
+		Place(Pos, TempTimer);
+		SiftDown(Pos);
+		SiftUp(TempTimer->MxPos - 1);
+	}
+
+	Timer **MxTimers;
+	size_t MxNumTimers, MxMaxTimers;
+};
+
+
+// Control socket protocol.  Fixed size messages in native byte order since both ends are on the same machine.
+// A connection may send several requests but only one can be outstanding at a time.
+#define CONTROL_PROTOCOL_VERSION   2
+
+#define CONTROL_CMD_STATUS    1
+#define CONTROL_CMD_STOP      2
+#define CONTROL_CMD_START     3
+#define CONTROL_CMD_RESTART   4
+#define CONTROL_CMD_RELOAD    5
+#define CONTROL_CMD_WAITREADY 6
+#define CONTROL_CMD_ROLLINGRESTART 7
+
+#define CONTROL_RESULT_OK          0
+#define CONTROL_RESULT_FAILED      1
+#define CONTROL_RESULT_BAD_REQUEST 2
+
+#define CONTROL_STATE_STOPPED     0
+#define CONTROL_STATE_RUNNING     1
+#define CONTROL_STATE_STOPPING    2
+#define CONTROL_STATE_RELOADING   3
+
+#define CONTROL_FLAG_SUPERVISE    0x01
+#define CONTROL_FLAG_READY        0x02
+#define CONTROL_FLAG_FAILED       0x04
+#define CONTROL_FLAG_BACKOFF      0x08
+#define CONTROL_FLAG_CGROUP       0x10
+
+// cgroup statistics that the kernel doesn't provide (e.g. the controller isn't enabled).
+#define CONTROL_CGROUP_NONE   ((std::uint64_t)-1)
+
+struct ControlRequest
+{
+	std::uint8_t MxVersion;
+	std::uint8_t MxCommand;
+
+	// Rolling restarts only.  How many copies of the executable may be unavailable at once (0 is the same as 1).
+	std::uint16_t MxMaxUnavailable;
+};
+
+struct ControlResponse
+{
+	std::uint8_t MxVersion;
+	std::uint8_t MxCommand;
+	std::uint8_t MxResult;
+	std::uint8_t MxState;
+	std::uint32_t MxFlags;
+	std::int32_t MxExitCode;
+	std::uint32_t MxManagerPID;
+	std::uint32_t MxServicePID;
+	std::uint32_t MxPrevServicePID;
+	std::uint32_t MxStartCount;
+	std::uint64_t MxStartTime;
+
+	// Only valid with CONTROL_FLAG_CGROUP.  Covers every process of the service.
+	std::uint64_t MxCgroupMemory;
+	std::uint64_t MxCgroupProcesses;
+	std::uint64_t MxCgroupCPUUsage;
+	std::uint64_t MxCgroupCPUThrottled;
+	std::uint64_t MxCgroupOOMKills;
+};
+
+// The control socket lives in the abstract namespace on Linux and next to the service info file elsewhere.
+// Suffix selects a different socket for the same service (e.g. "notify").
+bool GetControlSocketAddr(const char *ServiceName, struct sockaddr_un &Addr, socklen_t &AddrLen, const char *Suffix = NULL)
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+
+	memset(&Addr, 0, sizeof(Addr));
+	Addr.sun_family = AF_UNIX;
+
+#ifdef __linux__
+	TempBuffer.SetStr("servicemanager/");
+	TempBuffer.AppendStr(ServiceName);
+	if (Suffix != NULL)
+	{
+		TempBuffer.AppendChar('/');
+		TempBuffer.AppendStr(Suffix);
+	}
+	if (TempBuffer.MxStrPos + 1 > sizeof(Addr.sun_path))  return false;
+
+	memcpy(Addr.sun_path + 1, TempBuffer.MxStr, TempBuffer.MxStrPos);
+	AddrLen = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + TempBuffer.MxStrPos);
+#else
+	size_t y = sizeof(TempBuffer.MxStr);
+	if (!UTF8::AppInfo::GetSystemAppStorageDir(TempBuffer.MxStr, y, "servicemanager"))  return false;
+	TempBuffer.SetSize(y - 1);
+	TempBuffer.AppendStr(ServiceName);
+	TempBuffer.AppendChar('.');
+	TempBuffer.AppendStr(Suffix != NULL ? Suffix : "sock");
+	if (TempBuffer.MxStrPos + 1 > sizeof(Addr.sun_path))  return false;
+
+	memcpy(Addr.sun_path, TempBuffer.MxStr, TempBuffer.MxStrPos + 1);
+	AddrLen = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + TempBuffer.MxStrPos + 1);
+#endif
+
+	return true;
+}
+
+
+// Lifecycle latencies.  Fork to exec, exec to readiness, stop notification or SIGTERM to exit, and reload notification to acknowledgement.
+#define LATENCY_EXEC    0
+#define LATENCY_READY   1
+#define LATENCY_STOP    2
+#define LATENCY_RELOAD  3
+#define LATENCY_NUM     4
+
+const char *GxLatencyNames[LATENCY_NUM] = { "Fork to exec", "Exec to ready", "Stop", "Reload" };
+
+// Latency histogram summary.  All values are in microseconds.  Percentiles are the upper bound of the bucket they fall in.
+struct LatencySummary
+{
+	std::uint64_t MxCount, MxSum, MxMin, MxMax, MxP50, MxP90, MxP99;
+};
+
+// Fixed-bucket log-linear histogram (HDR style) of microsecond values.  Values below 16 have their own buckets.  Every
+// power of two after that is split into 8 linear sub-buckets, so the error stays under 12.5% up to about 19 hours.
+#define LATENCY_BUCKETS  (16 + (36 - 4) * 8)
+
+class LatencyHistogram
+{
+public:
+	LatencyHistogram() : MxCount(0), MxSum(0), MxMin(0), MxMax(0)
+	{
+		memset(MxBuckets, 0, sizeof(MxBuckets));
+	}
+
+	void Add(std::uint64_t Value)
+	{
+		MxBuckets[GetBucket(Value)]++;
+
+		if (!MxCount || Value < MxMin)  MxMin = Value;
+		if (Value > MxMax)  MxMax = Value;
+
+		MxCount++;
+		MxSum += Value;
+	}
+
+	void GetSummary(LatencySummary &Result) const
+	{
+		Result.MxCount = MxCount;
+		Result.MxSum = MxSum;
+		Result.MxMin = MxMin;
+		Result.MxMax = MxMax;
+		Result.MxP50 = GetPercentile(50);
+		Result.MxP90 = GetPercentile(90);
+		Result.MxP99 = GetPercentile(99);
+	}
+
+private:
+	static size_t GetBucket(std::uint64_t Value)
+	{
+		if (Value < 16)  return (size_t)Value;
+
+		size_t Bits = 63 - (size_t)__builtin_clzll(Value);
+		if (Bits > 35)  return LATENCY_BUCKETS - 1;
+
+		return 16 + (Bits - 4) * 8 + (size_t)((Value >> (Bits - 3)) & 7);
+	}
+
+	static std::uint64_t GetBucketMax(size_t Num)
+	{
+		if (Num < 16)  return Num;
+
+		size_t Bits = 4 + (Num - 16) / 8;
+
+		return ((std::uint64_t)(8 + (Num - 16) % 8 + 1) << (Bits - 3)) - 1;
+	}
+
+	std::uint64_t GetPercentile(std::uint64_t Percent) const
+	{
+		if (!MxCount)  return 0;
+
+		std::uint64_t Target = (MxCount * Percent + 99) / 100, Total = 0;
+
+		for (size_t x = 0; x < LATENCY_BUCKETS; x++)
+		{
+			Total += MxBuckets[x];
+			if (Total >= Target)  return (GetBucketMax(x) < MxMax ? GetBucketMax(x) : MxMax);
+		}
+
+		return MxMax;
+	}
+
+	std::uint32_t MxBuckets[LATENCY_BUCKETS];
+	std::uint64_t MxCount, MxSum, MxMin, MxMax;
+};
+
+void AppendLatencySummaryStr(StaticMixedVar<char[8192]> &Dest, const LatencySummary &Summary)
+{
+	Dest.AppendFormattedStr("%llu samples, min %.3fs, p50 %.3fs, p90 %.3fs, p99 %.3fs, max %.3fs", (unsigned long long)Summary.MxCount, (double)Summary.MxMin / 1000000.0,
+		(double)Summary.MxP50 / 1000000.0, (double)Summary.MxP90 / 1000000.0, (double)Summary.MxP99 / 1000000.0, (double)Summary.MxMax / 1000000.0);
+}
+
+// Shared memory status table.  Every service manager publishes the status of its services into a fixed slot so
+// 'status' can read any service without talking to the service manager.  Slots are seqlocked:  the writer makes the
+// sequence number odd while updating and readers retry until they see the same even sequence number before and after.
+#define STATUS_TABLE_NAME     "servicemanager_status_v3"
+#define STATUS_TABLE_SLOTS    512
+#define STATUS_TABLE_NAME_MAX 120
+
+struct StatusTableSlot
+{
+	volatile std::uint32_t MxSeq;
+	volatile std::uint32_t MxOwnerPID;
+	char MxName[STATUS_TABLE_NAME_MAX];
+	ControlResponse MxStatus;
+	LatencySummary MxLatency[LATENCY_NUM];
+	std::uint64_t MxUpdateTime;
+};
+
+class StatusTable
+{
+public:
+	StatusTable() : MxSlots(NULL)
+	{
+	}
+
+	// Maps the shared memory on first use.
+	bool Open()
+	{
+		if (MxSlots != NULL)  return true;
+
+		if (!MxMem.Create(STATUS_TABLE_NAME, sizeof(StatusTableSlot) * STATUS_TABLE_SLOTS))  return false;
+
+		MxSlots = (StatusTableSlot *)MxMem.RawData();
+
+		return true;
+	}
+
+	inline StatusTableSlot *GetSlot(size_t Num)  { return (Open() && Num < STATUS_TABLE_SLOTS ? MxSlots + Num : NULL); }
+
+	// Claims a slot for a service.  Takes over slots left behind by service managers that are gone.
+	StatusTableSlot *Claim(const char *ServiceName)
+	{
+		if (strlen(ServiceName) >= STATUS_TABLE_NAME_MAX || !Open())  return NULL;
+
+		std::uint32_t OwnerPID, CurrPID = (std::uint32_t)getpid();
+		for (size_t x = 0; x < STATUS_TABLE_SLOTS; x++)
+		{
+			StatusTableSlot *Slot = MxSlots + x;
+
+			OwnerPID = Slot->MxOwnerPID;
+			if (OwnerPID && (OwnerPID == CurrPID || kill((pid_t)OwnerPID, 0) == 0 || errno != ESRCH))  continue;
+
+			if (__sync_bool_compare_and_swap(&Slot->MxOwnerPID, OwnerPID, CurrPID))
+			{
+				BeginWrite(Slot);
+				strcpy(Slot->MxName, ServiceName);
+				memset(&Slot->MxStatus, 0, sizeof(Slot->MxStatus));
+				Slot->MxUpdateTime = (std::uint64_t)time(NULL);
+				EndWrite(Slot);
+
+				return Slot;
+			}
+		}
+
+		return NULL;
+	}
+
+	static void Release(StatusTableSlot *Slot)
+	{
+		BeginWrite(Slot);
+		Slot->MxName[0] = '\0';
+		EndWrite(Slot);
+
+		__sync_synchronize();
+		Slot->MxOwnerPID = 0;
+	}
+
+	static void Publish(StatusTableSlot *Slot, const ControlResponse &Status, const LatencySummary *Latency)
+	{
+		// Skip the write when nothing changed.
+		if (!memcmp(&Slot->MxStatus, &Status, sizeof(Status)) && !memcmp(Slot->MxLatency, Latency, sizeof(Slot->MxLatency)))  return;
+
+		BeginWrite(Slot);
+		Slot->MxStatus = Status;
+		memcpy(Slot->MxLatency, Latency, sizeof(Slot->MxLatency));
+		Slot->MxUpdateTime = (std::uint64_t)time(NULL);
+		EndWrite(Slot);
+	}
+
+	// Takes a consistent snapshot of a slot.  Returns false for unused slots.
+	static bool Read(const StatusTableSlot *Slot, StatusTableSlot &Result)
+	{
+		std::uint32_t Seq;
+
+		do
+		{
+			Seq = Slot->MxSeq;
+			__sync_synchronize();
+
+			memcpy(&Result, (const void *)Slot, sizeof(Result));
+
+			__sync_synchronize();
+		} while ((Seq & 1) || Seq != Slot->MxSeq);
+
+		return (Result.MxOwnerPID && Result.MxName[0]);
+	}
+
+	// Finds the slot for a service whose service manager is still running.
+	bool Find(const char *ServiceName, StatusTableSlot &Result)
+	{
+		if (!Open())  return false;
+
+		for (size_t x = 0; x < STATUS_TABLE_SLOTS; x++)
+		{
+			if (Read(MxSlots + x, Result) && !strcmp(Result.MxName, ServiceName))  return (kill((pid_t)Result.MxOwnerPID, 0) == 0 || errno != ESRCH);
+		}
+
+		return false;
+	}
+
+private:
+	// Deny copy constructor and assignment operator.
+	StatusTable(const StatusTable &);
+	StatusTable &operator=(const StatusTable &);
+
+	static inline void BeginWrite(StatusTableSlot *Slot)
+	{
+		Slot->MxSeq++;
+		__sync_synchronize();
+	}
+
+	static inline void EndWrite(StatusTableSlot *Slot)
+	{
+		__sync_synchronize();
+		Slot->MxSeq++;
+	}
+
+	Sync::SharedMem MxMem;
+	StatusTableSlot *MxSlots;
+};
+
+StatusTable GxStatusTable;
+
+
+// Metrics written by -metrics.  The order matches ServiceRunner::AppendMetric().
+struct MetricDef
+{
+	const char *MxName;
+	const char *MxType;
+	const char *MxHelp;
+};
+
+const MetricDef GxMetricDefs[] = {
+	{ "servicemanager_up", "gauge", "Whether the service process is running." },
+	{ "servicemanager_ready", "gauge", "Whether the service process is running and has signaled readiness." },
+	{ "servicemanager_process_starts_total", "counter", "Number of times the service process was started." },
+	{ "servicemanager_restarts_total", "counter", "Number of times the service process was started again after the first start." },
+	{ "servicemanager_process_exits_total", "counter", "Number of times the service process exited." },
+	{ "servicemanager_process_signaled_exits_total", "counter", "Number of times the service process was terminated by a signal." },
+	{ "servicemanager_force_terminations_total", "counter", "Number of times the service process had to be sent SIGTERM because the notification file was ignored or unavailable." },
+	{ "servicemanager_kills_total", "counter", "Number of times the service process was sent SIGKILL." },
+	{ "servicemanager_last_exit_code", "gauge", "Exit code of the last service process." },
+	{ "servicemanager_last_termination_signal", "gauge", "Signal that terminated the last service process.  0 if it exited normally." },
+	{ "servicemanager_process_uptime_seconds", "gauge", "Time since the current service process was started." },
+	{ "servicemanager_state_seconds_total", "counter", "Time spent in each service manager state." },
+	{ "servicemanager_reloads_total", "counter", "Number of reload requests." },
+	{ "servicemanager_reload_timeouts_total", "counter", "Number of reload requests that were not acknowledged in time." },
+	{ "servicemanager_reload_ack_seconds", "summary", "Time between a reload request and the process deleting the reload notification file." },
+	{ "servicemanager_last_reload_ack_seconds", "gauge", "Reload acknowledgement time of the last reload." },
+	{ "servicemanager_last_stop_seconds", "gauge", "Time the last stop or restart request took to stop the service process." },
+	{ "servicemanager_process_cpu_user_seconds_total", "counter", "User CPU time used by all service processes that have exited." },
+	{ "servicemanager_process_cpu_system_seconds_total", "counter", "System CPU time used by all service processes that have exited." },
+	{ "servicemanager_last_cpu_user_seconds", "gauge", "User CPU time used by the last service process." },
+	{ "servicemanager_last_cpu_system_seconds", "gauge", "System CPU time used by the last service process." },
+	{ "servicemanager_last_max_rss_bytes", "gauge", "Maximum resident set size of the last service process." },
+	{ "servicemanager_last_major_faults", "gauge", "Major page faults of the last service process." },
+	{ "servicemanager_last_minor_faults", "gauge", "Minor page faults of the last service process." },
+	{ "servicemanager_last_voluntary_context_switches", "gauge", "Voluntary context switches of the last service process." },
+	{ "servicemanager_last_involuntary_context_switches", "gauge", "Involuntary context switches of the last service process." },
+	{ "servicemanager_last_core_dumped", "gauge", "Whether the last service process dumped core." },
+	{ "servicemanager_automatic_restarts_total", "counter", "Number of times the service process was restarted after exiting on its own." },
+	{ "servicemanager_restart_delay_seconds", "gauge", "Delay before the last automatic restart." },
+	{ "servicemanager_failed", "gauge", "Whether the service was marked as failed after restarting too often." },
+	{ "servicemanager_health_check_failures_total", "counter", "Number of failed health checks." },
+	{ "servicemanager_health_restarts_total", "counter", "Number of times the service process was restarted after failing too many health checks in a row." }
+};
+
+// Binary state transition trace written by -trace.  A header followed by fixed size records in native byte order.
+#define SERVICE_TRACE_MAGIC    "SMTRACE1"
+#define SERVICE_TRACE_VERSION  1
+
+struct ServiceTraceHeader
+{
+	char MxMagic[8];
+	std::uint32_t MxVersion;
+	std::uint32_t MxRecordSize;
+};
+
+struct ServiceTraceRecord
+{
+	std::uint64_t MxMonotonicUS;
+	std::uint64_t MxTimeUS;
+	std::uint32_t MxPID;
+	std::uint32_t MxGeneration;
+	std::uint16_t MxFromState;
+	std::uint16_t MxToState;
+	std::uint32_t MxReserved;
+};
+
+// Opens a trace file for appending.  Writes the header to new files.
+int OpenServiceTraceFile(const char *Filename)
+{
+	struct stat TempStat;
+	int TempFD = open(Filename, O_CREAT | O_WRONLY | O_APPEND, 0644);
+	if (TempFD < 0)  return -1;
+
+	fcntl(TempFD, F_SETFD, FD_CLOEXEC);
+
+	if (fstat(TempFD, &TempStat) == 0 && !TempStat.st_size)
+	{
+		ServiceTraceHeader TempHeader;
+
+		memcpy(TempHeader.MxMagic, SERVICE_TRACE_MAGIC, 8);
+		TempHeader.MxVersion = SERVICE_TRACE_VERSION;
+		TempHeader.MxRecordSize = sizeof(ServiceTraceRecord);
+
+		if (write(TempFD, &TempHeader, sizeof(TempHeader)) != (ssize_t)sizeof(TempHeader))
+		{
+			close(TempFD);
+
+			return -1;
+		}
+	}
+
+	return TempFD;
+}
+
+const char *GxMetricStateNames[12] = { "starting", "running", "terminating", "exited", "stopping", "stopping_notified", "reloading", "killing", "restart_delay", "stopping_remaining", "cleanup", "stopped" };
+
+// Restart policies for processes that exit on their own.
+#define RESTART_POLICY_FIXED      0
+#define RESTART_POLICY_IMMEDIATE  1
+#define RESTART_POLICY_BACKOFF    2
+
+// Number lists (e.g. "0-3,8") as bit masks.  Large enough for CPU_SETSIZE.
+#define PLACEMENT_MAX_BITS     1024
+#define PLACEMENT_MASK_WORDS   (PLACEMENT_MAX_BITS / (8 * sizeof(unsigned long)))
+
+bool ParseNumList(const char *Str, unsigned long *Mask)
+{
+	char *Str2;
+
+	for (size_t x = 0; x < PLACEMENT_MASK_WORDS; x++)  Mask[x] = 0;
+
+	while (*Str && *Str != '\n')
+	{
+		if (*Str < '0' || *Str > '9')  return false;
+
+		unsigned long First = strtoul(Str, &Str2, 10), Last = First;
+		if (*Str2 == '-')
+		{
+			Str = Str2 + 1;
+			if (*Str < '0' || *Str > '9')  return false;
+
+			Last = strtoul(Str, &Str2, 10);
+		}
+
+		if (First > Last || Last >= PLACEMENT_MAX_BITS)  return false;
+
+		for (; First <= Last; First++)  Mask[First / (8 * sizeof(unsigned long))] |= 1UL << (First % (8 * sizeof(unsigned long)));
+
+		Str = Str2;
+		if (*Str == ',')  Str++;
+		else if (*Str && *Str != '\n')  return false;
+	}
+
+	return true;
+}
+
+bool IsNumListBitSet(const unsigned long *Mask, size_t Num)
+{
+	return ((Mask[Num / (8 * sizeof(unsigned long))] >> (Num % (8 * sizeof(unsigned long)))) & 1);
+}
+
+void AppendNumList(StaticMixedVar<char[8192]> &Dest, const unsigned long *Mask)
+{
+	bool First = true;
+
+	for (size_t x = 0; x < PLACEMENT_MAX_BITS; x++)
+	{
+		if (!IsNumListBitSet(Mask, x))  continue;
+
+		size_t y = x;
+		while (y + 1 < PLACEMENT_MAX_BITS && IsNumListBitSet(Mask, y + 1))  y++;
+
+		if (!First)  Dest.AppendChar(',');
+		Dest.AppendUInt(x);
+		if (y > x)
+		{
+			Dest.AppendChar('-');
+			Dest.AppendUInt(y);
+		}
+
+		First = false;
+		x = y;
+	}
+}
+
+// CPU affinity, NUMA memory policy, scheduling policy, nice level, and I/O priority.  Applied between fork() and exec().
+class ProcessPlacement
+{
+public:
+	ProcessPlacement() : MxCPUsSet(false), MxNumaMode(-1), MxSchedPolicy(-1), MxSchedPriority(0), MxNiceSet(false), MxNice(0), MxIOPrio(-1)
+	{
+	}
+
+	// Returns false for values that are invalid or unsupported on this platform.
+	bool Set(size_t Num, const char *Str)
+	{
+#ifdef __linux__
+		if (Num == PLACEMENT_CPUS)
+		{
+			MxCPUsSet = ParseNumList(Str, MxCPUs);
+
+			return MxCPUsSet;
+		}
+		else if (Num == PLACEMENT_NUMA)
+		{
+			const char *Str2 = strchr(Str, ':');
+
+			if (Str2 == NULL)  MxNumaMode = MPOL_BIND;
+			else if (!strncasecmp(Str, "bind:", 5))  MxNumaMode = MPOL_BIND;
+			else if (!strncasecmp(Str, "preferred:", 10))  MxNumaMode = MPOL_PREFERRED;
+			else if (!strncasecmp(Str, "interleave:", 11))  MxNumaMode = MPOL_INTERLEAVE;
+			else  return false;
+
+			if (!ParseNumList(Str2 != NULL ? Str2 + 1 : Str, MxNumaNodes))  MxNumaMode = -1;
+
+			return (MxNumaMode > -1);
+		}
+		else if (Num == PLACEMENT_SCHED)
+		{
+			const char *Str2 = strchr(Str, ':');
+
+			MxSchedPriority = (Str2 != NULL ? atoi(Str2 + 1) : 0);
+
+			if (!strcasecmp(Str, "other"))  MxSchedPolicy = SCHED_OTHER;
+			else if (!strcasecmp(Str, "batch"))  MxSchedPolicy = SCHED_BATCH;
+			else if (!strcasecmp(Str, "idle"))  MxSchedPolicy = SCHED_IDLE;
+			else if (!strncasecmp(Str, "fifo:", 5) && MxSchedPriority >= 1 && MxSchedPriority <= 99)  MxSchedPolicy = SCHED_FIFO;
+			else if (!strncasecmp(Str, "rr:", 3) && MxSchedPriority >= 1 && MxSchedPriority <= 99)  MxSchedPolicy = SCHED_RR;
+			else  MxSchedPolicy = -1;
+
+			return (MxSchedPolicy > -1);
+		}
+		else if (Num == PLACEMENT_IOPRIO)
+		{
+			const char *Str2 = strchr(Str, ':');
+			int Level = (Str2 != NULL ? atoi(Str2 + 1) : 4);
+
+			if (Level < 0 || Level > 7)  MxIOPrio = -1;
+			else if (!strncasecmp(Str, "realtime", 8))  MxIOPrio = (1 << IOPRIO_CLASS_SHIFT) | Level;
+			else if (!strncasecmp(Str, "best-effort", 11))  MxIOPrio = (2 << IOPRIO_CLASS_SHIFT) | Level;
+			else if (!strcasecmp(Str, "idle"))  MxIOPrio = (3 << IOPRIO_CLASS_SHIFT);
+			else  MxIOPrio = -1;
+
+			return (MxIOPrio > -1);
+		}
+#endif
+
+		if (Num == PLACEMENT_NICE)
+		{
+			char *Str2;
+
+			MxNice = (int)strtol(Str, &Str2, 10);
+			MxNiceSet = (Str2 != Str && !*Str2 && MxNice >= -20 && MxNice <= 19);
+
+			return MxNiceSet;
+		}
+
+		return false;
+	}
+
+	// Binding memory to NUMA nodes without CPUs on those nodes just makes every access remote.  Reads sysfs, so call it before fork().
+	void UseNumaNodeCPUs()
+	{
+#ifdef __linux__
+		if (MxCPUsSet || MxNumaMode != MPOL_BIND)  return;
+
+		StaticMixedVar<char[8192]> TempBuffer;
+		unsigned long TempMask[PLACEMENT_MASK_WORDS];
+		char Line[4096];
+
+		for (size_t x = 0; x < PLACEMENT_MASK_WORDS; x++)  MxCPUs[x] = 0;
+
+		for (size_t x = 0; x < PLACEMENT_MAX_BITS; x++)
+		{
+			if (!IsNumListBitSet(MxNumaNodes, x))  continue;
+
+			TempBuffer.SetFormattedStr("/sys/devices/system/node/node%u/cpulist", (unsigned int)x);
+			FILE *fp = fopen(TempBuffer.MxStr, "r");
+			if (fp == NULL)  continue;
+
+			if (fgets(Line, sizeof(Line), fp) != NULL && ParseNumList(Line, TempMask))
+			{
+				for (size_t y = 0; y < PLACEMENT_MASK_WORDS; y++)
+				{
+					MxCPUs[y] |= TempMask[y];
+					if (TempMask[y])  MxCPUsSet = true;
+				}
+			}
+
+			fclose(fp);
+		}
+#endif
+	}
+
+	// Narrows the CPUs down to the Num-th one (wrapping around).  Uses the CPUs the service manager may run on when none were chosen.
+	bool PinToCPU(size_t Num)
+	{
+#ifdef __linux__
+		if (!MxCPUsSet)
+		{
+			cpu_set_t TempSet;
+
+			if (sched_getaffinity(0, sizeof(TempSet), &TempSet) < 0)  return false;
+
+			for (size_t x = 0; x < PLACEMENT_MASK_WORDS; x++)  MxCPUs[x] = 0;
+			for (size_t x = 0; x < PLACEMENT_MAX_BITS && x < CPU_SETSIZE; x++)
+			{
+				if (CPU_ISSET(x, &TempSet))  MxCPUs[x / (8 * sizeof(unsigned long))] |= 1UL << (x % (8 * sizeof(unsigned long)));
+			}
+		}
+
+		size_t NumCPUs = 0;
+		for (size_t x = 0; x < PLACEMENT_MAX_BITS; x++)
+		{
+			if (IsNumListBitSet(MxCPUs, x))  NumCPUs++;
+		}
+		if (!NumCPUs)  return false;
+
+		Num %= NumCPUs;
+		for (size_t x = 0; x < PLACEMENT_MAX_BITS; x++)
+		{
+			if (!IsNumListBitSet(MxCPUs, x))  continue;
+
+			if (!Num)
+			{
+				for (size_t y = 0; y < PLACEMENT_MASK_WORDS; y++)  MxCPUs[y] = 0;
+				MxCPUs[x / (8 * sizeof(unsigned long))] = 1UL << (x % (8 * sizeof(unsigned long)));
+
+				break;
+			}
+
+			Num--;
+		}
+
+		MxCPUsSet = true;
+
+		return true;
+#else
+		(void)Num;
+
+		return false;
+#endif
+	}
+
+	// Returns a bit for each PLACEMENT_ option that couldn't be applied.  Only uses system calls.
+	size_t Apply()
+	{
+		size_t Result = 0;
+
+#ifdef __linux__
+		if (MxCPUsSet)
+		{
+			cpu_set_t TempSet;
+
+			CPU_ZERO(&TempSet);
+			for (size_t x = 0; x < PLACEMENT_MAX_BITS && x < CPU_SETSIZE; x++)
+			{
+				if (IsNumListBitSet(MxCPUs, x))  CPU_SET(x, &TempSet);
+			}
+
+			if (sched_setaffinity(0, sizeof(TempSet), &TempSet) < 0)  Result |= ((size_t)1 << PLACEMENT_CPUS);
+		}
+
+		// The node mask size is passed with one extra, like libnuma does.
+		if (MxNumaMode > -1 && syscall(__NR_set_mempolicy, MxNumaMode, MxNumaNodes, (unsigned long)PLACEMENT_MAX_BITS + 1) < 0)  Result |= ((size_t)1 << PLACEMENT_NUMA);
+
+		if (MxSchedPolicy > -1)
+		{
+			struct sched_param TempParam;
+
+			memset(&TempParam, 0, sizeof(TempParam));
+			TempParam.sched_priority = MxSchedPriority;
+
+			if (sched_setscheduler(0, MxSchedPolicy, &TempParam) < 0)  Result |= ((size_t)1 << PLACEMENT_SCHED);
+		}
+
+		if (MxIOPrio > -1 && syscall(__NR_ioprio_set, IOPRIO_WHO_PROCESS, 0, MxIOPrio) < 0)  Result |= ((size_t)1 << PLACEMENT_IOPRIO);
+#endif
+
+		if (MxNiceSet && setpriority(PRIO_PROCESS, 0, MxNice) < 0)  Result |= ((size_t)1 << PLACEMENT_NICE);
+
+		return Result;
+	}
+
+private:
+	bool MxCPUsSet;
+	unsigned long MxCPUs[PLACEMENT_MASK_WORDS];
+	int MxNumaMode;
+	unsigned long MxNumaNodes[PLACEMENT_MASK_WORDS];
+	int MxSchedPolicy, MxSchedPriority;
+	bool MxNiceSet;
+	int MxNice;
+	int MxIOPrio;
+};
+
+bool ParseRLimitValue(const char *&Str, rlim_t &Result)
+{
+	char *Str2;
+
+	if (!strncasecmp(Str, "unlimited", 9))
+	{
+		Result = RLIM_INFINITY;
+		Str += 9;
+	}
+	else if (*Str >= '0' && *Str <= '9')
+	{
+		Result = (rlim_t)strtoull(Str, &Str2, 10);
+		Str = Str2;
+	}
+	else  return false;
+
+	return true;
+}
+
+// Parses "Soft[:Hard]".  Hard defaults to Soft.
+bool ParseRLimit(const char *Str, struct rlimit &Result)
+{
+	if (!ParseRLimitValue(Str, Result.rlim_cur))  return false;
+
+	if (*Str == ':')
+	{
+		Str++;
+		if (!ParseRLimitValue(Str, Result.rlim_max))  return false;
+	}
+	else  Result.rlim_max = Result.rlim_cur;
+
+	return (!*Str && (Result.rlim_max == RLIM_INFINITY || (Result.rlim_cur != RLIM_INFINITY && Result.rlim_cur <= Result.rlim_max)));
+}
+
+// Validates an oom_score_adj and stores it as the string that gets written to /proc.
+bool ParseOOMScoreAdj(const char *Str, char *Result, size_t ResultSize)
+{
+	char *Str2;
+	long Value = strtol(Str, &Str2, 10);
+
+	if (Str2 == Str || *Str2 || Value < -1000 || Value > 1000)  return false;
+
+	snprintf(Result, ResultSize, "%ld", Value);
+
+	return true;
+}
+
+// Shows where a running process actually ended up.
+void DumpProcessPlacement(pid_t ProcessID)
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+
+#ifdef __linux__
+	cpu_set_t TempSet;
+	unsigned long TempMask[PLACEMENT_MASK_WORDS];
+
+	if (sched_getaffinity(ProcessID, sizeof(TempSet), &TempSet) == 0)
+	{
+		for (size_t x = 0; x < PLACEMENT_MASK_WORDS; x++)  TempMask[x] = 0;
+		for (size_t x = 0; x < PLACEMENT_MAX_BITS && x < CPU_SETSIZE; x++)
+		{
+			if (CPU_ISSET(x, &TempSet))  TempMask[x / (8 * sizeof(unsigned long))] |= 1UL << (x % (8 * sizeof(unsigned long)));
+		}
+
+		TempBuffer.SetStr("");
+		AppendNumList(TempBuffer, TempMask);
+		printf("Service CPUs:  %s\n", TempBuffer.MxStr);
+	}
+
+	// The memory policy of the process only shows up per mapping.  The first mapping is the executable.
+	TempBuffer.SetFormattedStr("/proc/%u/numa_maps", (unsigned int)ProcessID);
+	FILE *fp = fopen(TempBuffer.MxStr, "r");
+	if (fp != NULL)
+	{
+		char Line[4096];
+
+		if (fgets(Line, sizeof(Line), fp) != NULL)
+		{
+			char *Str = strchr(Line, ' ');
+			if (Str != NULL)
+			{
+				Str++;
+				Str[strcspn(Str, " \n")] = '\0';
+
+				printf("Service memory policy:  %s\n", Str);
+			}
+		}
+
+		fclose(fp);
+	}
+
+	int Policy = sched_getscheduler(ProcessID);
+	if (Policy > -1)
+	{
+		struct sched_param TempParam;
+
+		if (Policy == SCHED_FIFO)  TempBuffer.SetStr("fifo");
+		else if (Policy == SCHED_RR)  TempBuffer.SetStr("rr");
+		else if (Policy == SCHED_BATCH)  TempBuffer.SetStr("batch");
+		else if (Policy == SCHED_IDLE)  TempBuffer.SetStr("idle");
+		else  TempBuffer.SetStr("other");
+
+		if ((Policy == SCHED_FIFO || Policy == SCHED_RR) && sched_getparam(ProcessID, &TempParam) == 0)
+		{
+			TempBuffer.AppendChar(':');
+			TempBuffer.AppendInt(TempParam.sched_priority);
+		}
+
+		printf("Service scheduling policy:  %s\n", TempBuffer.MxStr);
+	}
+
+	int IOPrio = (int)syscall(__NR_ioprio_get, IOPRIO_WHO_PROCESS, (int)ProcessID);
+	if (IOPrio > -1)
+	{
+		int Class = IOPrio >> IOPRIO_CLASS_SHIFT;
+
+		if (Class == 1)  printf("Service I/O priority:  realtime:%d\n", IOPrio & 7);
+		else if (Class == 2)  printf("Service I/O priority:  best-effort:%d\n", IOPrio & 7);
+		else if (Class == 3)  printf("Service I/O priority:  idle\n");
+		else  printf("Service I/O priority:  none (follows the nice level)\n");
+	}
+#endif
+
+	errno = 0;
+	int Nice = getpriority(PRIO_PROCESS, (id_t)ProcessID);
+	if (Nice != -1 || !errno)  printf("Service nice level:  %d\n", Nice);
+}
+
+// What force termination reaches.
+#define KILL_MODE_PROCESS  0
+#define KILL_MODE_GROUP    1
+#define KILL_MODE_CGROUP   2
+
+bool GetKillMode(const char *Str, size_t &Result)
+{
+	if (!strcasecmp(Str, "process"))  Result = KILL_MODE_PROCESS;
+	else if (!strcasecmp(Str, "group"))  Result = KILL_MODE_GROUP;
+	else if (!strcasecmp(Str, "cgroup"))  Result = KILL_MODE_CGROUP;
+	else  return false;
+
+	return true;
+}
+
+bool GetRestartPolicy(const char *Str, size_t &Result)
+{
+	if (!strcasecmp(Str, "fixed"))  Result = RESTART_POLICY_FIXED;
+	else if (!strcasecmp(Str, "immediate"))  Result = RESTART_POLICY_IMMEDIATE;
+	else if (!strcasecmp(Str, "backoff"))  Result = RESTART_POLICY_BACKOFF;
+	else  return false;
+
+	return true;
+}
+
+// Health probes (-health).
+#define HEALTH_PROBE_NONE     0
+#define HEALTH_PROBE_TCP      1
+#define HEALTH_PROBE_UNIX     2
+#define HEALTH_PROBE_FILE     3
+#define HEALTH_PROBE_ACTION   4
+
+class Supervisor;
+class ControlConnection;
+
+// Runs a single service executable and restarts it as needed.  Driven by a Supervisor.
+// States:  0 = Start, 1 = Running, 2 = Force terminate, 3 = Completed, 4 = Stopping (service manager),
+// 5 = Stopping (notification file), 6 = Reloading, 7 = Force terminating, 8 = Restart delay,
+// 9 = Stopping processes left behind, 100 = Stop, 101 = Stopped.
+class ServiceRunner : public EventHandler
+{
+public:
+	ServiceRunner(Supervisor *Owner);
+	~ServiceRunner();
+
+	// Loads the service configuration from the command-line (-debug) or the service info file.
+	bool InitFromArgs(int argc, char **argv);
+	bool InitFromServiceInfo(const char *ServiceName);
+
+	// Claims the control socket, opens the log, binds the listening sockets, and watches the notification files.
+	// Returns false if the service can't be run (e.g. another service manager is running it).
+	bool Activate();
+	void CloseControlSocket();
+
+	// Process and control socket file descriptors.
+	void HandleEvent(int FD);
+
+	// Runs the state machine until it has to wait for something.
+	void Process(std::uint64_t CurrTS);
+
+	void RequestStart();
+	void RequestStop(bool Restart = false);
+
+	// Turns this service into copy Num of Leader.  Call before Activate().
+	void SetInstance(ServiceRunner *Leader, std::uint32_t Num);
+	void AddInstance(ServiceRunner *Instance);
+	inline size_t GetNumInstances()  { return (MxInstances != NULL ? MxNumInstancesAdded : 1); }
+	inline ServiceRunner *GetInstance(size_t Num)  { return (MxInstances != NULL ? MxInstances[Num] : this); }
+
+	inline bool IsStopped()  { return (MxCurrState == 101); }
+	void GetStatus(ControlResponse &Response);
+
+	void Log(const char *Message, bool Display = true);
+
+	// Reopens the log file and captured output files.
+	void ReopenLogs();
+
+	char *MxName;
+	char *MxPIDFilename;
+	char *MxLogFilename;
+	char *MxNotifyStopFilename, *MxNotifyReloadFilename;
+	const char *MxNotifyStopName, *MxNotifyReloadName;
+	int MxNotifyWatch;
+	pid_t MxMainPID;
+	int MxMainPIDFD;
+	int MxExitCode;
+
+	// The previous process during an overlapped restart.  0 when there isn't one.
+	pid_t MxPrevPID;
+	int MxPrevPIDFD;
+
+	// gzip process compressing the most recently rotated log file.  0 when there isn't one.
+	pid_t MxLogCompressPID;
+
+	// Custom action run by the health probe.  0 when there isn't one.
+	pid_t MxHealthPID;
+
+	// Incremented every time the executable is started.
+	std::uint32_t MxStartCount;
+
+	// Copies of the executable.  The leader (copy 0) keeps the list of every copy and hands reloads to the others.
+	std::uint32_t MxInstance, MxNumInstances;
+	ServiceRunner **MxInstances;
+	size_t MxNumInstancesAdded;
+	ServiceRunner *MxLeader;
+	std::uint32_t MxReloadPropagations;
+
+	// Readiness of the current process.  Without readiness notification, the process is ready as soon as it starts.
+	bool MxReady, MxReadyFailed;
+
+	// Set when the state machine needs to run (e.g. a notification file changed).
+	bool MxCheck;
+
+	// Monotonic timestamp (milliseconds) at which the state machine wants to run again.  0 = not until something happens.
+	std::uint64_t MxWakeupTS;
+	Timer MxWakeupTimer;
+
+	// Metrics file.  The Supervisor writes it every MxMetricsInterval seconds.
+	char *MxMetricsFilename;
+	std::uint32_t MxMetricsInterval;
+	std::uint64_t MxMetricsTS;
+
+	// Appends the samples of one metric (see GxMetricDefs) for this service.
+	void AppendMetric(size_t Num, StaticMixedVar<char[8192]> &Dest, std::uint64_t CurrTS);
+
+private:
+	// Deny copy constructor and assignment operator.
+	ServiceRunner(const ServiceRunner &);
+	ServiceRunner &operator=(const ServiceRunner &);
+
+	void SetNotifyFilenames(const char *NotifyBase);
+	void ClosePIDFD(int &FD);
+	void WritePIDFile();
+	void StartOverlappedRestart();
+	void KeepPrevProcess();
+	std::uint64_t ProcessPrevProcess(std::uint64_t CurrTS);
+	void ProcessState(std::uint64_t CurrTS);
+	void ProcessReadyEvents();
+	bool BindListenSockets();
+	void PassListenSockets();
+	void OpenOutputStreams();
+	void ProcessOutput(size_t Num);
+	void GetRotatedLogFilename(StaticMixedVar<char[8192]> &Result, std::uint32_t Num, bool Compressed);
+	std::uint64_t CheckLogRotation(std::uint64_t CurrTS);
+	void PublishStatus();
+	void RecordExit(int Status, const struct rusage &Usage);
+	void LogProcessExit(const char *Prefix, int Status, const struct rusage &Usage);
+	void UpdateStateTimes(std::uint64_t CurrTS);
+	void ProcessExecEvent();
+	void AddLatency(size_t Num, std::uint64_t StartUS, std::uint64_t EndUS);
+	void TraceState();
+	void ScheduleRestart(std::uint64_t CurrTS);
+	void ContinueAfterExit(std::uint64_t CurrTS);
+	bool InitCgroup();
+	void GetCgroupFilename(StaticMixedVar<char[8192]> &Result, std::uint32_t Num, const char *Filename);
+	void RemoveCgroup(std::uint32_t &Num);
+	bool SignalProcesses(pid_t PID, std::uint32_t CgroupNum, int Signal);
+	bool HasProcesses(pid_t PID, std::uint32_t CgroupNum);
+	void ResetRestartLimit();
+	void PropagateReload();
+	void RequestReload();
+	bool InitHealthProbe(const char *ProbeStr);
+	std::uint64_t CheckHealth(std::uint64_t CurrTS);
+	void StartHealthProbe(std::uint64_t CurrTS);
+	void StopHealthProbe();
+	void FinishHealthProbe(std::uint64_t CurrTS, const char *Failure);
+
+	Supervisor *MxOwner;
+
+	int MxControlFD;
+	time_t MxStartTime;
+
+	std::uint32_t MxReadyTimeout;
+	int MxReadyFD;
+	char *MxReadySocketName;
+	std::uint64_t MxReadyTS;
+
+	char *MxListenStr;
+	int *MxListenFDs;
+	size_t MxNumListenFDs;
+
+	// Captured standard output (0) and standard error (1).  Both streams share the first pipe when they have the same target.
+	char *MxOutputStrs[2];
+	int MxOutputPipes[2][2];
+	int MxOutputFDs[2];
+	bool MxOutputLineStart[2], MxOutputTimestamps, MxOutputNoSplice;
+
+	std::uint32_t MxOverlapAmount;
+	std::uint64_t MxPrevStateTS;
+
+	// Restart policy.  The restart limit keeps the times of recent automatic restarts in a ring buffer.
+	size_t MxRestartPolicy;
+	std::uint32_t MxRestartDelay, MxRestartMaxDelay, MxRestartLimit, MxRestartWindow;
+	std::uint32_t MxRestartFailures, MxAutoRestartCount;
+	std::uint64_t MxRestartDelayLast;
+	std::uint64_t *MxRestartTimes;
+	size_t MxNumRestartTimes, MxRestartPos;
+	unsigned int MxRandSeed;
+	bool MxFailed;
+	bool MxOverlapRequested, MxPrevTermSent, MxPrevKillSent;
+
+	char *MxStartDir;
+	char *MxCmdLine;
+	char **MxCmdLineArgs;
+	uid_t MxUserID;
+	gid_t MxGroupID;
+	std::uint32_t MxWaitAmount, MxKillWaitAmount;
+
+	// Force termination reaches the process group or cgroup of a process.  Each process gets a numbered cgroup below MxCgroupDir.
+	size_t MxKillMode;
+	char *MxCgroupDir;
+	std::uint32_t MxMainCgroupNum, MxPrevCgroupNum, MxLastCgroupNum;
+	char *MxCgroupLimits[CGROUP_LIMIT_NUM];
+
+	ProcessPlacement MxPlacement;
+	bool MxPinInstances;
+
+	// Resource limits and OOM killer priority of the process.  An empty MxOOMScoreAdj leaves it alone.
+	bool MxRLimitsSet[RLIMIT_DEFS_MAX];
+	struct rlimit MxRLimits[RLIMIT_DEFS_MAX];
+	char MxOOMScoreAdj[16];
+
+	// Health probe.  Runs every MxHealthInterval milliseconds while the process is running.  MxHealthDeadlineTS is 0 unless a probe is in progress.
+	size_t MxHealthType;
+	struct sockaddr_storage MxHealthAddr;
+	socklen_t MxHealthAddrLen;
+	char *MxHealthFilename;
+	char *MxHealthCmdLine;
+	char **MxHealthArgs;
+	std::uint32_t MxHealthInterval, MxHealthTimeout, MxHealthThreshold;
+	std::uint32_t MxHealthFailures, MxHealthStartCount, MxHealthFailCount, MxHealthRestartCount;
+	int MxHealthFD;
+	std::uint64_t MxHealthTS, MxHealthDeadlineTS;
+	bool MxHealthRestart;
+
+	int MxLogFD;
+
+	// Log rotation.
+	std::uint64_t MxLogMaxSize;
+	std::uint32_t MxLogKeep, MxLogInterval;
+	bool MxLogCompress;
+	std::uint64_t MxLogCheckTS, MxLogRotateTS;
+
+	// Slot in the shared memory status table.  NULL when the table isn't available.
+	StatusTableSlot *MxStatusSlot;
+
+	// Metrics.  Times are in milliseconds.  State times are indexed by GetStateIndex().
+	std::uint32_t MxExitCount, MxSignalExitCount, MxForceTermCount, MxKillCount, MxReloadCount, MxReloadTimeoutCount, MxReloadAckCount, MxStopCount;
+	int MxLastStatus, MxLastSignal;
+	bool MxLastCoreDump, MxExitRecorded;
+	struct rusage MxLastUsage;
+	std::uint64_t MxUsageUserSum, MxUsageSysSum;
+	std::uint64_t MxStateTimes[12];
+	size_t MxMetricsState;
+	std::uint64_t MxMetricsStateTS, MxReloadStartTS, MxReloadAckLast, MxReloadAckSum, MxStopRequestTS, MxStopLast;
+
+	// Lifecycle latencies and state transition tracing.  Times are in microseconds.  The exec pipe closes when exec() succeeds.
+	LatencyHistogram MxLatency[LATENCY_NUM];
+	LatencySummary MxLatencySummary[LATENCY_NUM];
+	int MxExecFD;
+	std::uint64_t MxForkUS, MxExecUS, MxStopStartUS, MxStopUS, MxPrevStopStartUS, MxReloadStartUS;
+	char *MxTraceFilename;
+	int MxTraceFD;
+	size_t MxTraceState;
+
+	size_t MxCurrState, MxNextState;
+	std::uint64_t MxStartTS, MxStateTS;
+	bool MxKillSent, MxStopRequested, MxRestartRequested;
+};
+
+// A client of a service's control socket.  Stop, start, restart, and reload requests are answered when they complete.
+class ControlConnection : public EventHandler
+{
+public:
+	ControlConnection(Supervisor *Owner, ServiceRunner *Service, int FD);
+	~ControlConnection();
+
+	// Reads requests.
+	void HandleEvent(int FD);
+
+	// Sends the response to the outstanding request once it has completed.  Returns false when the connection should be closed.
+	bool Check();
+
+	ServiceRunner *MxService;
+
+private:
+	// Deny copy constructor and assignment operator.
+	ControlConnection(const ControlConnection &);
+	ControlConnection &operator=(const ControlConnection &);
+
+	void SendResponse(std::uint8_t Result);
+	int CheckInstance(size_t Num);
+	int CheckRollingRestart();
+
+	Supervisor *MxOwner;
+	int MxFD;
+	ControlRequest MxRequest;
+	size_t MxRequestSize;
+
+	// Start counts of every copy of the executable when the request arrived.
+	std::uint32_t *MxStartCounts;
+	std::uint32_t MxReloadPropagations;
+	bool MxWaitReloadPropagation;
+
+	// The next copy of the executable for a rolling restart to restart.
+	size_t MxNextInstance;
+
+	bool MxPending, MxClosed;
+};
+
+// Drives one or more services from a single event loop.
+class Supervisor : public EventHandler
+{
+public:
+	Supervisor();
+	~Supervisor();
+
+	// Supervise mode keeps running when services stop and accepts per-service control requests.
+	bool Init(bool Supervise);
+
+	void AddService(ServiceRunner *Service);
+	ServiceRunner *FindService(const char *Name);
+	inline size_t GetNumServices()  { return MxNumServices; }
+
+	void AddConnection(ControlConnection *Connection);
+
+	// Watches the directory containing a service's notification files.  Returns the watch descriptor or -1.
+	int AddNotifyWatch(const char *Filename);
+
+	// Signals and file change notifications.
+	void HandleEvent(int FD);
+
+	// Runs until every service has stopped.  Returns the exit code.
+	int Run();
+
+	EventLoop MxEventLoop;
+	TimerQueue MxTimers;
+	bool MxSupervise;
+
+private:
+	// Deny copy constructor and assignment operator.
+	Supervisor(const Supervisor &);
+	Supervisor &operator=(const Supervisor &);
+
+	void ProcessNotifyWatchEvents();
+	void CheckConnections();
+	std::uint64_t CheckMetrics(std::uint64_t CurrTS);
+	static void AppendMetricsData(char *&Data, size_t &DataSize, size_t &DataMax, StaticMixedVar<char[8192]> &TempBuffer);
+
+	ServiceRunner **MxServices;
+	size_t MxNumServices, MxMaxServices;
+	ControlConnection **MxConnections;
+	size_t MxNumConnections, MxMaxConnections;
+	int MxNotifyFD;
+	bool MxStopRequested, MxSystemdReady;
+};
+
+
+ServiceRunner::ServiceRunner(Supervisor *Owner) : MxName(NULL), MxPIDFilename(NULL), MxLogFilename(NULL), MxNotifyStopFilename(NULL), MxNotifyReloadFilename(NULL),
+	MxNotifyStopName(NULL), MxNotifyReloadName(NULL), MxNotifyWatch(-1), MxMainPID(0), MxMainPIDFD(-1), MxExitCode(0), MxPrevPID(0), MxPrevPIDFD(-1), MxLogCompressPID(0), MxHealthPID(0), MxStartCount(0),
+	MxInstance(0), MxNumInstances(GxApp.MxInstances ? GxApp.MxInstances : 1), MxInstances(NULL), MxNumInstancesAdded(0), MxLeader(NULL), MxReloadPropagations(0), MxReady(false), MxReadyFailed(false), MxCheck(true), MxWakeupTS(0), MxWakeupTimer(this),
+	MxMetricsFilename(NULL), MxMetricsInterval(GxApp.MxMetricsInterval), MxMetricsTS(0), MxOwner(Owner), MxControlFD(-1), MxStartTime(0), MxReadyTimeout(GxApp.MxReadyTimeout), MxReadyFD(-1), MxReadySocketName(NULL), MxReadyTS(0),
+	MxListenStr(NULL), MxListenFDs(NULL), MxNumListenFDs(0), MxOutputTimestamps(GxApp.MxOutputTimestamps), MxOutputNoSplice(false),
+	MxOverlapAmount(GxApp.MxOverlapAmount), MxPrevStateTS(0), MxRestartPolicy(RESTART_POLICY_FIXED), MxRestartDelay(GxApp.MxRestartDelay), MxRestartMaxDelay(GxApp.MxRestartMaxDelay), MxRestartLimit(GxApp.MxRestartLimit), MxRestartWindow(GxApp.MxRestartWindow),
+	MxRestartFailures(0), MxAutoRestartCount(0), MxRestartDelayLast(0), MxRestartTimes(NULL), MxNumRestartTimes(0), MxRestartPos(0), MxRandSeed((unsigned int)getpid() ^ (unsigned int)time(NULL)), MxFailed(false), MxOverlapRequested(false), MxPrevTermSent(false), MxPrevKillSent(false), MxStartDir(NULL), MxCmdLine(NULL), MxCmdLineArgs(NULL), MxUserID(0), MxGroupID(0), MxWaitAmount(GxApp.MxWaitAmount), MxKillWaitAmount(GxApp.MxKillWaitAmount),
+	MxKillMode(KILL_MODE_GROUP), MxCgroupDir(NULL), MxMainCgroupNum(0), MxPrevCgroupNum(0), MxLastCgroupNum(0), MxPinInstances(GxApp.MxPinInstances),
+	MxHealthType(HEALTH_PROBE_NONE), MxHealthAddrLen(0), MxHealthFilename(NULL), MxHealthCmdLine(NULL), MxHealthArgs(NULL), MxHealthInterval(GxApp.MxHealthInterval), MxHealthTimeout(GxApp.MxHealthTimeout), MxHealthThreshold(GxApp.MxHealthThreshold),
+	MxHealthFailures(0), MxHealthStartCount(0), MxHealthFailCount(0), MxHealthRestartCount(0), MxHealthFD(-1), MxHealthTS(0), MxHealthDeadlineTS(0), MxHealthRestart(false), MxLogFD(-1),
+	MxLogMaxSize(GxApp.MxLogMaxSize), MxLogKeep(GxApp.MxLogKeep), MxLogInterval(GxApp.MxLogInterval), MxLogCompress(GxApp.MxLogCompress), MxLogCheckTS(0), MxLogRotateTS(0), MxStatusSlot(NULL),
+	MxExitCount(0), MxSignalExitCount(0), MxForceTermCount(0), MxKillCount(0), MxReloadCount(0), MxReloadTimeoutCount(0), MxReloadAckCount(0), MxStopCount(0), MxLastStatus(0), MxLastSignal(0), MxLastCoreDump(false), MxExitRecorded(false), MxUsageUserSum(0), MxUsageSysSum(0),
+	MxMetricsState(0), MxMetricsStateTS(0), MxReloadStartTS(0), MxReloadAckLast(0), MxReloadAckSum(0), MxStopRequestTS(0), MxStopLast(0),
+	MxExecFD(-1), MxForkUS(0), MxExecUS(0), MxStopStartUS(0), MxStopUS(0), MxPrevStopStartUS(0), MxReloadStartUS(0), MxTraceFilename(NULL), MxTraceFD(-1), MxTraceState(0),
+	MxCurrState(0), MxNextState(0), MxStartTS(0), MxStateTS(0), MxKillSent(false), MxStopRequested(false), MxRestartRequested(false)
+{
+	for (size_t x = 0; x < 2; x++)
+	{
+		MxOutputStrs[x] = NULL;
+		MxOutputPipes[x][0] = -1;
+		MxOutputPipes[x][1] = -1;
+		MxOutputFDs[x] = -1;
+		MxOutputLineStart[x] = true;
+	}
+
+	for (size_t x = 0; x < sizeof(MxStateTimes) / sizeof(MxStateTimes[0]); x++)  MxStateTimes[x] = 0;
+	for (size_t x = 0; x < CGROUP_LIMIT_NUM; x++)  MxCgroupLimits[x] = NULL;
+	for (size_t x = 0; x < RLIMIT_DEFS_MAX; x++)  MxRLimitsSet[x] = false;
+	MxOOMScoreAdj[0] = '\0';
+	memset(&MxLastUsage, 0, sizeof(MxLastUsage));
+	memset(MxLatencySummary, 0, sizeof(MxLatencySummary));
+}
+
+ServiceRunner::~ServiceRunner()
+{
+	if (MxStatusSlot != NULL)  StatusTable::Release(MxStatusSlot);
+
+	ClosePIDFD(MxMainPIDFD);
+	ClosePIDFD(MxPrevPIDFD);
+	ClosePIDFD(MxExecFD);
+	CloseControlSocket();
+
+	StopHealthProbe();
+	if (MxHealthPID)  waitpid(MxHealthPID, NULL, 0);
+
+	MxOwner->MxTimers.Set(&MxWakeupTimer, 0);
+
+	if (MxCgroupDir != NULL)
+	{
+		RemoveCgroup(MxMainCgroupNum);
+		RemoveCgroup(MxPrevCgroupNum);
+		rmdir(MxCgroupDir);
+	}
+
+	if (MxTraceFD > -1)  close(MxTraceFD);
+
+	if (MxReadyFD > -1)
+	{
+		MxOwner->MxEventLoop.Remove(MxReadyFD);
+		close(MxReadyFD);
+
+#ifndef __linux__
+		UTF8::File::Delete(MxReadySocketName);
+#endif
+	}
+
+	for (size_t x = 0; x < MxNumListenFDs; x++)
+	{
+		// Remove Unix domain socket files.
+		struct sockaddr_un TempAddr;
+		socklen_t TempAddrLen = sizeof(TempAddr);
+
+		if (MxLeader == NULL && getsockname(MxListenFDs[x], (struct sockaddr *)&TempAddr, &TempAddrLen) == 0 && TempAddr.sun_family == AF_UNIX && TempAddr.sun_path[0])  UTF8::File::Delete(TempAddr.sun_path);
+
+		close(MxListenFDs[x]);
+	}
+
+	for (size_t x = 0; x < 2; x++)
+	{
+		// Write out anything still sitting in the pipe.
+		if (MxOutputPipes[x][0] > -1)
+		{
+			ProcessOutput(x);
+
+			MxOwner->MxEventLoop.Remove(MxOutputPipes[x][0]);
+			close(MxOutputPipes[x][0]);
+			close(MxOutputPipes[x][1]);
+		}
+
+		if (MxOutputFDs[x] > -1)  close(MxOutputFDs[x]);
+
+		delete[] MxOutputStrs[x];
+	}
+
+	// Queued log records still refer to the file descriptor.
+	if (MxLogFD > -1)
+	{
+		GxLogWriter.Flush();
+		close(MxLogFD);
+	}
+
+	delete[] MxListenFDs;
+	delete[] MxListenStr;
+	delete[] MxReadySocketName;
+	delete[] MxName;
+	delete[] MxPIDFilename;
+	delete[] MxLogFilename;
+	delete[] MxMetricsFilename;
+	delete[] MxTraceFilename;
+	delete[] MxRestartTimes;
+	delete[] MxCgroupDir;
+	for (size_t x = 0; x < CGROUP_LIMIT_NUM; x++)  delete[] MxCgroupLimits[x];
+	delete[] MxInstances;
+	delete[] MxNotifyStopFilename;
+	delete[] MxNotifyReloadFilename;
+	delete[] MxStartDir;
+	delete[] MxCmdLine;
+	delete[] MxCmdLineArgs;
+	delete[] MxHealthFilename;
+	delete[] MxHealthCmdLine;
+	delete[] MxHealthArgs;
+}
+
+void ServiceRunner::SetNotifyFilenames(const char *NotifyBase)
+{
+	size_t x, y = strlen(NotifyBase);
+
+	MxNotifyStopFilename = new char[y + 6];
+	memcpy(MxNotifyStopFilename, NotifyBase, y);
+	memcpy(MxNotifyStopFilename + y, ".stop", 6);
+
+	MxNotifyReloadFilename = new char[y + 8];
+	memcpy(MxNotifyReloadFilename, NotifyBase, y);
+	memcpy(MxNotifyReloadFilename + y, ".reload", 8);
+
+	// Filenames without the path for matching file change notifications.
+	for (x = y; x && NotifyBase[x - 1] != '/'; x--);
+	MxNotifyStopName = MxNotifyStopFilename + x;
+	MxNotifyReloadName = MxNotifyReloadFilename + x;
+}
+
+bool ServiceRunner::Activate()
+{
+	struct sockaddr_un TempAddr;
+	socklen_t TempAddrLen;
+
+	// The control socket doubles as a lock.  Only one service manager can run a service.
+	if (GetControlSocketAddr(MxName, TempAddr, TempAddrLen))
+	{
+		MxControlFD = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (MxControlFD > -1)
+		{
+			fcntl(MxControlFD, F_SETFD, FD_CLOEXEC);
+			fcntl(MxControlFD, F_SETFL, fcntl(MxControlFD, F_GETFL) | O_NONBLOCK);
+
+			int Result = bind(MxControlFD, (struct sockaddr *)&TempAddr, TempAddrLen);
+
+#ifndef __linux__
+			// Remove a stale socket left behind by a service manager that didn't exit cleanly.
+			if (Result < 0 && errno == EADDRINUSE)
+			{
+				int TempFD = socket(AF_UNIX, SOCK_STREAM, 0);
+				if (TempFD > -1 && connect(TempFD, (struct sockaddr *)&TempAddr, TempAddrLen) < 0 && errno == ECONNREFUSED)
+				{
+					UTF8::File::Delete(TempAddr.sun_path);
+
+					Result = bind(MxControlFD, (struct sockaddr *)&TempAddr, TempAddrLen);
+				}
+
+				if (TempFD > -1)  close(TempFD);
+			}
+
+			if (Result == 0)  chmod(TempAddr.sun_path, 0600);
+#endif
+
+			if (Result < 0 && errno == EADDRINUSE)
+			{
+				close(MxControlFD);
+				MxControlFD = -1;
+
+				printf("Service '%s' is already running via another service manager.\n", MxName);
+
+				return false;
+			}
+
+			if (Result < 0 || listen(MxControlFD, 16) < 0 || !MxOwner->MxEventLoop.Add(MxControlFD, this))
+			{
+				close(MxControlFD);
+				MxControlFD = -1;
+			}
+		}
+	}
+
+	// Readiness notifications arrive on a datagram socket named in the NOTIFY_SOCKET environment variable of the process.
+	if (MxReadyTimeout && GetControlSocketAddr(MxName, TempAddr, TempAddrLen, "notify"))
+	{
+		MxReadyFD = socket(AF_UNIX, SOCK_DGRAM, 0);
+		if (MxReadyFD > -1)
+		{
+			fcntl(MxReadyFD, F_SETFD, FD_CLOEXEC);
+			fcntl(MxReadyFD, F_SETFL, fcntl(MxReadyFD, F_GETFL) | O_NONBLOCK);
+
+#ifdef __linux__
+			// Collect sender credentials since anyone can send to an abstract socket.
+			int TempOpt = 1;
+			setsockopt(MxReadyFD, SOL_SOCKET, SO_PASSCRED, &TempOpt, sizeof(TempOpt));
+#else
+			// The control socket is held, so this is a stale socket.
+			UTF8::File::Delete(TempAddr.sun_path);
+#endif
+
+			if (bind(MxReadyFD, (struct sockaddr *)&TempAddr, TempAddrLen) < 0 || !MxOwner->MxEventLoop.Add(MxReadyFD, this))
+			{
+				close(MxReadyFD);
+				MxReadyFD = -1;
+			}
+			else
+			{
+#ifdef __linux__
+				size_t y = TempAddrLen - offsetof(struct sockaddr_un, sun_path);
+
+				TempAddr.sun_path[0] = '@';
+				MxReadySocketName = new char[y + 1];
+				memcpy(MxReadySocketName, TempAddr.sun_path, y);
+				MxReadySocketName[y] = '\0';
+#else
+				if (MxUserID && chown(TempAddr.sun_path, MxUserID, (gid_t)-1) < 0)  {}
+
+				MxReadySocketName = CopyStr(TempAddr.sun_path);
+#endif
+			}
+		}
+	}
+
+	if (MxLogFilename != NULL)
+	{
+		MxLogFD = open(MxLogFilename, O_CREAT | O_WRONLY | O_APPEND, 0644);
+		if (MxLogFD > -1)  fcntl(MxLogFD, F_SETFD, FD_CLOEXEC);
+	}
+
+	Log("Service manager started.");
+
+	if (MxTraceFilename != NULL)
+	{
+		MxTraceFD = OpenServiceTraceFile(MxTraceFilename);
+		if (MxTraceFD < 0)  Log("Unable to open the trace file.");
+	}
+
+	MxPlacement.UseNumaNodeCPUs();
+	if (MxPinInstances && !MxPlacement.PinToCPU(MxInstance))  Log("Unable to pin the process to a CPU.");
+
+	// Resource limits need the processes in the cgroup.
+	if (MxKillMode != KILL_MODE_CGROUP)
+	{
+		for (size_t x = 0; x < CGROUP_LIMIT_NUM; x++)
+		{
+			if (MxCgroupLimits[x] != NULL)  MxKillMode = KILL_MODE_CGROUP;
+		}
+	}
+
+	if (MxKillMode == KILL_MODE_CGROUP && !InitCgroup())
+	{
+		Log("cgroup v2 is not available.  Using the process group instead.");
+
+		MxKillMode = KILL_MODE_GROUP;
+	}
+
+	if (MxControlFD < 0)  Log("Control socket is not available.", false);
+	if (MxReadyTimeout && MxReadyFD < 0)  Log("Readiness notification socket is not available.  The process is considered ready as soon as it starts.", false);
+
+	if (MxListenStr != NULL && !BindListenSockets())  return false;
+
+	OpenOutputStreams();
+
+	// Sleep until something happens instead of checking for the notification files every couple of seconds.
+	MxNotifyWatch = MxOwner->AddNotifyWatch(MxNotifyStopFilename);
+	if (MxNotifyWatch < 0)  Log("File change notifications are not available.  Falling back to polling.", false);
+
+	MxStatusSlot = GxStatusTable.Claim(MxName);
+	if (MxStatusSlot == NULL)  Log("Status table is not available.", false);
+	PublishStatus();
+
+	return true;
+}
+
+bool ServiceRunner::InitFromArgs(int argc, char **argv)
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+
+	// Running in debug mode requires additional arguments.
+	if (GxApp.MxExeArgc + 1 >= argc)
+	{
+		printf("Missing 'NotifyFile' or 'ExecutableToRun'.\n\n");
+
+		DumpSyntax(argv[0]);
+
+		return false;
+	}
+
+	MxName = CopyStr(GxApp.MxServiceName);
+	SetNotifyFilenames(argv[GxApp.MxExeArgc]);
+
+	if (GxApp.MxPIDFileStr != NULL)  MxPIDFilename = CopyStr(GxApp.MxPIDFileStr);
+	if (GxApp.MxStartDir != NULL)  MxStartDir = CopyStr(GxApp.MxStartDir);
+	if (GxApp.MxListenStr != NULL)  MxListenStr = CopyStr(GxApp.MxListenStr);
+	if (GxApp.MxStdoutStr != NULL)  MxOutputStrs[0] = CopyStr(GxApp.MxStdoutStr);
+	if (GxApp.MxStderrStr != NULL)  MxOutputStrs[1] = CopyStr(GxApp.MxStderrStr);
+	if (GxApp.MxMetricsStr != NULL)  MxMetricsFilename = CopyStr(GxApp.MxMetricsStr);
+	if (GxApp.MxTraceStr != NULL)  MxTraceFilename = CopyStr(GxApp.MxTraceStr);
+	for (size_t x = 0; x < CGROUP_LIMIT_NUM; x++)
+	{
+		if (GxApp.MxCgroupLimitStrs[x] != NULL)  MxCgroupLimits[x] = CopyStr(GxApp.MxCgroupLimitStrs[x]);
+	}
+
+	if (GxApp.MxKillModeStr != NULL && !GetKillMode(GxApp.MxKillModeStr, MxKillMode))
+	{
+		printf("Unknown kill mode '%s'.\n\n", GxApp.MxKillModeStr);
+
+		DumpSyntax(argv[0]);
+
+		return false;
+	}
+
+	for (size_t x = 0; x < PLACEMENT_NUM; x++)
+	{
+		if (GxApp.MxPlacementStrs[x] != NULL && !MxPlacement.Set(x, GxApp.MxPlacementStrs[x]))
+		{
+			printf("Invalid or unsupported %s '%s'.\n\n", GxPlacementKeys[x], GxApp.MxPlacementStrs[x]);
+
+			DumpSyntax(argv[0]);
+
+			return false;
+		}
+	}
+
+	for (size_t x = 0; x < GxNumRLimitDefs; x++)
+	{
+		if (GxApp.MxRLimitStrs[x] == NULL)  continue;
+
+		MxRLimitsSet[x] = ParseRLimit(GxApp.MxRLimitStrs[x], MxRLimits[x]);
+		if (!MxRLimitsSet[x])
+		{
+			printf("Invalid %s resource limit '%s'.\n\n", GxRLimitDefs[x].MxName, GxApp.MxRLimitStrs[x]);
+
+			DumpSyntax(argv[0]);
+
+			return false;
+		}
+	}
+
+	if (GxApp.MxOOMScoreAdjStr != NULL && !ParseOOMScoreAdj(GxApp.MxOOMScoreAdjStr, MxOOMScoreAdj, sizeof(MxOOMScoreAdj)))
+	{
+		printf("Invalid oom_score_adj '%s'.\n\n", GxApp.MxOOMScoreAdjStr);
+
+		DumpSyntax(argv[0]);
+
+		return false;
+	}
+
+	if (GxApp.MxHealthStr != NULL && !InitHealthProbe(GxApp.MxHealthStr))
+	{
+		printf("Invalid health probe '%s'.\n\n", GxApp.MxHealthStr);
+
+		DumpSyntax(argv[0]);
+
+		return false;
+	}
+
+	if (!MxHealthInterval || !MxHealthTimeout || !MxHealthThreshold)
+	{
+		printf("The health check interval, timeout, and threshold must be greater than 0.\n\n");
+
+		DumpSyntax(argv[0]);
+
+		return false;
+	}
+
+	if (GxApp.MxRestartStr != NULL && !GetRestartPolicy(GxApp.MxRestartStr, MxRestartPolicy))
+	{
+		printf("Unknown restart policy '%s'.\n\n", GxApp.MxRestartStr);
+
+		DumpSyntax(argv[0]);
+
+		return false;
+	}
+
+	// Retrieve the user.
+	if (GxApp.MxUserStr != NULL)
+	{
+		struct passwd *TempPasswd = getpwnam(GxApp.MxUserStr);
+		if (TempPasswd == NULL)
+		{
+			printf("Unknown user '%s' specified.\n", GxApp.MxUserStr);
+
+			return false;
+		}
+
+		MxUserID = TempPasswd->pw_uid;
+	}
+
+	// Retrieve the group.
+	if (GxApp.MxGroupStr != NULL)
+	{
+		struct group *TempGroup = getgrnam(GxApp.MxGroupStr);
+		if (TempGroup == NULL)
+		{
+			printf("Unknown group '%s' specified.\n", GxApp.MxGroupStr);
+
+			return false;
+		}
+
+		MxGroupID = TempGroup->gr_gid;
+	}
+
+	// Parse command-line arguments.
+	MxCmdLineArgs = new char *[argc - GxApp.MxExeArgc];
+	size_t y = 0;
+	for (int x = GxApp.MxExeArgc + 1; x < argc; x++)
+	{
+		MxCmdLineArgs[y++] = argv[x];
+	}
+	MxCmdLineArgs[y] = NULL;
+
+	if (GxApp.MxLogFileStr != NULL)  MxLogFilename = CopyStr(GxApp.MxLogFileStr);
+	else if (GetServiceInfoStr("log", TempBuffer) && TempBuffer.MxStrPos)  MxLogFilename = CopyStr(TempBuffer.MxStr);
+
+	return true;
+}
+
+bool ServiceRunner::InitFromServiceInfo(const char *ServiceName)
+{
+	StaticMixedVar<char[8192]> TempBuffer, TempBuffer2;
+
+	MxName = CopyStr(ServiceName);
+
+	if (!GetServiceInfoStr("notify", TempBuffer, false, MxName))  return false;
+	SetNotifyFilenames(TempBuffer.MxStr);
+
+	if (GetServiceInfoStr("pid", TempBuffer, false, MxName) && TempBuffer.MxStrPos)  MxPIDFilename = CopyStr(TempBuffer.MxStr);
+	if (GxApp.MxStartDir != NULL)  MxStartDir = CopyStr(GxApp.MxStartDir);
+	else if (GetServiceInfoStr("dir", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxStartDir = CopyStr(TempBuffer.MxStr);
+
+	if (GetServiceInfoStr("wait", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxWaitAmount = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 0);
+	if (GetServiceInfoStr("kill_wait", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxKillWaitAmount = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 0);
+	for (size_t x = 0; x < CGROUP_LIMIT_NUM; x++)
+	{
+		if (GetServiceInfoStr(GxCgroupLimitDefs[x].MxKey, TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxCgroupLimits[x] = CopyStr(TempBuffer.MxStr);
+	}
+	for (size_t x = 0; x < PLACEMENT_NUM; x++)
+	{
+		if (GetServiceInfoStr(GxPlacementKeys[x], TempBuffer, true, MxName) && TempBuffer.MxStrPos && !MxPlacement.Set(x, TempBuffer.MxStr))  printf("Invalid or unsupported %s '%s'.  Ignoring.\n", GxPlacementKeys[x], TempBuffer.MxStr);
+	}
+	for (size_t x = 0; x < GxNumRLimitDefs; x++)
+	{
+		TempBuffer2.SetStr("rlimit_");
+		TempBuffer2.AppendStr(GxRLimitDefs[x].MxName);
+
+		if (GetServiceInfoStr(TempBuffer2.MxStr, TempBuffer, true, MxName) && TempBuffer.MxStrPos)
+		{
+			MxRLimitsSet[x] = ParseRLimit(TempBuffer.MxStr, MxRLimits[x]);
+			if (!MxRLimitsSet[x])  printf("Invalid %s '%s'.  Ignoring.\n", TempBuffer2.MxStr, TempBuffer.MxStr);
+		}
+	}
+	if (GetServiceInfoStr("oom_score_adj", TempBuffer, true, MxName) && TempBuffer.MxStrPos && !ParseOOMScoreAdj(TempBuffer.MxStr, MxOOMScoreAdj, sizeof(MxOOMScoreAdj)))  printf("Invalid oom_score_adj '%s'.  Ignoring.\n", TempBuffer.MxStr);
+	if (GetServiceInfoStr("kill_mode", TempBuffer, true, MxName) && TempBuffer.MxStrPos && !GetKillMode(TempBuffer.MxStr, MxKillMode))  printf("Unknown kill mode '%s'.  Using 'group'.\n", TempBuffer.MxStr);
+	if (GetServiceInfoStr("ready", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxReadyTimeout = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 0);
+	if (GetServiceInfoStr("listen", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxListenStr = CopyStr(TempBuffer.MxStr);
+	if (GetServiceInfoStr("overlap", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxOverlapAmount = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 0);
+	if (GetServiceInfoStr("instances", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxNumInstances = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 10);
+	if (GetServiceInfoStr("pin_instances", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxPinInstances = (atoi(TempBuffer.MxStr) != 0);
+	if (!MxNumInstances)  MxNumInstances = 1;
+	if (GetServiceInfoStr("health", TempBuffer, true, MxName) && TempBuffer.MxStrPos && !InitHealthProbe(TempBuffer.MxStr))  printf("Invalid health probe '%s'.  Ignoring.\n", TempBuffer.MxStr);
+	if (GetServiceInfoStr("health_interval", TempBuffer, true, MxName) && strtoul(TempBuffer.MxStr, NULL, 10))  MxHealthInterval = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 10);
+	if (GetServiceInfoStr("health_timeout", TempBuffer, true, MxName) && strtoul(TempBuffer.MxStr, NULL, 10))  MxHealthTimeout = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 10);
+	if (GetServiceInfoStr("health_threshold", TempBuffer, true, MxName) && strtoul(TempBuffer.MxStr, NULL, 10))  MxHealthThreshold = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 10);
+	if (GetServiceInfoStr("stdout", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxOutputStrs[0] = CopyStr(TempBuffer.MxStr);
+	if (GetServiceInfoStr("stderr", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxOutputStrs[1] = CopyStr(TempBuffer.MxStr);
+	if (GetServiceInfoStr("timestamps", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxOutputTimestamps = (atoi(TempBuffer.MxStr) != 0);
+	if (GetServiceInfoStr("log_max_size", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxLogMaxSize = strtoull(TempBuffer.MxStr, NULL, 10);
+	if (GetServiceInfoStr("log_keep", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxLogKeep = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 10);
+	if (GetServiceInfoStr("log_interval", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxLogInterval = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 10);
+	if (GetServiceInfoStr("log_compress", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxLogCompress = (atoi(TempBuffer.MxStr) != 0);
+	if (GetServiceInfoStr("metrics", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxMetricsFilename = CopyStr(TempBuffer.MxStr);
+	if (GetServiceInfoStr("metrics_interval", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxMetricsInterval = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 10);
+	if (GetServiceInfoStr("trace", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxTraceFilename = CopyStr(TempBuffer.MxStr);
+	if (GetServiceInfoStr("restart", TempBuffer, true, MxName) && TempBuffer.MxStrPos && !GetRestartPolicy(TempBuffer.MxStr, MxRestartPolicy))  printf("Unknown restart policy '%s'.  Using 'fixed'.\n", TempBuffer.MxStr);
+	if (GetServiceInfoStr("restart_delay", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxRestartDelay = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 10);
+	if (GetServiceInfoStr("restart_max_delay", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxRestartMaxDelay = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 10);
+	if (GetServiceInfoStr("restart_limit", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxRestartLimit = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 10);
+	if (GetServiceInfoStr("restart_window", TempBuffer, true, MxName) && TempBuffer.MxStrPos)  MxRestartWindow = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 10);
+
+	// Parse command-line arguments.
+	if (!GetServiceInfoStr("cmd", TempBuffer, false, MxName))  return false;
+
+	char **TempArgs = ExtractArgs(TempBuffer);
+
+	if (TempArgs == NULL)
+	{
+		printf("An error occurred while attempting to extract the arguments to run the service.\n");
+
+		return false;
+	}
+
+	// Only keep as much of the command-line as is actually used.
+	MxCmdLine = new char[TempBuffer.MxStrPos + 1];
+	memcpy(MxCmdLine, TempBuffer.MxStr, TempBuffer.MxStrPos + 1);
+
+	size_t x;
+	for (x = 0; TempArgs[x] != NULL; x++)  TempArgs[x] = MxCmdLine + (TempArgs[x] - TempBuffer.MxStr);
+	MxCmdLineArgs = TempArgs;
+
+	// Retrieve the user.
+	if (GetServiceInfoStr("nix_user", TempBuffer, true, MxName) && TempBuffer.MxStrPos)
+	{
+		struct passwd *TempPasswd = getpwnam(TempBuffer.MxStr);
+		if (TempPasswd == NULL)
+		{
+			printf("Unknown user '%s' specified in configuration.\n", TempBuffer.MxStr);
+
+			return false;
+		}
+
+		MxUserID = TempPasswd->pw_uid;
+	}
+
+	// Retrieve the group.
+	if (GetServiceInfoStr("nix_group", TempBuffer, true, MxName) && TempBuffer.MxStrPos)
+	{
+		struct group *TempGroup = getgrnam(TempBuffer.MxStr);
+		if (TempGroup == NULL)
+		{
+			printf("Unknown group '%s' specified in configuration.\n", TempBuffer.MxStr);
+
+			return false;
+		}
+
+		MxGroupID = TempGroup->gr_gid;
+	}
+
+	if (GetServiceInfoStr("log", TempBuffer, false, MxName) && TempBuffer.MxStrPos)  MxLogFilename = CopyStr(TempBuffer.MxStr);
+
+	return true;
+}
+
+void ServiceRunner::Log(const char *Message, bool Display)
+{
+	if (GxDebug && Display && MxOwner->MxSupervise)  printf("[%s] ", MxName);
+
+	if (GxDebug && Display)  printf("%s\n", Message);
+
+	GxLogWriter.Write(MxLogFD, Message);
+}
+
+void ServiceRunner::ClosePIDFD(int &FD)
+{
+	if (FD > -1)
+	{
+		MxOwner->MxEventLoop.Remove(FD);
+		close(FD);
+
+		FD = -1;
+	}
+}
+
+void ServiceRunner::CloseControlSocket()
+{
+	if (MxControlFD > -1)
+	{
+		MxOwner->MxEventLoop.Remove(MxControlFD);
+		close(MxControlFD);
+
+		MxControlFD = -1;
+
+#ifndef __linux__
+		struct sockaddr_un TempAddr;
+		socklen_t TempAddrLen;
+
+		if (GetControlSocketAddr(MxName, TempAddr, TempAddrLen))  UTF8::File::Delete(TempAddr.sun_path);
+#endif
+	}
+}
+
+void ServiceRunner::HandleEvent(int FD)
+{
+	if (FD == MxMainPIDFD || FD == MxPrevPIDFD)
+	{
+		// The process exited.
+		MxCheck = true;
+	}
+	else if (FD == MxReadyFD)
+	{
+		ProcessReadyEvents();
+	}
+	else if (FD == MxExecFD)
+	{
+		ProcessExecEvent();
+	}
+	else if (FD == MxHealthFD)
+	{
+		// The health probe connection attempt completed.
+		int TempErr = 0;
+		socklen_t TempErrLen = sizeof(TempErr);
+
+		if (getsockopt(MxHealthFD, SOL_SOCKET, SO_ERROR, &TempErr, &TempErrLen) < 0)  TempErr = errno;
+
+		FinishHealthProbe(GetMonotonicMilliseconds(), (TempErr ? "Unable to connect" : NULL));
+
+		// Schedule the next probe.
+		MxCheck = true;
+	}
+	else if (FD == MxOutputPipes[0][0] || FD == MxOutputPipes[1][0])
+	{
+		ProcessOutput(FD == MxOutputPipes[0][0] ? 0 : 1);
+
+		// Output may have grown the log file past its maximum size.
+		if (MxLogMaxSize)  CheckLogRotation(GetMonotonicMilliseconds());
+	}
+	else if (FD == MxControlFD)
+	{
+		// Accept new control connections.
+		int TempFD;
+
+		while ((TempFD = accept(MxControlFD, NULL, NULL)) > -1)
+		{
+			fcntl(TempFD, F_SETFD, FD_CLOEXEC);
+			fcntl(TempFD, F_SETFL, fcntl(TempFD, F_GETFL) | O_NONBLOCK);
+
+#ifdef __linux__
+			// Anyone can connect to an abstract socket.  Only allow root and the user the service manager is running as.
+			struct ucred TempCred;
+			socklen_t TempCredLen = sizeof(TempCred);
+
+			if (getsockopt(TempFD, SOL_SOCKET, SO_PEERCRED, &TempCred, &TempCredLen) < 0 || (TempCred.uid != 0 && TempCred.uid != geteuid()))
+			{
+				close(TempFD);
+
+				continue;
+			}
+#endif
+
+#ifdef SO_NOSIGPIPE
+			int TempOpt = 1;
+			setsockopt(TempFD, SOL_SOCKET, SO_NOSIGPIPE, &TempOpt, sizeof(TempOpt));
+#endif
+
+			MxOwner->AddConnection(new ControlConnection(MxOwner, this, TempFD));
+		}
+	}
+}
+
+void ServiceRunner::ProcessReadyEvents()
+{
+	char TempBuffer[4096];
+	struct iovec TempIOV;
+	struct msghdr TempMsg;
+	ssize_t y;
+
+#ifdef __linux__
+	union
+	{
+		struct cmsghdr MxHeader;
+		char MxData[CMSG_SPACE(sizeof(struct ucred))];
+	} TempControl;
+#endif
+
+	do
+	{
+		TempIOV.iov_base = TempBuffer;
+		TempIOV.iov_len = sizeof(TempBuffer) - 1;
+
+		memset(&TempMsg, 0, sizeof(TempMsg));
+		TempMsg.msg_iov = &TempIOV;
+		TempMsg.msg_iovlen = 1;
+
+#ifdef __linux__
+		TempMsg.msg_control = &TempControl;
+		TempMsg.msg_controllen = sizeof(TempControl);
+#endif
+
+		y = recvmsg(MxReadyFD, &TempMsg, 0);
+		if (y < 0)  break;
+
+#ifdef __linux__
+		// Only accept notifications from the process, root, or the user the process runs as.
+		struct cmsghdr *TempHeader = CMSG_FIRSTHDR(&TempMsg);
+		if (TempHeader == NULL || TempHeader->cmsg_level != SOL_SOCKET || TempHeader->cmsg_type != SCM_CREDENTIALS)  continue;
+
+		struct ucred *TempCred = (struct ucred *)CMSG_DATA(TempHeader);
+		if (TempCred->pid != MxMainPID && TempCred->uid != 0 && TempCred->uid != (MxUserID ? MxUserID : geteuid()))  continue;
+
+		// Ignore the previous process during an overlapped restart.
+		if (MxPrevPID && TempCred->pid == MxPrevPID)  continue;
+#endif
+
+		if (MxReady || (MxCurrState != 1 && MxCurrState != 6))  continue;
+
+		// Notifications are newline separated 'KEY=VALUE' assignments.  Only READY=1 matters.
+		TempBuffer[y] = '\0';
+		for (char *Line = TempBuffer; Line != NULL; )
+		{
+			char *NextLine = strchr(Line, '\n');
+			if (NextLine != NULL)  *NextLine++ = '\0';
+
+			if (!strcmp(Line, "READY=1"))
+			{
+				// The exec pipe might not have been read yet.
+				if (MxExecFD > -1)  ProcessExecEvent();
+
+				std::uint64_t CurrUS = GetMonotonicMicroseconds(), StartUS = (MxExecUS ? MxExecUS : MxForkUS);
+				AddLatency(LATENCY_READY, StartUS, CurrUS);
+
+				StaticMixedVar<char[256]> TempBuffer2;
+				TempBuffer2.SetFormattedStr("Process is ready %.3f seconds after exec.", (double)(CurrUS - StartUS) / 1000000.0);
+				Log(TempBuffer2.MxStr, false);
+
+				MxReady = true;
+				MxCheck = true;
+				WritePIDFile();
+
+				break;
+			}
+
+			Line = NextLine;
+		}
+	} while (1);
+}
+
+bool ServiceRunner::BindListenSockets()
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+	char *Addr, *NextAddr, *Host, *Port;
+	size_t x;
+	int TempFD, TempOpt;
+
+	TempBuffer.SetStr(MxListenStr);
+
+	for (x = 1, Addr = TempBuffer.MxStr; (Addr = strchr(Addr, ',')) != NULL; x++, Addr++);
+	MxListenFDs = new int[x];
+
+	for (Addr = TempBuffer.MxStr; Addr != NULL; Addr = NextAddr)
+	{
+		NextAddr = strchr(Addr, ',');
+		if (NextAddr != NULL)  *NextAddr++ = '\0';
+
+		while (*Addr == ' ')  Addr++;
+		if (!*Addr)  continue;
+
+		TempFD = -1;
+
+		if (!strncmp(Addr, "unix:", 5) && MxLeader != NULL)
+		{
+			// Unix domain sockets can't be bound twice.  Copies share the socket of the leader.
+			if (MxNumListenFDs < MxLeader->MxNumListenFDs)  TempFD = dup(MxLeader->MxListenFDs[MxNumListenFDs]);
+		}
+		else if (!strncmp(Addr, "unix:", 5))
+		{
+			struct sockaddr_un TempAddr;
+
+			memset(&TempAddr, 0, sizeof(TempAddr));
+			TempAddr.sun_family = AF_UNIX;
+
+			if (strlen(Addr + 5) < sizeof(TempAddr.sun_path))
+			{
+				strcpy(TempAddr.sun_path, Addr + 5);
+
+				// Remove a socket file left behind by a previous service manager.
+				UTF8::File::Delete(TempAddr.sun_path);
+
+				TempFD = socket(AF_UNIX, SOCK_STREAM, 0);
+				if (TempFD > -1 && bind(TempFD, (struct sockaddr *)&TempAddr, sizeof(TempAddr)) < 0)
+				{
+					close(TempFD);
+					TempFD = -1;
+				}
+
+				if (TempFD > -1 && (MxUserID || MxGroupID) && chown(TempAddr.sun_path, (MxUserID ? MxUserID : (uid_t)-1), (MxGroupID ? MxGroupID : (gid_t)-1)) < 0)  {}
+			}
+		}
+		else
+		{
+			struct addrinfo TempHints, *TempResult;
+
+			if (!strncmp(Addr, "tcp:", 4))  Addr += 4;
+
+			// Split the host and the port.  IPv6 hosts are enclosed in square brackets.
+			Port = strrchr(Addr, ':');
+			if (Port != NULL)
+			{
+				*Port++ = '\0';
+
+				Host = Addr;
+				if (Host[0] == '[' && Host[strlen(Host) - 1] == ']')
+				{
+					Host++;
+					Host[strlen(Host) - 1] = '\0';
+				}
+
+				memset(&TempHints, 0, sizeof(TempHints));
+				TempHints.ai_family = AF_UNSPEC;
+				TempHints.ai_socktype = SOCK_STREAM;
+				TempHints.ai_flags = AI_PASSIVE;
+
+				if (getaddrinfo((!Host[0] || !strcmp(Host, "*") ? NULL : Host), Port, &TempHints, &TempResult) == 0)
+				{
+					TempFD = socket(TempResult->ai_family, TempResult->ai_socktype, TempResult->ai_protocol);
+					if (TempFD > -1)
+					{
+						TempOpt = 1;
+						setsockopt(TempFD, SOL_SOCKET, SO_REUSEADDR, &TempOpt, sizeof(TempOpt));
+
+						// Each copy binds the same port and the kernel spreads connections between them.
+						if (MxNumInstances > 1)
+						{
+#if defined(SO_REUSEPORT_LB)
+							setsockopt(TempFD, SOL_SOCKET, SO_REUSEPORT_LB, &TempOpt, sizeof(TempOpt));
+#elif defined(SO_REUSEPORT)
+							setsockopt(TempFD, SOL_SOCKET, SO_REUSEPORT, &TempOpt, sizeof(TempOpt));
+#endif
+						}
+
+						if (bind(TempFD, TempResult->ai_addr, TempResult->ai_addrlen) < 0)
+						{
+							close(TempFD);
+							TempFD = -1;
+						}
+					}
+
+					freeaddrinfo(TempResult);
+				}
+
+				// Restore the address for error reporting.
+				if (Host != Addr)  Host[strlen(Host)] = ']';
+				Port[-1] = ':';
+			}
+		}
+
+		if (TempFD > -1 && listen(TempFD, SOMAXCONN) < 0)
+		{
+			close(TempFD);
+			TempFD = -1;
+		}
+
+		if (TempFD < 0)
+		{
+			StaticMixedVar<char[8192]> TempBuffer2;
+
+			TempBuffer2.SetStr("Unable to listen on '");
+			TempBuffer2.AppendStr(Addr);
+			TempBuffer2.AppendStr("'.");
+
+			Log(TempBuffer2.MxStr);
+
+			return false;
+		}
+
+		fcntl(TempFD, F_SETFD, FD_CLOEXEC);
+
+		MxListenFDs[MxNumListenFDs++] = TempFD;
+	}
+
+	return true;
+}
+
+// Called in the forked child.  Moves the listening sockets to file descriptors 3 and up and announces them via LISTEN_FDS/LISTEN_PID.
+void ServiceRunner::PassListenSockets()
+{
+	StaticMixedVar<char[64]> TempBuffer;
+	size_t x;
+	int TempFD;
+
+	if (!MxNumListenFDs)
+	{
+		unsetenv("LISTEN_FDS");
+		unsetenv("LISTEN_PID");
+
+		return;
+	}
+
+	// Move everything out of the way first so dup2() doesn't clobber a socket that hasn't been moved yet.
+	for (x = 0; x < MxNumListenFDs; x++)
+	{
+		TempFD = fcntl(MxListenFDs[x], F_DUPFD_CLOEXEC, (int)(3 + MxNumListenFDs));
+		if (TempFD > -1)  MxListenFDs[x] = TempFD;
+	}
+
+	// dup2() clears FD_CLOEXEC.
+	for (x = 0; x < MxNumListenFDs; x++)  dup2(MxListenFDs[x], (int)(3 + x));
+
+	Convert::Int::ToString(TempBuffer.MxStr, sizeof(TempBuffer.MxStr), (std::uint64_t)MxNumListenFDs);
+	setenv("LISTEN_FDS", TempBuffer.MxStr, 1);
+
+	Convert::Int::ToString(TempBuffer.MxStr, sizeof(TempBuffer.MxStr), (std::uint64_t)getpid());
+	setenv("LISTEN_PID", TempBuffer.MxStr, 1);
+}
+
+void ServiceRunner::OpenOutputStreams()
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+	size_t x;
+	int TempFD;
+
+	for (x = 0; x < 2; x++)
+	{
+		if (MxOutputStrs[x] == NULL)  continue;
+
+		// Share the first pipe when both streams go to the same place.
+		if (x == 1 && MxOutputStrs[0] != NULL && MxOutputPipes[0][0] > -1 && !strcmp(MxOutputStrs[0], MxOutputStrs[1]))  continue;
+
+		const char *Filename = (!strcmp(MxOutputStrs[x], "log") ? MxLogFilename : MxOutputStrs[x]);
+		if (Filename == NULL)  continue;
+
+		// Not opened with O_APPEND since splice() refuses to write to append-only files.  Writes seek to the end instead.
+		TempFD = open(Filename, O_CREAT | O_WRONLY, 0644);
+		if (TempFD < 0)
+		{
+			TempBuffer.SetStr("Unable to open '");
+			TempBuffer.AppendStr(Filename);
+			TempBuffer.AppendStr("' for process output.  Output will be discarded.");
+
+			Log(TempBuffer.MxStr);
+
+			continue;
+		}
+
+		fcntl(TempFD, F_SETFD, FD_CLOEXEC);
+
+		// The write end stays open in the service manager so the pipe survives restarts and never reports end of file.
+		if (pipe(MxOutputPipes[x]) < 0)
+		{
+			close(TempFD);
+			MxOutputPipes[x][0] = -1;
+			MxOutputPipes[x][1] = -1;
+
+			continue;
+		}
+
+		fcntl(MxOutputPipes[x][0], F_SETFD, FD_CLOEXEC);
+		fcntl(MxOutputPipes[x][1], F_SETFD, FD_CLOEXEC);
+		fcntl(MxOutputPipes[x][0], F_SETFL, fcntl(MxOutputPipes[x][0], F_GETFL) | O_NONBLOCK);
+
+		if (!MxOwner->MxEventLoop.Add(MxOutputPipes[x][0], this))
+		{
+			close(TempFD);
+			close(MxOutputPipes[x][0]);
+			close(MxOutputPipes[x][1]);
+			MxOutputPipes[x][0] = -1;
+			MxOutputPipes[x][1] = -1;
+
+			continue;
+		}
+
+		MxOutputFDs[x] = TempFD;
+	}
+}
+
+// Moves captured output from a pipe to its target.  On Linux, splice() moves the data without copying it through the service manager.
+void ServiceRunner::ProcessOutput(size_t Num)
+{
+	char TempBuffer[65536], TempTime[64];
+	ssize_t y;
+	time_t CurrTime;
+
+	// Output that goes to the service manager log is queued behind the log records so it stays in order without waiting on the log writer thread.
+	if (MxLogFD > -1 && !strcmp(MxOutputStrs[Num], "log"))
+	{
+		while ((y = read(MxOutputPipes[Num][0], TempBuffer, sizeof(TempBuffer))) > 0)
+		{
+			char *Pos = TempBuffer, *LastPos = TempBuffer + y, *NextPos;
+
+			while (Pos < LastPos)
+			{
+				NextPos = (MxOutputTimestamps ? (char *)memchr(Pos, '\n', LastPos - Pos) : NULL);
+				NextPos = (NextPos != NULL ? NextPos + 1 : LastPos);
+
+				GxLogWriter.WriteOutput(MxLogFD, Pos, NextPos - Pos, (MxOutputTimestamps && MxOutputLineStart[Num]));
+				MxOutputLineStart[Num] = (NextPos[-1] == '\n');
+
+				Pos = NextPos;
+			}
+		}
+
+		return;
+	}
+
+	lseek(MxOutputFDs[Num], 0, SEEK_END);
+
+#ifdef __linux__
+	if (!MxOutputTimestamps && !MxOutputNoSplice)
+	{
+		while ((y = splice(MxOutputPipes[Num][0], NULL, MxOutputFDs[Num], NULL, sizeof(TempBuffer), SPLICE_F_MOVE | SPLICE_F_NONBLOCK)) > 0);
+
+		// Some targets (e.g. certain filesystems or devices) don't support splice().  Switch to copying.
+		if (y == 0 || errno == EAGAIN || errno == EINTR)  return;
+
+		MxOutputNoSplice = true;
+	}
+#endif
+
+	while ((y = read(MxOutputPipes[Num][0], TempBuffer, sizeof(TempBuffer))) > 0)
+	{
+		char *Pos = TempBuffer, *LastPos = TempBuffer + y, *NextPos;
+
+		while (Pos < LastPos)
+		{
+			if (MxOutputTimestamps && MxOutputLineStart[Num])
+			{
+				CurrTime = time(NULL);
+				strftime(TempTime, sizeof(TempTime) - 1, "%Y-%m-%d %H:%M:%S\t", localtime(&CurrTime));
+
+				if (write(MxOutputFDs[Num], TempTime, strlen(TempTime)) < 0)  {}
+			}
+
+			NextPos = (MxOutputTimestamps ? (char *)memchr(Pos, '\n', LastPos - Pos) : NULL);
+			NextPos = (NextPos != NULL ? NextPos + 1 : LastPos);
+			MxOutputLineStart[Num] = (NextPos[-1] == '\n');
+
+			if (write(MxOutputFDs[Num], Pos, NextPos - Pos) < 0)  {}
+
+			Pos = NextPos;
+		}
+	}
+}
+
+void ServiceRunner::ReopenLogs()
+{
+	int TempFD;
+
+	// dup2() swaps the file out from under the log writer thread without closing the file descriptor it uses.
+	if (MxLogFD > -1)
+	{
+		TempFD = open(MxLogFilename, O_CREAT | O_WRONLY | O_APPEND, 0644);
+		if (TempFD > -1)
+		{
+			dup2(TempFD, MxLogFD);
+			close(TempFD);
+		}
+	}
+
+	for (size_t x = 0; x < 2; x++)
+	{
+		if (MxOutputFDs[x] < 0)  continue;
+
+		TempFD = open((!strcmp(MxOutputStrs[x], "log") ? MxLogFilename : MxOutputStrs[x]), O_CREAT | O_WRONLY, 0644);
+		if (TempFD > -1)
+		{
+			dup2(TempFD, MxOutputFDs[x]);
+			close(TempFD);
+		}
+	}
+
+	// dup2() clears FD_CLOEXEC.
+	if (MxLogFD > -1)  fcntl(MxLogFD, F_SETFD, FD_CLOEXEC);
+	for (size_t x = 0; x < 2; x++)
+	{
+		if (MxOutputFDs[x] > -1)  fcntl(MxOutputFDs[x], F_SETFD, FD_CLOEXEC);
+	}
+
+	MxLogRotateTS = 0;
+}
+
+void ServiceRunner::GetRotatedLogFilename(StaticMixedVar<char[8192]> &Result, std::uint32_t Num, bool Compressed)
+{
+	char TempBuffer[44];
+
+	Convert::Int::ToString(TempBuffer, sizeof(TempBuffer), (std::uint64_t)Num);
+
+	Result.SetStr(MxLogFilename);
+	Result.AppendChar('.');
+	Result.AppendStr(TempBuffer);
+	if (Compressed)  Result.AppendStr(".gz");
+}
+
+// Rotates the log file once it gets too large or too old.  Returns the timestamp at which to check again.
+std::uint64_t ServiceRunner::CheckLogRotation(std::uint64_t CurrTS)
+{
+	StaticMixedVar<char[8192]> TempBuffer, TempBuffer2;
+	struct stat TempStat;
+	int Status;
+
+	if (MxLogFD < 0 || (!MxLogMaxSize && !MxLogInterval))  return 0;
+
+	if (!MxLogRotateTS)  MxLogRotateTS = CurrTS + (std::uint64_t)MxLogInterval * 1000;
+
+	// Wait for the previous compression to finish.  Otherwise gzip might remove the wrong file.
+	if (MxLogCompressPID)
+	{
+		if (waitpid(MxLogCompressPID, &Status, WNOHANG) != MxLogCompressPID)  return 0;
+
+		MxLogCompressPID = 0;
+	}
+
+	// Checking the file size more often than once per second is pointless.
+	if (CurrTS >= MxLogCheckTS)
+	{
+		MxLogCheckTS = CurrTS + 1000;
+
+		if ((MxLogInterval && CurrTS >= MxLogRotateTS) || (MxLogMaxSize && fstat(MxLogFD, &TempStat) == 0 && (std::uint64_t)TempStat.st_size >= MxLogMaxSize))
+		{
+			// Shift the older log files.  Compressed and uncompressed files move together.
+			GetRotatedLogFilename(TempBuffer, MxLogKeep, false);
+			UTF8::File::Delete(TempBuffer.MxStr);
+			GetRotatedLogFilename(TempBuffer, MxLogKeep, true);
+			UTF8::File::Delete(TempBuffer.MxStr);
+
+			for (std::uint32_t x = MxLogKeep; x > 1; x--)
+			{
+				for (size_t y = 0; y < 2; y++)
+				{
+					GetRotatedLogFilename(TempBuffer, x - 1, (y == 1));
+					GetRotatedLogFilename(TempBuffer2, x, (y == 1));
+
+					if (UTF8::File::Exists(TempBuffer.MxStr))  UTF8::File::Move(TempBuffer.MxStr, TempBuffer2.MxStr);
+				}
+			}
+
+			GetRotatedLogFilename(TempBuffer, 1, false);
+			if (MxLogKeep)  UTF8::File::Move(MxLogFilename, TempBuffer.MxStr);
+			else  UTF8::File::Delete(MxLogFilename);
+
+			ReopenLogs();
+			MxLogRotateTS = CurrTS + (std::uint64_t)MxLogInterval * 1000;
+
+			Log("Log file rotated.", false);
+
+			// Compress the rotated file in the background.
+			if (MxLogKeep && MxLogCompress)
+			{
+				MxLogCompressPID = fork();
+
+				if (MxLogCompressPID == 0)
+				{
+					ResetSignalMask();
+					SetInheritedFDsCloseOnExec();
+
+					execlp("gzip", "gzip", "-f", "-q", TempBuffer.MxStr, (char *)NULL);
+
+					_exit(1);
+				}
+				else if (MxLogCompressPID < 0)
+				{
+					MxLogCompressPID = 0;
+
+					Log("Unable to start gzip to compress the rotated log file.", false);
+				}
+			}
+		}
+	}
+
+	return (MxLogInterval ? MxLogRotateTS : 0);
+}
+
+void ServiceRunner::WritePIDFile()
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+	UTF8::File TempFile;
+	size_t y;
+
+	// Write the process IDs to the PID file.
+	if (MxPIDFilename != NULL)
+	{
+		if (!TempFile.Open(MxPIDFilename, O_CREAT | O_WRONLY | O_TRUNC, UTF8::File::ShareBoth, 0644))  Log("Unable to create PID file.", false);
+		else
+		{
+			Convert::Int::ToString(TempBuffer.MxStr, sizeof(TempBuffer.MxStr), (std::uint64_t)Environment::AppInfo::GetCurrentProcessID());
+			TempFile.Write(TempBuffer.MxStr, y);
+			TempFile.Write("\n", y);
+
+			Convert::Int::ToString(TempBuffer.MxStr, sizeof(TempBuffer.MxStr), (std::uint64_t)MxMainPID);
+			TempFile.Write(TempBuffer.MxStr, y);
+			TempFile.Write("\n", y);
+
+			// During an overlapped restart, the previous process is listed on a third line until it exits.
+			if (MxPrevPID)
+			{
+				Convert::Int::ToString(TempBuffer.MxStr, sizeof(TempBuffer.MxStr), (std::uint64_t)MxPrevPID);
+				TempFile.Write(TempBuffer.MxStr, y);
+				TempFile.Write("\n", y);
+			}
+
+			TempFile.Close();
+		}
+	}
+}
+
+void ServiceRunner::GetStatus(ControlResponse &Response)
+{
+	if (MxCurrState == 101)  Response.MxState = CONTROL_STATE_STOPPED;
+	else if (MxCurrState == 6)  Response.MxState = CONTROL_STATE_RELOADING;
+	else if (MxStopRequested || MxCurrState == 2 || MxCurrState == 4 || MxCurrState == 5 || MxCurrState == 7 || MxCurrState == 9 || MxCurrState == 100)  Response.MxState = CONTROL_STATE_STOPPING;
+	else  Response.MxState = CONTROL_STATE_RUNNING;
+
+	Response.MxFlags = (MxOwner->MxSupervise ? CONTROL_FLAG_SUPERVISE : 0);
+	if (MxReady && MxCurrState != 101)  Response.MxFlags |= CONTROL_FLAG_READY;
+	if (MxFailed)  Response.MxFlags |= CONTROL_FLAG_FAILED;
+	if (MxCurrState == 8)  Response.MxFlags |= CONTROL_FLAG_BACKOFF;
+	Response.MxExitCode = MxExitCode;
+	Response.MxManagerPID = (std::uint32_t)getpid();
+	Response.MxServicePID = (MxCurrState == 101 ? 0 : (std::uint32_t)MxMainPID);
+	Response.MxPrevServicePID = (std::uint32_t)MxPrevPID;
+	Response.MxStartCount = MxStartCount;
+	Response.MxStartTime = (std::uint64_t)MxStartTime;
+
+	if (MxCgroupDir != NULL)
+	{
+		Response.MxFlags |= CONTROL_FLAG_CGROUP;
+
+		if (!ReadCgroupValue(MxCgroupDir, "memory.current", NULL, Response.MxCgroupMemory))  Response.MxCgroupMemory = CONTROL_CGROUP_NONE;
+		if (!ReadCgroupValue(MxCgroupDir, "pids.current", NULL, Response.MxCgroupProcesses))  Response.MxCgroupProcesses = CONTROL_CGROUP_NONE;
+		if (!ReadCgroupValue(MxCgroupDir, "cpu.stat", "usage_usec", Response.MxCgroupCPUUsage))  Response.MxCgroupCPUUsage = CONTROL_CGROUP_NONE;
+		if (!ReadCgroupValue(MxCgroupDir, "cpu.stat", "throttled_usec", Response.MxCgroupCPUThrottled))  Response.MxCgroupCPUThrottled = CONTROL_CGROUP_NONE;
+		if (!ReadCgroupValue(MxCgroupDir, "memory.events", "oom_kill", Response.MxCgroupOOMKills))  Response.MxCgroupOOMKills = CONTROL_CGROUP_NONE;
+	}
+}
+
+// Converts a wait status to an exit code.  Signals map to 128 + signal like shells do.
+int GetWaitStatusExitCode(int Status)
+{
+	if (WIFEXITED(Status))  return WEXITSTATUS(Status);
+	if (WIFSIGNALED(Status))  return 128 + WTERMSIG(Status);
+
+	return 1;
+}
+
+std::uint64_t GetTimevalMicroseconds(const struct timeval &TempTime)
+{
+	return ((std::uint64_t)TempTime.tv_sec * 1000000) + (std::uint64_t)TempTime.tv_usec;
+}
+
+// ru_maxrss is in bytes on Mac OSX and kilobytes everywhere else.
+std::uint64_t GetMaxRSSBytes(const struct rusage &Usage)
+{
+#ifdef __APPLE__
+	return (std::uint64_t)Usage.ru_maxrss;
+#else
+	return (std::uint64_t)Usage.ru_maxrss * 1024;
+#endif
+}
+
+// Logs how a process ended and the resources it used.  Prefix is "Process" or "Previous process".
+void ServiceRunner::LogProcessExit(const char *Prefix, int Status, const struct rusage &Usage)
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+
+	TempBuffer.SetStr(Prefix);
+	if (WIFSIGNALED(Status))
+	{
+		TempBuffer.AppendFormattedStr(" terminated by signal %d (%s)", WTERMSIG(Status), strsignal(WTERMSIG(Status)));
+#ifdef WCOREDUMP
+		if (WCOREDUMP(Status))  TempBuffer.AppendStr(", core dumped");
+#endif
+		TempBuffer.AppendChar('.');
+	}
+	else
+	{
+		TempBuffer.AppendFormattedStr(" terminated with exit code %d.", GetWaitStatusExitCode(Status));
+	}
+
+	Log(TempBuffer.MxStr);
+
+	TempBuffer.SetStr(Prefix);
+	TempBuffer.AppendFormattedStr(" resource usage:  %.3fs user, %.3fs system, %llu KB max RSS, %ld major faults, %ld minor faults, %ld voluntary and %ld involuntary context switches.",
+		(double)GetTimevalMicroseconds(Usage.ru_utime) / 1000000.0, (double)GetTimevalMicroseconds(Usage.ru_stime) / 1000000.0, (unsigned long long)(GetMaxRSSBytes(Usage) / 1024),
+		(long)Usage.ru_majflt, (long)Usage.ru_minflt, (long)Usage.ru_nvcsw, (long)Usage.ru_nivcsw);
+
+	Log(TempBuffer.MxStr);
+}
+
+void ServiceRunner::RecordExit(int Status, const struct rusage &Usage)
+{
+	MxExitCount++;
+
+	MxLastStatus = Status;
+	MxLastSignal = (WIFSIGNALED(Status) ? WTERMSIG(Status) : 0);
+	if (MxLastSignal)  MxSignalExitCount++;
+
+#ifdef WCOREDUMP
+	MxLastCoreDump = (MxLastSignal && WCOREDUMP(Status));
+#endif
+
+	MxLastUsage = Usage;
+	MxUsageUserSum += GetTimevalMicroseconds(Usage.ru_utime);
+	MxUsageSysSum += GetTimevalMicroseconds(Usage.ru_stime);
+
+	if (MxStopStartUS)
+	{
+		std::uint64_t CurrUS = GetMonotonicMicroseconds();
+
+		AddLatency(LATENCY_STOP, MxStopStartUS, CurrUS);
+		MxStopUS = CurrUS - MxStopStartUS;
+	}
+
+	MxExitRecorded = true;
+}
+
+// The exec pipe was closed by a successful exec() or received the errno of a failed one.
+void ServiceRunner::ProcessExecEvent()
+{
+	int TempErr;
+	ssize_t Result = read(MxExecFD, &TempErr, sizeof(TempErr));
+
+	if (Result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))  return;
+
+	if (!Result)
+	{
+		MxExecUS = GetMonotonicMicroseconds();
+
+		AddLatency(LATENCY_EXEC, MxForkUS, MxExecUS);
+	}
+
+	ClosePIDFD(MxExecFD);
+}
+
+void ServiceRunner::AddLatency(size_t Num, std::uint64_t StartUS, std::uint64_t EndUS)
+{
+	if (!StartUS || EndUS < StartUS)  return;
+
+	MxLatency[Num].Add(EndUS - StartUS);
+	MxLatency[Num].GetSummary(MxLatencySummary[Num]);
+}
+
+// Notes state changes.  Starts the stop latency clock and appends a record to the trace file.
+void ServiceRunner::TraceState()
+{
+	if (MxCurrState == MxTraceState)  return;
+
+	std::uint64_t CurrUS = GetMonotonicMicroseconds();
+
+	if ((MxCurrState == 2 || MxCurrState == 4 || MxCurrState == 5) && !MxStopStartUS)  MxStopStartUS = CurrUS;
+
+	if (MxTraceFD > -1)
+	{
+		ServiceTraceRecord TempRecord;
+
+		TempRecord.MxMonotonicUS = CurrUS;
+		TempRecord.MxTimeUS = GetUnixMicroseconds();
+		TempRecord.MxPID = (std::uint32_t)MxMainPID;
+		TempRecord.MxGeneration = MxStartCount;
+		TempRecord.MxFromState = (std::uint16_t)MxTraceState;
+		TempRecord.MxToState = (std::uint16_t)MxCurrState;
+		TempRecord.MxReserved = 0;
+
+		if (write(MxTraceFD, &TempRecord, sizeof(TempRecord)) < 0)  {}
+	}
+
+	MxTraceState = MxCurrState;
+}
+
+// Maps a state to its slot in MxStateTimes and GxMetricStateNames.
+size_t GetStateIndex(size_t State)
+{
+	if (State <= 9)  return State;
+
+	return (State == 100 ? 10 : 11);
+}
+
+// Charges the time since the last call to the state the service was in.
+void ServiceRunner::UpdateStateTimes(std::uint64_t CurrTS)
+{
+	if (MxMetricsStateTS && CurrTS > MxMetricsStateTS)  MxStateTimes[GetStateIndex(MxMetricsState)] += CurrTS - MxMetricsStateTS;
+
+	MxMetricsState = MxCurrState;
+	MxMetricsStateTS = CurrTS;
+}
+
+void ServiceRunner::AppendMetric(size_t Num, StaticMixedVar<char[8192]> &Dest, std::uint64_t CurrTS)
+{
+	const char *Name = GxMetricDefs[Num].MxName;
+	bool Running = (MxCurrState == 1 || MxCurrState == 4 || MxCurrState == 5 || MxCurrState == 6);
+
+	switch (Num)
+	{
+		case 0:  Dest.AppendFormattedStr("%s{service=\"%s\"} %d\n", Name, MxName, (Running ? 1 : 0));  break;
+		case 1:  Dest.AppendFormattedStr("%s{service=\"%s\"} %d\n", Name, MxName, (Running && MxReady ? 1 : 0));  break;
+		case 2:  Dest.AppendFormattedStr("%s{service=\"%s\"} %u\n", Name, MxName, MxStartCount);  break;
+		case 3:  Dest.AppendFormattedStr("%s{service=\"%s\"} %u\n", Name, MxName, (MxStartCount ? MxStartCount - 1 : 0));  break;
+		case 4:  Dest.AppendFormattedStr("%s{service=\"%s\"} %u\n", Name, MxName, MxExitCount);  break;
+		case 5:  Dest.AppendFormattedStr("%s{service=\"%s\"} %u\n", Name, MxName, MxSignalExitCount);  break;
+		case 6:  Dest.AppendFormattedStr("%s{service=\"%s\"} %u\n", Name, MxName, MxForceTermCount);  break;
+		case 7:  Dest.AppendFormattedStr("%s{service=\"%s\"} %u\n", Name, MxName, MxKillCount);  break;
+		case 8:  Dest.AppendFormattedStr("%s{service=\"%s\"} %d\n", Name, MxName, MxExitCode);  break;
+		case 9:  Dest.AppendFormattedStr("%s{service=\"%s\"} %d\n", Name, MxName, MxLastSignal);  break;
+		case 10:  Dest.AppendFormattedStr("%s{service=\"%s\"} %.3f\n", Name, MxName, (Running ? (double)(CurrTS - MxStartTS) / 1000.0 : 0.0));  break;
+		case 11:
+		{
+			UpdateStateTimes(CurrTS);
+
+			for (size_t x = 0; x < sizeof(MxStateTimes) / sizeof(MxStateTimes[0]); x++)
+			{
+				Dest.AppendFormattedStr("%s{service=\"%s\",state=\"%s\"} %.3f\n", Name, MxName, GxMetricStateNames[x], (double)MxStateTimes[x] / 1000.0);
+			}
+
+			break;
+		}
+		case 12:  Dest.AppendFormattedStr("%s{service=\"%s\"} %u\n", Name, MxName, MxReloadCount);  break;
+		case 13:  Dest.AppendFormattedStr("%s{service=\"%s\"} %u\n", Name, MxName, MxReloadTimeoutCount);  break;
+		case 14:
+		{
+			Dest.AppendFormattedStr("%s_sum{service=\"%s\"} %.3f\n", Name, MxName, (double)MxReloadAckSum / 1000.0);
+			Dest.AppendFormattedStr("%s_count{service=\"%s\"} %u\n", Name, MxName, MxReloadAckCount);
+
+			break;
+		}
+		case 15:  Dest.AppendFormattedStr("%s{service=\"%s\"} %.3f\n", Name, MxName, (double)MxReloadAckLast / 1000.0);  break;
+		case 16:  Dest.AppendFormattedStr("%s{service=\"%s\"} %.3f\n", Name, MxName, (double)MxStopLast / 1000.0);  break;
+		case 17:  Dest.AppendFormattedStr("%s{service=\"%s\"} %.6f\n", Name, MxName, (double)MxUsageUserSum / 1000000.0);  break;
+		case 18:  Dest.AppendFormattedStr("%s{service=\"%s\"} %.6f\n", Name, MxName, (double)MxUsageSysSum / 1000000.0);  break;
+		case 19:  Dest.AppendFormattedStr("%s{service=\"%s\"} %.6f\n", Name, MxName, (double)GetTimevalMicroseconds(MxLastUsage.ru_utime) / 1000000.0);  break;
+		case 20:  Dest.AppendFormattedStr("%s{service=\"%s\"} %.6f\n", Name, MxName, (double)GetTimevalMicroseconds(MxLastUsage.ru_stime) / 1000000.0);  break;
+		case 21:  Dest.AppendFormattedStr("%s{service=\"%s\"} %llu\n", Name, MxName, (unsigned long long)GetMaxRSSBytes(MxLastUsage));  break;
+		case 22:  Dest.AppendFormattedStr("%s{service=\"%s\"} %ld\n", Name, MxName, (long)MxLastUsage.ru_majflt);  break;
+		case 23:  Dest.AppendFormattedStr("%s{service=\"%s\"} %ld\n", Name, MxName, (long)MxLastUsage.ru_minflt);  break;
+		case 24:  Dest.AppendFormattedStr("%s{service=\"%s\"} %ld\n", Name, MxName, (long)MxLastUsage.ru_nvcsw);  break;
+		case 25:  Dest.AppendFormattedStr("%s{service=\"%s\"} %ld\n", Name, MxName, (long)MxLastUsage.ru_nivcsw);  break;
+		case 26:  Dest.AppendFormattedStr("%s{service=\"%s\"} %d\n", Name, MxName, (MxLastCoreDump ? 1 : 0));  break;
+		case 27:  Dest.AppendFormattedStr("%s{service=\"%s\"} %u\n", Name, MxName, MxAutoRestartCount);  break;
+		case 28:  Dest.AppendFormattedStr("%s{service=\"%s\"} %.3f\n", Name, MxName, (double)MxRestartDelayLast / 1000.0);  break;
+		case 29:  Dest.AppendFormattedStr("%s{service=\"%s\"} %d\n", Name, MxName, (MxFailed ? 1 : 0));  break;
+		case 30:  Dest.AppendFormattedStr("%s{service=\"%s\"} %u\n", Name, MxName, MxHealthFailCount);  break;
+		case 31:  Dest.AppendFormattedStr("%s{service=\"%s\"} %u\n", Name, MxName, MxHealthRestartCount);  break;
+	}
+}
+
+void ServiceRunner::PublishStatus()
+{
+	if (MxStatusSlot == NULL)  return;
+
+	ControlResponse TempResponse;
+	memset(&TempResponse, 0, sizeof(TempResponse));
+	TempResponse.MxVersion = CONTROL_PROTOCOL_VERSION;
+	TempResponse.MxCommand = CONTROL_CMD_STATUS;
+	GetStatus(TempResponse);
+
+	StatusTable::Publish(MxStatusSlot, TempResponse, MxLatencySummary);
+}
+
+void ServiceRunner::RequestStart()
+{
+	if (MxCurrState == 101)
+	{
+		if (MxFailed)
+		{
+			Log("Clearing the failed state.", false);
+
+			ResetRestartLimit();
+		}
+
+		MxStopRequested = false;
+		MxRestartRequested = false;
+		MxCurrState = 0;
+		MxCheck = true;
+	}
+	else if (MxStopRequested)
+	{
+		// Start again once the stop completes.
+		MxRestartRequested = true;
+	}
+}
+
+void ServiceRunner::RequestStop(bool Restart)
+{
+	if (MxCurrState == 101)
+	{
+		if (Restart)  RequestStart();
+	}
+	else if (Restart && MxOverlapAmount && !MxStopRequested && (MxCurrState == 1 || MxCurrState == 6))
+	{
+		// Starts once any overlapped restart already in progress completes.
+		MxOverlapRequested = true;
+		MxCheck = true;
+	}
+	else
+	{
+		if (!MxStopRequested)  MxStopRequestTS = GetMonotonicMilliseconds();
+
+		MxStopRequested = true;
+		MxRestartRequested = Restart;
+		MxCheck = true;
+	}
+}
+
+// Adds '@Num' to a filename.
+void SetInstanceFilename(char *&Filename, std::uint32_t Num)
+{
+	if (Filename == NULL)  return;
+
+	StaticMixedVar<char[8192]> TempBuffer;
+
+	TempBuffer.SetStr(Filename);
+	TempBuffer.AppendChar('@');
+	TempBuffer.AppendUInt(Num);
+
+	delete[] Filename;
+	Filename = CopyStr(TempBuffer.MxStr);
+}
+
+void ServiceRunner::SetInstance(ServiceRunner *Leader, std::uint32_t Num)
+{
+	MxLeader = Leader;
+	MxInstance = Num;
+
+	// Everything that can't be shared gets its own name.  The metrics file is shared since every sample is labeled with the service name.
+	SetInstanceFilename(MxName, Num);
+	SetInstanceFilename(MxPIDFilename, Num);
+	SetInstanceFilename(MxLogFilename, Num);
+	SetInstanceFilename(MxTraceFilename, Num);
+	SetInstanceFilename(MxHealthFilename, Num);
+
+	for (size_t x = 0; x < 2; x++)
+	{
+		if (MxOutputStrs[x] != NULL && strcmp(MxOutputStrs[x], "log"))  SetInstanceFilename(MxOutputStrs[x], Num);
+	}
+
+	StaticMixedVar<char[8192]> TempBuffer;
+
+	TempBuffer.SetStr(MxNotifyStopFilename);
+	TempBuffer.SetSize(TempBuffer.MxStrPos - 5);
+	TempBuffer.AppendChar('@');
+	TempBuffer.AppendUInt(Num);
+
+	delete[] MxNotifyStopFilename;
+	delete[] MxNotifyReloadFilename;
+	SetNotifyFilenames(TempBuffer.MxStr);
+}
+
+void ServiceRunner::AddInstance(ServiceRunner *Instance)
+{
+	if (MxInstances == NULL)
+	{
+		MxInstances = new ServiceRunner *[MxNumInstances];
+		MxInstances[0] = this;
+		MxNumInstancesAdded = 1;
+	}
+
+	if (MxNumInstancesAdded < MxNumInstances)  MxInstances[MxNumInstancesAdded++] = Instance;
+}
+
+// Hands a reload to the other copies.  Called by the leader when it starts reloading.
+void ServiceRunner::PropagateReload()
+{
+	if (MxInstances == NULL)  return;
+
+	for (size_t x = 1; x < MxNumInstancesAdded; x++)  MxInstances[x]->RequestReload();
+
+	MxReloadPropagations++;
+}
+
+void ServiceRunner::RequestReload()
+{
+	if (MxCurrState == 101)  return;
+
+	int TempFD = open(MxNotifyReloadFilename, O_CREAT | O_WRONLY | O_CLOEXEC, 0664);
+	if (TempFD < 0)
+	{
+		Log("Unable to create the reload notification file.");
+
+		return;
+	}
+
+	if ((MxUserID || MxGroupID) && fchown(TempFD, (MxUserID ? MxUserID : (uid_t)-1), (MxGroupID ? MxGroupID : (gid_t)-1)) < 0)  {}
+	close(TempFD);
+
+	MxCheck = true;
+}
+
+// Parses 'tcp:host:port', 'unix:/path', 'file:/path', or 'action:Name'.  TCP addresses are only resolved once.
+bool ServiceRunner::InitHealthProbe(const char *ProbeStr)
+{
+	StaticMixedVar<char[8192]> TempBuffer, TempBuffer2;
+
+	if (!strncmp(ProbeStr, "tcp:", 4))
+	{
+		struct addrinfo TempHints, *TempResult;
+		char *Host, *Port;
+
+		// Split the host and the port.  IPv6 hosts are enclosed in square brackets.
+		TempBuffer.SetStr(ProbeStr + 4);
+		Port = strrchr(TempBuffer.MxStr, ':');
+		if (Port == NULL)  return false;
+		*Port++ = '\0';
+
+		Host = TempBuffer.MxStr;
+		if (Host[0] == '[' && Host[strlen(Host) - 1] == ']')
+		{
+			Host++;
+			Host[strlen(Host) - 1] = '\0';
+		}
+
+		memset(&TempHints, 0, sizeof(TempHints));
+		TempHints.ai_family = AF_UNSPEC;
+		TempHints.ai_socktype = SOCK_STREAM;
+
+		if (getaddrinfo((Host[0] ? Host : "localhost"), Port, &TempHints, &TempResult) != 0)  return false;
+
+		if (TempResult->ai_addrlen <= sizeof(MxHealthAddr))
+		{
+			memcpy(&MxHealthAddr, TempResult->ai_addr, TempResult->ai_addrlen);
+			MxHealthAddrLen = TempResult->ai_addrlen;
+		}
+
+		freeaddrinfo(TempResult);
+
+		if (!MxHealthAddrLen)  return false;
+
+		MxHealthType = HEALTH_PROBE_TCP;
+	}
+	else if (!strncmp(ProbeStr, "unix:", 5))
+	{
+		struct sockaddr_un *TempAddr = (struct sockaddr_un *)&MxHealthAddr;
+
+		if (!ProbeStr[5] || strlen(ProbeStr + 5) >= sizeof(TempAddr->sun_path))  return false;
+
+		memset(TempAddr, 0, sizeof(struct sockaddr_un));
+		TempAddr->sun_family = AF_UNIX;
+		strcpy(TempAddr->sun_path, ProbeStr + 5);
+		MxHealthAddrLen = sizeof(struct sockaddr_un);
+
+		MxHealthType = HEALTH_PROBE_UNIX;
+	}
+	else if (!strncmp(ProbeStr, "file:", 5) && ProbeStr[5])
+	{
+		MxHealthFilename = CopyStr(ProbeStr + 5);
+
+		MxHealthType = HEALTH_PROBE_FILE;
+	}
+	else if (!strncmp(ProbeStr, "action:", 7) && ProbeStr[7])
+	{
+		// Custom actions are stored in the service info file by 'addaction'.
+		TempBuffer2.SetStr("action_");
+		TempBuffer2.AppendStr(ProbeStr + 7);
+		if (!GetServiceInfoStr(TempBuffer2.MxStr, TempBuffer, true, MxName))  return false;
+
+		char **TempArgs = ExtractArgs(TempBuffer);
+		if (TempArgs == NULL)  return false;
+
+		MxHealthCmdLine = new char[TempBuffer.MxStrPos + 1];
+		memcpy(MxHealthCmdLine, TempBuffer.MxStr, TempBuffer.MxStrPos + 1);
+
+		for (size_t x = 0; TempArgs[x] != NULL; x++)  TempArgs[x] = MxHealthCmdLine + (TempArgs[x] - TempBuffer.MxStr);
+		MxHealthArgs = TempArgs;
+
+		MxHealthType = HEALTH_PROBE_ACTION;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+// Runs the health probe while the process is running.  Returns the timestamp at which to check again.
+std::uint64_t ServiceRunner::CheckHealth(std::uint64_t CurrTS)
+{
+	int Status;
+
+	if (MxHealthType == HEALTH_PROBE_NONE)  return 0;
+
+	if (MxHealthPID && waitpid(MxHealthPID, &Status, WNOHANG) == MxHealthPID)
+	{
+		MxHealthPID = 0;
+
+		// A custom action that was killed after timing out has already been counted.
+		if (MxHealthDeadlineTS)  FinishHealthProbe(CurrTS, (WIFEXITED(Status) && WEXITSTATUS(Status) == 0 ? NULL : "The custom action failed"));
+	}
+
+	// Probing starts once readiness is known.  Reloads and stops have their own timeouts.
+	if (MxCurrState != 1 || MxStopRequested || (!MxReady && !MxReadyFailed))
+	{
+		StopHealthProbe();
+		MxHealthRestart = false;
+
+		return 0;
+	}
+
+	// Every new process starts over.
+	if (MxHealthStartCount != MxStartCount)
+	{
+		StopHealthProbe();
+
+		MxHealthStartCount = MxStartCount;
+		MxHealthFailures = 0;
+		MxHealthTS = CurrTS + MxHealthInterval;
+	}
+
+	if (MxHealthDeadlineTS && CurrTS >= MxHealthDeadlineTS)  FinishHealthProbe(CurrTS, "Timed out");
+
+	if (!MxHealthDeadlineTS && !MxHealthRestart && CurrTS >= MxHealthTS)  StartHealthProbe(CurrTS);
+
+	return (MxHealthDeadlineTS ? MxHealthDeadlineTS : MxHealthTS);
+}
+
+// File probes complete right away.  Socket probes complete in HandleEvent() and custom actions in CheckHealth().
+void ServiceRunner::StartHealthProbe(std::uint64_t CurrTS)
+{
+	MxHealthDeadlineTS = CurrTS + MxHealthTimeout;
+
+	if (MxHealthType == HEALTH_PROBE_FILE)
+	{
+		struct stat TempStat;
+		time_t CurrTime = time(NULL);
+
+		if (stat(MxHealthFilename, &TempStat) < 0)  FinishHealthProbe(CurrTS, "The file does not exist");
+		else if (TempStat.st_mtime < CurrTime && (std::uint64_t)(CurrTime - TempStat.st_mtime) * 1000 > (std::uint64_t)MxHealthInterval + MxHealthTimeout)  FinishHealthProbe(CurrTS, "The file was not updated in time");
+		else  FinishHealthProbe(CurrTS, NULL);
+	}
+	else if (MxHealthType == HEALTH_PROBE_TCP || MxHealthType == HEALTH_PROBE_UNIX)
+	{
+		// No data is exchanged.  The connection only has to be accepted.
+		MxHealthFD = socket(MxHealthAddr.ss_family, SOCK_STREAM, 0);
+		if (MxHealthFD < 0)
+		{
+			FinishHealthProbe(CurrTS, "Unable to create a socket");
+
+			return;
+		}
+
+		fcntl(MxHealthFD, F_SETFD, FD_CLOEXEC);
+		fcntl(MxHealthFD, F_SETFL, fcntl(MxHealthFD, F_GETFL) | O_NONBLOCK);
+
+		if (connect(MxHealthFD, (struct sockaddr *)&MxHealthAddr, MxHealthAddrLen) == 0)  FinishHealthProbe(CurrTS, NULL);
+		else if (errno != EINPROGRESS)  FinishHealthProbe(CurrTS, "Unable to connect");
+		else if (!MxOwner->MxEventLoop.Add(MxHealthFD, this, true))  FinishHealthProbe(CurrTS, "Unable to wait for the connection");
+	}
+	else if (MxHealthType == HEALTH_PROBE_ACTION)
+	{
+		if (MxHealthPID)
+		{
+			FinishHealthProbe(CurrTS, "The previous custom action is still running");
+
+			return;
+		}
+
+		MxHealthPID = fork();
+
+		if (MxHealthPID < 0)
+		{
+			MxHealthPID = 0;
+
+			FinishHealthProbe(CurrTS, "Unable to fork() the custom action");
+		}
+		else if (MxHealthPID == 0)
+		{
+			// Run the custom action like the process, but in its own process group without any output.
+			ResetSignalMask();
+			SetInheritedFDsCloseOnExec();
+			setpgid(0, 0);
+
+			int TempFD = open("/dev/null", O_RDWR);
+			if (TempFD > -1)
+			{
+				dup2(TempFD, 0);
+				dup2(TempFD, 1);
+				dup2(TempFD, 2);
+
+				if (TempFD > 2)  close(TempFD);
+			}
+
+			char TempNum[16];
+
+			snprintf(TempNum, sizeof(TempNum), "%u", (unsigned int)MxMainPID);
+			setenv("SERVICEMANAGER_PID", TempNum, 1);
+
+			if (MxNumInstances > 1)
+			{
+				snprintf(TempNum, sizeof(TempNum), "%u", MxInstance);
+				setenv("SERVICEMANAGER_INSTANCE", TempNum, 1);
+				snprintf(TempNum, sizeof(TempNum), "%u", MxNumInstances);
+				setenv("SERVICEMANAGER_INSTANCES", TempNum, 1);
+			}
+
+			if (MxStartDir != NULL && chdir(MxStartDir) < 0)  _exit(1);
+			if (MxGroupID && setgid(MxGroupID) < 0)  _exit(1);
+			if (MxUserID && setuid(MxUserID) < 0)  _exit(1);
+
+			execv(MxHealthArgs[0], MxHealthArgs);
+
+			_exit(1);
+		}
+		else
+		{
+			setpgid(MxHealthPID, MxHealthPID);
+		}
+	}
+}
+
+// Abandons the probe in progress.  A custom action is killed but reaped later.
+void ServiceRunner::StopHealthProbe()
+{
+	ClosePIDFD(MxHealthFD);
+
+	if (MxHealthPID && MxHealthDeadlineTS)  kill(-MxHealthPID, SIGKILL);
+
+	MxHealthDeadlineTS = 0;
+}
+
+// Failure is NULL when the probe passed.
+void ServiceRunner::FinishHealthProbe(std::uint64_t CurrTS, const char *Failure)
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+
+	StopHealthProbe();
+
+	MxHealthTS = CurrTS + MxHealthInterval;
+
+	if (Failure == NULL)
+	{
+		if (MxHealthFailures)  Log("Health check passed.", false);
+
+		MxHealthFailures = 0;
+
+		return;
+	}
+
+	MxHealthFailures++;
+	MxHealthFailCount++;
+
+	TempBuffer.SetFormattedStr("Health check failed (%u of %u).  %s.", MxHealthFailures, MxHealthThreshold, Failure);
+	Log(TempBuffer.MxStr, false);
+
+	if (MxHealthFailures >= MxHealthThreshold)
+	{
+		Log("Restarting the process after too many failed health checks.");
+
+		MxHealthFailures = 0;
+		MxHealthRestartCount++;
+		MxHealthRestart = true;
+		MxCheck = true;
+	}
+}
+
+// Moves the current process aside and starts a new one.  The previous process is stopped once the new one is ready.
+void ServiceRunner::StartOverlappedRestart()
+{
+	Log("Starting a new process before stopping the current one.", false);
+
+	MxPrevPID = MxMainPID;
+	MxPrevPIDFD = MxMainPIDFD;
+	MxPrevCgroupNum = MxMainCgroupNum;
+	MxMainPIDFD = -1;
+	MxMainCgroupNum = 0;
+	MxPrevStateTS = 0;
+	MxPrevTermSent = false;
+	MxPrevKillSent = false;
+
+	MxOverlapRequested = false;
+	MxCurrState = 0;
+}
+
+// The new process of an overlapped restart failed.  The previous process becomes the current process again.
+void ServiceRunner::KeepPrevProcess()
+{
+	Log("Keeping the previous process running.");
+
+	MxMainPID = MxPrevPID;
+	MxMainPIDFD = MxPrevPIDFD;
+	MxMainCgroupNum = MxPrevCgroupNum;
+	MxPrevPID = 0;
+	MxPrevPIDFD = -1;
+	MxPrevCgroupNum = 0;
+
+	MxReady = true;
+	MxReadyFailed = true;
+	MxStateTS = 0;
+	MxCurrState = 1;
+}
+
+// Stops the previous process of an overlapped restart once the new process is ready.  Returns the timestamp at which to run again.
+std::uint64_t ServiceRunner::ProcessPrevProcess(std::uint64_t CurrTS)
+{
+	int Status;
+	struct rusage TempUsage;
+
+	if (!MxPrevPID)  return 0;
+
+	if (wait4(MxPrevPID, &Status, WNOHANG, &TempUsage) == MxPrevPID)
+	{
+		LogProcessExit("Previous process", Status, TempUsage);
+
+		if (MxPrevTermSent)  AddLatency(LATENCY_STOP, MxPrevStopStartUS, GetMonotonicMicroseconds());
+
+		// The previous process already had its chance to stop.  Anything it left behind is killed.
+		if (MxKillMode != KILL_MODE_PROCESS && HasProcesses(MxPrevPID, MxPrevCgroupNum))
+		{
+			Log("Killing processes left behind by the previous process.", false);
+
+			SignalProcesses(MxPrevPID, MxPrevCgroupNum, SIGKILL);
+		}
+
+		RemoveCgroup(MxPrevCgroupNum);
+
+		MxUsageUserSum += GetTimevalMicroseconds(TempUsage.ru_utime);
+		MxUsageSysSum += GetTimevalMicroseconds(TempUsage.ru_stime);
+
+		ClosePIDFD(MxPrevPIDFD);
+		MxPrevPID = 0;
+
+		if (MxReady)  WritePIDFile();
+
+		MxCheck = true;
+
+		return 0;
+	}
+
+	if (!MxPrevTermSent)
+	{
+		if (MxReadyFailed && !MxStopRequested && (MxCurrState == 1 || MxCurrState == 6))
+		{
+			// The new process didn't become ready.  Stop it instead.
+			pid_t TempPID = MxMainPID;
+			int TempFD = MxMainPIDFD;
+			std::uint32_t TempCgroupNum = MxMainCgroupNum;
+
+			KeepPrevProcess();
+
+			MxPrevPID = TempPID;
+			MxPrevPIDFD = TempFD;
+			MxPrevCgroupNum = TempCgroupNum;
+
+			WritePIDFile();
+
+			Log("Stopping the new process.", false);
+		}
+		else if (!MxStopRequested && MxCurrState < 100 && (MxReadyFD > -1 ? !MxReady : CurrTS < MxStartTS + MxOverlapAmount))
+		{
+			// Wait for readiness (readiness notification wakes the state machine) or the overlap delay.
+			return (MxReadyFD > -1 ? 0 : MxStartTS + MxOverlapAmount);
+		}
+		else
+		{
+			Log("Stopping the previous process.", false);
+		}
+
+		MxPrevTermSent = true;
+		MxPrevStopStartUS = GetMonotonicMicroseconds();
+		if (!SignalProcesses(MxPrevPID, MxPrevCgroupNum, SIGTERM))
+		{
+			if (!SignalProcesses(MxPrevPID, MxPrevCgroupNum, SIGKILL))  Log("Previous process termination initiation failed.");
+
+			MxPrevKillSent = true;
+		}
+
+		MxPrevStateTS = (MxPrevKillSent ? CurrTS + MxKillWaitAmount : (MxWaitAmount == INFINITE ? 0 : CurrTS + MxWaitAmount));
+	}
+	else if (MxPrevStateTS && CurrTS >= MxPrevStateTS)
+	{
+		if (!MxPrevKillSent)
+		{
+			// Force terminate the process since the timeout has expired.
+			if (!SignalProcesses(MxPrevPID, MxPrevCgroupNum, SIGKILL))  Log("Previous process force termination initiation failed.");
+
+			MxPrevKillSent = true;
+			MxPrevStateTS = CurrTS + MxKillWaitAmount;
+		}
+		else
+		{
+			// Unable to reap the process.  Carry on anyway.
+			Log("Previous process force termination failed.");
+
+			ClosePIDFD(MxPrevPIDFD);
+			MxPrevPID = 0;
+
+			if (MxReady)  WritePIDFile();
+
+			MxCheck = true;
+
+			return 0;
+		}
+	}
+
+	return MxPrevStateTS;
+}
+
+// Decides when to start a process that exited on its own again.  Gives up when the restart limit is reached.
+void ServiceRunner::ScheduleRestart(std::uint64_t CurrTS)
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+
+	if (MxRestartLimit)
+	{
+		if (MxRestartTimes == NULL)
+		{
+			MxRestartTimes = new std::uint64_t[MxRestartLimit];
+			MxNumRestartTimes = 0;
+			MxRestartPos = 0;
+		}
+
+		// Once the ring buffer is full, the oldest entry is the one that gets replaced.
+		if (MxNumRestartTimes == MxRestartLimit && CurrTS < MxRestartTimes[MxRestartPos] + (std::uint64_t)MxRestartWindow * 1000)
+		{
+			TempBuffer.SetFormattedStr("Process was restarted %u times within %u seconds.  Service failed.", MxRestartLimit, MxRestartWindow);
+			Log(TempBuffer.MxStr);
+
+			MxFailed = true;
+			MxCurrState = 100;
+
+			return;
+		}
+
+		MxRestartTimes[MxRestartPos] = CurrTS;
+		MxRestartPos = (MxRestartPos + 1) % MxRestartLimit;
+		if (MxNumRestartTimes < MxRestartLimit)  MxNumRestartTimes++;
+	}
+
+	MxAutoRestartCount++;
+
+	if (MxRestartPolicy == RESTART_POLICY_IMMEDIATE)  MxStateTS = CurrTS;
+	else if (MxRestartPolicy == RESTART_POLICY_BACKOFF)
+	{
+		// A process that stayed up long enough starts over with the initial delay.
+		if (CurrTS >= MxStartTS + MxRestartMaxDelay)  MxRestartFailures = 0;
+
+		std::uint64_t Delay = MxRestartDelay;
+		for (std::uint32_t x = 0; x < MxRestartFailures && Delay < MxRestartMaxDelay; x++)  Delay *= 2;
+		if (Delay > MxRestartMaxDelay)  Delay = MxRestartMaxDelay;
+
+		// Jitter keeps services that failed together from restarting together.
+		if (Delay > 1)  Delay = Delay / 2 + (std::uint64_t)rand_r(&MxRandSeed) % (Delay / 2 + 1);
+
+		MxRestartFailures++;
+		MxStateTS = CurrTS + Delay;
+
+		TempBuffer.SetFormattedStr("Restarting the process in %.3f seconds.", (double)Delay / 1000.0);
+		Log(TempBuffer.MxStr, false);
+	}
+	else
+	{
+		// Limit restarts to one per delay period to avoid a tight crash loop.
+		MxStateTS = MxStartTS + MxRestartDelay;
+	}
+
+	MxRestartDelayLast = (MxStateTS > CurrTS ? MxStateTS - CurrTS : 0);
+	MxCurrState = (MxStateTS > CurrTS ? 8 : 0);
+}
+
+// Moves on once the process and anything it left behind are gone.
+void ServiceRunner::ContinueAfterExit(std::uint64_t CurrTS)
+{
+	RemoveCgroup(MxMainCgroupNum);
+
+	if (MxStopRequested)  MxNextState = 100;
+
+	// A process that exited on its own is restarted according to the restart policy.
+	if (MxNextState == 0)  ScheduleRestart(CurrTS);
+	else  MxCurrState = MxNextState;
+}
+
+// Creates the cgroup for the service below the cgroup of the service manager.  Requires the unified cgroup v2 hierarchy.
+bool ServiceRunner::InitCgroup()
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+
+	if (GxCgroupBaseDir == NULL && !InitCgroupBaseDir())  return false;
+
+	TempBuffer.SetStr(GxCgroupBaseDir);
+	TempBuffer.AppendChar('/');
+	TempBuffer.AppendStr(MxName);
+
+	if (mkdir(TempBuffer.MxStr, 0755) < 0 && errno != EEXIST)  return false;
+
+	MxCgroupDir = new char[TempBuffer.MxStrPos + 1];
+	memcpy(MxCgroupDir, TempBuffer.MxStr, TempBuffer.MxStrPos + 1);
+
+	// Limits go on the cgroup for the service so they cover every process, including both processes of an overlapped restart.
+	for (size_t x = 0; x < CGROUP_LIMIT_NUM; x++)
+	{
+		if (MxCgroupLimits[x] == NULL)  continue;
+
+		if (!EnableCgroupController(GxCgroupLimitDefs[x].MxController))
+		{
+			TempBuffer.SetFormattedStr("Unable to enable the '%s' cgroup controller.  %s is not limited.", GxCgroupLimitDefs[x].MxController, GxCgroupLimitDefs[x].MxFilename);
+			Log(TempBuffer.MxStr);
+
+			continue;
+		}
+
+		TempBuffer.SetStr(MxCgroupDir);
+		TempBuffer.AppendChar('/');
+		TempBuffer.AppendStr(GxCgroupLimitDefs[x].MxFilename);
+
+		if (!WriteKernelFile(TempBuffer.MxStr, MxCgroupLimits[x]))
+		{
+			TempBuffer.SetFormattedStr("Unable to set %s to '%s'.", GxCgroupLimitDefs[x].MxFilename, MxCgroupLimits[x]);
+			Log(TempBuffer.MxStr);
+		}
+	}
+
+	return true;
+}
+
+void ServiceRunner::GetCgroupFilename(StaticMixedVar<char[8192]> &Result, std::uint32_t Num, const char *Filename)
+{
+	Result.SetStr(MxCgroupDir);
+	Result.AppendChar('/');
+	Result.AppendUInt(Num);
+
+	if (Filename != NULL)
+	{
+		Result.AppendChar('/');
+		Result.AppendStr(Filename);
+	}
+}
+
+void ServiceRunner::RemoveCgroup(std::uint32_t &Num)
+{
+	if (!Num || MxCgroupDir == NULL)  return;
+
+	StaticMixedVar<char[8192]> TempBuffer;
+
+	GetCgroupFilename(TempBuffer, Num, NULL);
+	rmdir(TempBuffer.MxStr);
+
+	Num = 0;
+}
+
+// Sends a signal to a process and, depending on the kill mode, everything in its process group or cgroup.
+bool ServiceRunner::SignalProcesses(pid_t PID, std::uint32_t CgroupNum, int Signal)
+{
+	if (MxKillMode == KILL_MODE_CGROUP && CgroupNum && MxCgroupDir != NULL)
+	{
+		StaticMixedVar<char[8192]> TempBuffer;
+		bool Result = false;
+		int TempFD;
+
+		// cgroup.kill (Linux 5.14 and later) also gets processes that fork while they are being killed.
+		if (Signal == SIGKILL)
+		{
+			GetCgroupFilename(TempBuffer, CgroupNum, "cgroup.kill");
+			if (WriteKernelFile(TempBuffer.MxStr, "1"))  return true;
+		}
+
+		GetCgroupFilename(TempBuffer, CgroupNum, "cgroup.procs");
+		TempFD = open(TempBuffer.MxStr, O_RDONLY | O_CLOEXEC);
+		if (TempFD > -1)
+		{
+			char Buffer[4096];
+			ssize_t y;
+			pid_t TempPID = 0;
+
+			// Process IDs are one per line.  A number split across reads carries over in TempPID.
+			while ((y = read(TempFD, Buffer, sizeof(Buffer))) > 0)
+			{
+				for (ssize_t x = 0; x < y; x++)
+				{
+					if (Buffer[x] >= '0' && Buffer[x] <= '9')  TempPID = TempPID * 10 + (Buffer[x] - '0');
+					else
+					{
+						if (TempPID > 0 && kill(TempPID, Signal) == 0)  Result = true;
+
+						TempPID = 0;
+					}
+				}
+			}
+
+			if (TempPID > 0 && kill(TempPID, Signal) == 0)  Result = true;
+
+			close(TempFD);
+
+			if (Result)  return true;
+		}
+	}
+
+	if (MxKillMode != KILL_MODE_PROCESS && kill(-PID, Signal) == 0)  return true;
+
+	return (kill(PID, Signal) == 0);
+}
+
+// Whether anything started by a process is still running.  Only useful after the process itself has been reaped.
+bool ServiceRunner::HasProcesses(pid_t PID, std::uint32_t CgroupNum)
+{
+	if (MxKillMode == KILL_MODE_PROCESS)  return false;
+
+	if (MxKillMode == KILL_MODE_CGROUP && CgroupNum && MxCgroupDir != NULL)
+	{
+		StaticMixedVar<char[8192]> TempBuffer;
+		char Buffer[16];
+
+		GetCgroupFilename(TempBuffer, CgroupNum, "cgroup.procs");
+		int TempFD = open(TempBuffer.MxStr, O_RDONLY | O_CLOEXEC);
+		if (TempFD > -1)
+		{
+			ssize_t y = read(TempFD, Buffer, sizeof(Buffer));
+
+			close(TempFD);
+
+			return (y > 0);
+		}
+	}
+
+	return (kill(-PID, 0) == 0 || errno == EPERM);
+}
+
+void ServiceRunner::ResetRestartLimit()
+{
+	MxNumRestartTimes = 0;
+	MxRestartPos = 0;
+	MxRestartFailures = 0;
+	MxFailed = false;
+}
+
+void ServiceRunner::Process(std::uint64_t CurrTS)
+{
+	ProcessState(CurrTS);
+
+	// Overlapped restart.  Run the state machine again if the previous process exited or was swapped back in.
+	std::uint64_t TempTS = ProcessPrevProcess(CurrTS);
+	if (MxCheck)  ProcessState(CurrTS);
+
+	if (TempTS && (!MxWakeupTS || TempTS < MxWakeupTS))  MxWakeupTS = TempTS;
+
+	TempTS = CheckLogRotation(CurrTS);
+	if (TempTS && (!MxWakeupTS || TempTS < MxWakeupTS))  MxWakeupTS = TempTS;
+
+	TempTS = CheckHealth(CurrTS);
+	if (TempTS && (!MxWakeupTS || TempTS < MxWakeupTS))  MxWakeupTS = TempTS;
+
+	TraceState();
+	UpdateStateTimes(CurrTS);
+	PublishStatus();
+}
+
+void ServiceRunner::ProcessState(std::uint64_t CurrTS)
+{
+	StaticMixedVar<char[8192]> TempBuffer, TempBuffer2;
+	UTF8::File TempFile;
+	int Status;
+	struct rusage TempUsage;
+
+	MxCheck = false;
+	MxWakeupTS = 0;
+
+	do
+	{
+		TraceState();
+
+		switch (MxCurrState)
+		{
+			case 0:
+			{
+				// Start the service executable.
+				TempBuffer.SetStr("Starting process:  ");
+				for (int x = 0; MxCmdLineArgs[x] != NULL; x++)
+				{
+					if (x)  TempBuffer.AppendChar(' ');
+					TempBuffer.AppendChar('\'');
+					TempBuffer.AppendStr(MxCmdLineArgs[x]);
+					TempBuffer.AppendChar('\'');
+				}
+				Log(TempBuffer.MxStr, false);
+
+				// During an overlapped restart, the PID file is rewritten with both processes instead.
+				if (MxPIDFilename != NULL && !MxPrevPID)  UTF8::File::Delete(MxPIDFilename);
+				UTF8::File::Delete(MxNotifyStopFilename);
+				UTF8::File::Delete(MxNotifyReloadFilename);
+
+				// The child only writes to the exec pipe when exec() fails.
+				int ExecPipe[2];
+				ClosePIDFD(MxExecFD);
+				if (pipe(ExecPipe) < 0)  ExecPipe[0] = ExecPipe[1] = -1;
+				else
+				{
+					fcntl(ExecPipe[0], F_SETFD, FD_CLOEXEC);
+					fcntl(ExecPipe[1], F_SETFD, FD_CLOEXEC);
+				}
+
+				// Each process gets a new cgroup.  The child moves itself into it before exec().
+				StaticMixedVar<char[8192]> CgroupProcsFilename;
+				std::uint32_t CgroupNum = 0;
+				if (MxKillMode == KILL_MODE_CGROUP)
+				{
+					CgroupNum = ++MxLastCgroupNum;
+					GetCgroupFilename(CgroupProcsFilename, CgroupNum, NULL);
+					if (mkdir(CgroupProcsFilename.MxStr, 0755) < 0 && errno != EEXIST)
+					{
+						Log("Unable to create the cgroup for the process.  Using the process group instead.", false);
+
+						CgroupNum = 0;
+					}
+
+					GetCgroupFilename(CgroupProcsFilename, CgroupNum, "cgroup.procs");
+				}
+
+				MxForkUS = GetMonotonicMicroseconds();
+				MxExecUS = 0;
+				MxMainPID = fork();
+
+				if (MxMainPID < 0)
+				{
+					Log("An error occurred while attempting to fork() the process to start the service.");
+
+					if (ExecPipe[0] > -1)
+					{
+						close(ExecPipe[0]);
+						close(ExecPipe[1]);
+					}
+
+					if (MxPrevPID)
+					{
+						KeepPrevProcess();
+						WritePIDFile();
+					}
+					else
+					{
+						MxExitCode = 1;
+						MxCurrState = 100;
+					}
+				}
+				else if (MxMainPID == 0)
+				{
+					// Start service.
+					ResetSignalMask();
+					SetInheritedFDsCloseOnExec();
+
+					// A separate process group lets force termination reach everything the process starts.
+					if (MxKillMode != KILL_MODE_PROCESS)  setpgid(0, 0);
+
+					if (CgroupNum && !WriteKernelFile(CgroupProcsFilename.MxStr, "0"))  Log("Unable to move the process into its cgroup.");
+
+					if (MxReadySocketName != NULL)  setenv("NOTIFY_SOCKET", MxReadySocketName, 1);
+
+					if (MxNumInstances > 1)
+					{
+						char TempNum[16];
+
+						snprintf(TempNum, sizeof(TempNum), "%u", MxInstance);
+						setenv("SERVICEMANAGER_INSTANCE", TempNum, 1);
+						snprintf(TempNum, sizeof(TempNum), "%u", MxNumInstances);
+						setenv("SERVICEMANAGER_INSTANCES", TempNum, 1);
+					}
+
+					// Connect captured output before the listening sockets take over file descriptors 3 and up.
+					if (MxOutputPipes[0][1] > -1)
+					{
+						if (MxOutputStrs[0] != NULL)  dup2(MxOutputPipes[0][1], 1);
+						if (MxOutputStrs[1] != NULL && MxOutputPipes[1][1] < 0 && !strcmp(MxOutputStrs[0], MxOutputStrs[1]))  dup2(MxOutputPipes[0][1], 2);
+					}
+					if (MxOutputPipes[1][1] > -1)  dup2(MxOutputPipes[1][1], 2);
+
+					// Keep the exec pipe out of the way of the listening sockets.
+					if (ExecPipe[0] > -1)
+					{
+						close(ExecPipe[0]);
+
+						if (ExecPipe[1] < (int)(3 + MxNumListenFDs))  ExecPipe[1] = fcntl(ExecPipe[1], F_DUPFD_CLOEXEC, (int)(3 + MxNumListenFDs));
+					}
+
+					PassListenSockets();
+
+					if (MxStartDir != NULL)
+					{
+						if (chdir(MxStartDir) < 0)  Log("Unable to change directories.");
+					}
+
+					// Placement comes before dropping privileges since raising priorities requires root.
+					size_t Failed = MxPlacement.Apply();
+					for (size_t x = 0; x < PLACEMENT_NUM; x++)
+					{
+						if (Failed & ((size_t)1 << x))
+						{
+							TempBuffer.SetFormattedStr("Unable to apply %s.", GxPlacementKeys[x]);
+							Log(TempBuffer.MxStr);
+						}
+					}
+
+					// Raising hard limits and lowering oom_score_adj also require root.
+					for (size_t x = 0; x < GxNumRLimitDefs; x++)
+					{
+						if (MxRLimitsSet[x] && setrlimit(GxRLimitDefs[x].MxResource, &MxRLimits[x]) < 0)
+						{
+							TempBuffer.SetFormattedStr("Unable to set the %s resource limit.", GxRLimitDefs[x].MxName);
+							Log(TempBuffer.MxStr);
+						}
+					}
+
+					if (MxOOMScoreAdj[0] && !WriteKernelFile("/proc/self/oom_score_adj", MxOOMScoreAdj))  Log("Unable to set oom_score_adj.");
+
+					if (MxGroupID && setgid(MxGroupID) < 0)  Log("Unable to setgid().");
+					if (MxUserID && setuid(MxUserID) < 0)  Log("Unable to setuid().");
+
+					execv(MxCmdLineArgs[0], MxCmdLineArgs);
+
+					if (ExecPipe[1] > -1)
+					{
+						int TempErr = errno;
+
+						if (write(ExecPipe[1], &TempErr, sizeof(TempErr)) < 0)  {}
+					}
+
+					TempBuffer.SetStr("An error occurred while attempting to start the process.  Command = ");
+					for (int x = 0; MxCmdLineArgs[x] != NULL; x++)
+					{
+						if (x)  TempBuffer.AppendChar(' ');
+						TempBuffer.AppendChar('\'');
+						TempBuffer.AppendStr(MxCmdLineArgs[x]);
+						TempBuffer.AppendChar('\'');
+					}
+					Log(TempBuffer.MxStr);
+
+					_exit(1);
+				}
+				else
+				{
+					// Also set the process group here.  Whichever runs first wins and signals sent right away still reach the group.
+					if (MxKillMode != KILL_MODE_PROCESS)  setpgid(MxMainPID, MxMainPID);
+					MxMainCgroupNum = CgroupNum;
+
+					if (ExecPipe[0] > -1)
+					{
+						close(ExecPipe[1]);
+						fcntl(ExecPipe[0], F_SETFL, fcntl(ExecPipe[0], F_GETFL) | O_NONBLOCK);
+
+						MxExecFD = ExecPipe[0];
+						if (!MxOwner->MxEventLoop.Add(MxExecFD, this))
+						{
+							close(MxExecFD);
+							MxExecFD = -1;
+						}
+					}
+
+					// With readiness notification, the PID file is written when the process is ready.
+					MxReady = (MxReadyFD < 0);
+					MxReadyFailed = false;
+					MxReadyTS = CurrTS + MxReadyTimeout;
+
+					if (MxReady || MxPrevPID)  WritePIDFile();
+
+					// Watch for the process to exit (Linux 5.3 and later).  Falls back to SIGCHLD.
+					MxMainPIDFD = OpenProcessFD(MxMainPID);
+					if (MxMainPIDFD > -1 && !MxOwner->MxEventLoop.Add(MxMainPIDFD, this))
+					{
+						close(MxMainPIDFD);
+						MxMainPIDFD = -1;
+					}
+
+					MxStartTS = CurrTS;
+					MxStartTime = time(NULL);
+					MxStartCount++;
+					MxStateTS = 0;
+					MxCurrState = 1;
+				}
+
+				break;
+			}
+			case 1:
+			case 4:
+			case 5:
+			case 6:
+			{
+				if (wait4(MxMainPID, &Status, WNOHANG, &TempUsage) == MxMainPID)
+				{
+					MxExitCode = GetWaitStatusExitCode(Status);
+					RecordExit(Status, TempUsage);
+
+					// Process completed.
+					MxNextState = (MxCurrState == 4 ? 100 : 0);
+					MxCurrState = 3;
+				}
+				else if (MxCurrState != 4 && MxStopRequested)
+				{
+					// Service manager has been requested to stop the service.
+					if (TempFile.Open(MxNotifyStopFilename, O_CREAT | O_WRONLY))
+					{
+						TempFile.Close();
+
+						MxCurrState = 4;
+						MxStateTS = (MxWaitAmount == INFINITE ? 0 : CurrTS + MxWaitAmount);
+					}
+					else
+					{
+						// Force terminate the process since communication is not possible.
+						MxCurrState = 2;
+						MxNextState = 100;
+					}
+				}
+				else if (MxCurrState == 4 || MxCurrState == 5 || UTF8::File::Exists(MxNotifyStopFilename))
+				{
+					// Note that both processes see the stop notification file during an overlapped restart.
+					// Stop.
+					if (MxCurrState != 4 && MxCurrState != 5)
+					{
+						MxCurrState = 5;
+						MxStateTS = (MxWaitAmount == INFINITE ? 0 : CurrTS + MxWaitAmount);
+					}
+					else if (MxStateTS && CurrTS >= MxStateTS)
+					{
+						// Force the process to terminate since the timeout has expired.
+						MxNextState = (MxCurrState == 4 ? 100 : 0);
+						MxCurrState = 2;
+					}
+				}
+				else if (MxHealthRestart)
+				{
+					// Failed too many health checks in a row.  A stuck process won't notice the stop notification file.
+					MxHealthRestart = false;
+
+					MxCurrState = 2;
+					MxNextState = 0;
+				}
+				else if (MxOverlapRequested && !MxPrevPID)
+				{
+					StartOverlappedRestart();
+				}
+				else if (UTF8::File::Exists(MxNotifyReloadFilename))
+				{
+					// Reload.
+					if (MxCurrState != 6)
+					{
+						MxCurrState = 6;
+						MxStateTS = (MxWaitAmount == INFINITE ? 0 : CurrTS + MxWaitAmount);
+
+						MxReloadCount++;
+						MxReloadStartTS = CurrTS;
+						MxReloadStartUS = GetMonotonicMicroseconds();
+
+						PropagateReload();
+					}
+					else if (MxStateTS && CurrTS >= MxStateTS)
+					{
+						// Stop the process since it didn't respond in time to reload.
+						MxReloadTimeoutCount++;
+						if (MxOverlapAmount && !MxPrevPID)  StartOverlappedRestart();
+						else if (TempFile.Open(MxNotifyStopFilename, O_CREAT | O_WRONLY))
+						{
+							TempFile.Close();
+
+							MxCurrState = 5;
+							MxStateTS = (MxWaitAmount == INFINITE ? 0 : CurrTS + MxWaitAmount);
+						}
+						else
+						{
+							// Force terminate the process since communication is not possible.
+							MxCurrState = 2;
+							MxNextState = 0;
+						}
+					}
+				}
+				else
+				{
+					// The process deleted the reload notification file.
+					if (MxCurrState == 6)
+					{
+						MxReloadAckLast = CurrTS - MxReloadStartTS;
+						MxReloadAckSum += MxReloadAckLast;
+						MxReloadAckCount++;
+
+						AddLatency(LATENCY_RELOAD, MxReloadStartUS, GetMonotonicMicroseconds());
+					}
+
+					MxCurrState = 1;
+					MxStateTS = 0;
+				}
+
+				if (MxCurrState == 1 || MxCurrState == 4 || MxCurrState == 5 || MxCurrState == 6)
+				{
+					// Wait for something to happen.  Without file change notifications, the notification files have to be checked periodically.
+					MxWakeupTS = MxStateTS;
+					if (MxNotifyWatch < 0 && (!MxWakeupTS || MxWakeupTS > CurrTS + 2000))  MxWakeupTS = CurrTS + 2000;
+
+					if (!MxReady && !MxReadyFailed)
+					{
+						if (CurrTS >= MxReadyTS)
+						{
+							Log("Process did not signal readiness in time.");
+
+							MxReadyFailed = true;
+						}
+						else if (!MxWakeupTS || MxWakeupTS > MxReadyTS)
+						{
+							MxWakeupTS = MxReadyTS;
+						}
+					}
+
+					return;
+				}
+
+				break;
+			}
+			case 2:
+			{
+				// Try a standard termination signal.
+				MxForceTermCount++;
+				MxKillSent = false;
+				if (!SignalProcesses(MxMainPID, MxMainCgroupNum, SIGTERM))
+				{
+					// Force terminate the process.
+					if (!SignalProcesses(MxMainPID, MxMainCgroupNum, SIGKILL))
+					{
+						Log("Process force termination initiation failed.");
+
+						MxCurrState = 100;
+
+						break;
+					}
+
+					MxKillSent = true;
+					MxKillCount++;
+				}
+
+				MxStateTS = CurrTS + MxKillWaitAmount;
+				MxCurrState = 7;
+
+				break;
+			}
+			case 7:
+			{
+				// Wait for the process to terminate.
+				if (wait4(MxMainPID, &Status, WNOHANG, &TempUsage) == MxMainPID)
+				{
+					MxExitCode = GetWaitStatusExitCode(Status);
+					RecordExit(Status, TempUsage);
+				}
+				else if (CurrTS < MxStateTS)
+				{
+					MxWakeupTS = MxStateTS;
+
+					return;
+				}
+				else if (!MxKillSent)
+				{
+					// Force terminate the process.
+					if (!SignalProcesses(MxMainPID, MxMainCgroupNum, SIGKILL))
+					{
+						Log("Process force termination initiation failed.");
+
+						MxCurrState = 100;
+
+						break;
+					}
+
+					MxKillSent = true;
+					MxKillCount++;
+					MxStateTS = CurrTS + MxKillWaitAmount;
+
+					break;
+				}
+				else
+				{
+					// Unable to reap the process.  Carry on anyway.
+					MxExitCode = 1;
+				}
+
+				Log("Process force terminated.");
+
+				if (MxStopRequested)  MxNextState = 100;
+				MxCurrState = 3;
+
+				break;
+			}
+			case 3:
+			{
+				// Process completed.  Write out its remaining output first.
+				for (size_t x = 0; x < 2; x++)
+				{
+					if (MxOutputPipes[x][0] > -1)  ProcessOutput(x);
+				}
+
+				if (MxExitRecorded)  LogProcessExit("Process", MxLastStatus, MxLastUsage);
+				else
+				{
+					TempBuffer.SetStr("Process terminated with exit code ");
+					Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)MxExitCode);
+					TempBuffer.AppendStr(TempBuffer2.MxStr);
+					TempBuffer.AppendChar('.');
+
+					Log(TempBuffer.MxStr);
+				}
+
+				if (MxStopUS)
+				{
+					TempBuffer.SetFormattedStr("Process stopped %.3f seconds after it was told to stop.", (double)MxStopUS / 1000000.0);
+					Log(TempBuffer.MxStr, false);
+				}
+
+				MxExitRecorded = false;
+				MxStopStartUS = 0;
+				MxStopUS = 0;
+
+				// Catch an exec() that hasn't been noticed yet.
+				if (MxExecFD > -1)  ProcessExecEvent();
+
+				ClosePIDFD(MxMainPIDFD);
+
+				MxReady = false;
+
+				if (MxPrevPID && !MxPrevTermSent && !MxStopRequested)
+				{
+					// The new process of an overlapped restart exited early.
+					if (MxKillMode != KILL_MODE_PROCESS && HasProcesses(MxMainPID, MxMainCgroupNum))  SignalProcesses(MxMainPID, MxMainCgroupNum, SIGKILL);
+					RemoveCgroup(MxMainCgroupNum);
+
+					KeepPrevProcess();
+					WritePIDFile();
+
+					break;
+				}
+
+				// Handle the rare instance where the service was told to stop immediately after the executable happened to terminate.
+				if (MxStopRequested)  MxNextState = 100;
+
+				// Processes left behind keep ports and memory.  They have to go before the next process starts.
+				if (MxKillMode != KILL_MODE_PROCESS && HasProcesses(MxMainPID, MxMainCgroupNum))
+				{
+					Log("Stopping processes left behind by the process.");
+
+					MxKillSent = false;
+					if (!SignalProcesses(MxMainPID, MxMainCgroupNum, SIGTERM))
+					{
+						SignalProcesses(MxMainPID, MxMainCgroupNum, SIGKILL);
+						MxKillSent = true;
+					}
+
+					MxStateTS = CurrTS + MxKillWaitAmount;
+					MxCurrState = 9;
+
+					break;
+				}
+
+				ContinueAfterExit(CurrTS);
+
+				break;
+			}
+			case 9:
+			{
+				// Wait for the processes left behind to exit.  There is no event for that, so check every 100 milliseconds.
+				if (!HasProcesses(MxMainPID, MxMainCgroupNum))  ContinueAfterExit(CurrTS);
+				else if (CurrTS < MxStateTS)
+				{
+					MxWakeupTS = (MxStateTS < CurrTS + 100 ? MxStateTS : CurrTS + 100);
+
+					return;
+				}
+				else if (!MxKillSent)
+				{
+					SignalProcesses(MxMainPID, MxMainCgroupNum, SIGKILL);
+
+					MxKillSent = true;
+					MxKillCount++;
+					MxStateTS = CurrTS + MxKillWaitAmount;
+				}
+				else
+				{
+					Log("Unable to stop every process left behind.  Carrying on anyway.");
+
+					ContinueAfterExit(CurrTS);
+				}
+
+				break;
+			}
+			case 8:
+			{
+				// Restart delay.
+				if (MxStopRequested)  MxCurrState = 100;
+				else if (CurrTS >= MxStateTS)  MxCurrState = 0;
+				else
+				{
+					MxWakeupTS = MxStateTS;
+
+					return;
+				}
+
+				break;
+			}
+			case 101:
+			{
+				// Stopped.  Wait for a start request.
+				return;
+			}
+			default:
+			{
+				// Wait for the previous process of an overlapped restart to exit.
+				if (MxPrevPID)  return;
+
+				if (MxPIDFilename != NULL)  UTF8::File::Delete(MxPIDFilename);
+				UTF8::File::Delete(MxNotifyStopFilename);
+				UTF8::File::Delete(MxNotifyReloadFilename);
+
+				if (MxStopRequestTS)
+				{
+					MxStopLast = CurrTS - MxStopRequestTS;
+					MxStopCount++;
+					MxStopRequestTS = 0;
+				}
+
+				if (MxRestartRequested)
+				{
+					MxStopRequested = false;
+					MxRestartRequested = false;
+					MxCurrState = 0;
+
+					break;
+				}
+
+				for (size_t x = 0; x < LATENCY_NUM; x++)
+				{
+					if (!MxLatencySummary[x].MxCount)  continue;
+
+					TempBuffer.SetStr(GxLatencyNames[x]);
+					TempBuffer.AppendStr(" latency:  ");
+					AppendLatencySummaryStr(TempBuffer, MxLatencySummary[x]);
+					TempBuffer.AppendChar('.');
+
+					Log(TempBuffer.MxStr, false);
+				}
+
+				Log(MxOwner->MxSupervise ? "Service stopped." : "Service manager stopped.");
+
+				MxCurrState = 101;
+
+				return;
+			}
+		}
+	} while (1);
+}
+
+
+ControlConnection::ControlConnection(Supervisor *Owner, ServiceRunner *Service, int FD) : MxService(Service), MxOwner(Owner), MxFD(FD), MxRequestSize(0), MxStartCounts(NULL), MxReloadPropagations(0), MxWaitReloadPropagation(false), MxNextInstance(0), MxPending(false), MxClosed(false)
+{
+	if (!MxOwner->MxEventLoop.Add(MxFD, this))  MxClosed = true;
+}
+
+ControlConnection::~ControlConnection()
+{
+	MxOwner->MxEventLoop.Remove(MxFD);
+	close(MxFD);
+
+	delete[] MxStartCounts;
+}
+
+void ControlConnection::HandleEvent(int)
+{
+	ssize_t y = recv(MxFD, (char *)&MxRequest + MxRequestSize, sizeof(MxRequest) - MxRequestSize, 0);
+
+	// Disconnected or sent a request while another one is outstanding.
+	if (y == 0 || (y < 0 && errno != EAGAIN && errno != EINTR) || MxPending)
+	{
+		MxClosed = true;
+
+		return;
+	}
+
+	if (y < 0)  return;
+
+	MxRequestSize += (size_t)y;
+	if (MxRequestSize < sizeof(MxRequest))  return;
+
+	MxRequestSize = 0;
+
+	if (MxRequest.MxVersion != CONTROL_PROTOCOL_VERSION)
+	{
+		SendResponse(CONTROL_RESULT_BAD_REQUEST);
+
+		return;
+	}
+
+	size_t Num = MxService->GetNumInstances();
+
+	delete[] MxStartCounts;
+	MxStartCounts = new std::uint32_t[Num];
+	for (size_t x = 0; x < Num; x++)  MxStartCounts[x] = MxService->GetInstance(x)->MxStartCount;
+
+	// The client created the reload notification file of the leader.  The other copies get theirs once the leader notices it.
+	MxReloadPropagations = MxService->MxReloadPropagations;
+	MxWaitReloadPropagation = (Num > 1 && !MxService->IsStopped() && UTF8::File::Exists(MxService->MxNotifyReloadFilename));
+
+	MxNextInstance = 0;
+
+	MxPending = true;
+
+	for (size_t x = 0; x < Num; x++)
+	{
+		ServiceRunner *Service = MxService->GetInstance(x);
+
+		switch (MxRequest.MxCommand)
+		{
+			case CONTROL_CMD_STATUS:  break;
+			case CONTROL_CMD_STOP:  Service->RequestStop();  break;
+			case CONTROL_CMD_START:  Service->RequestStart();  break;
+			case CONTROL_CMD_RESTART:  Service->RequestStop(true);  break;
+			case CONTROL_CMD_RELOAD:  Service->MxCheck = true;  break;
+			case CONTROL_CMD_WAITREADY:  break;
+			case CONTROL_CMD_ROLLINGRESTART:  break;
+			default:
+			{
+				MxPending = false;
+
+				break;
+			}
+		}
+	}
+
+	if (!MxPending)  SendResponse(CONTROL_RESULT_BAD_REQUEST);
+	else if (MxRequest.MxCommand == CONTROL_CMD_ROLLINGRESTART)
+	{
+		if (!MxRequest.MxMaxUnavailable)  MxRequest.MxMaxUnavailable = 1;
+
+		StaticMixedVar<char[8192]> TempBuffer;
+		TempBuffer.SetFormattedStr("Rolling restart of %u copies, %u at a time.", (unsigned int)Num, (unsigned int)MxRequest.MxMaxUnavailable);
+		MxService->Log(TempBuffer.MxStr, false);
+	}
+}
+
+void ControlConnection::SendResponse(std::uint8_t Result)
+{
+	ControlResponse TempResponse;
+
+	memset(&TempResponse, 0, sizeof(TempResponse));
+	TempResponse.MxVersion = CONTROL_PROTOCOL_VERSION;
+	TempResponse.MxCommand = MxRequest.MxCommand;
+	TempResponse.MxResult = Result;
+	MxService->GetStatus(TempResponse);
+
+	// Responses are tiny.  If the client isn't reading, drop it.
+	if (send(MxFD, (const char *)&TempResponse, sizeof(TempResponse), MSG_NOSIGNAL) != (ssize_t)sizeof(TempResponse))  MxClosed = true;
+}
+
+// Returns the result for one copy of the executable or -1 while the request is still in progress.
+int ControlConnection::CheckInstance(size_t Num)
+{
+	ServiceRunner *Service = MxService->GetInstance(Num);
+	ControlResponse TempResponse;
+	UTF8::File::FileStat TempStat;
+
+	Service->GetStatus(TempResponse);
+
+	switch (MxRequest.MxCommand)
+	{
+		case CONTROL_CMD_STOP:
+		{
+			if (TempResponse.MxState == CONTROL_STATE_STOPPED)  return CONTROL_RESULT_OK;
+
+			break;
+		}
+		case CONTROL_CMD_ROLLINGRESTART:
+		{
+			// Fails as soon as the new process exits before it is ready instead of waiting for it to be restarted on its own.
+			if (Service->MxStartCount != MxStartCounts[Num] && !Service->MxReady && (Service->MxStartCount - MxStartCounts[Num] > 1 || (TempResponse.MxFlags & (CONTROL_FLAG_BACKOFF | CONTROL_FLAG_FAILED)) || TempResponse.MxState == CONTROL_STATE_STOPPED))  return CONTROL_RESULT_FAILED;
+
+			// Intentionally fall through to restart handling.
+			FALL_THROUGH;
+		}
+		case CONTROL_CMD_START:
+		case CONTROL_CMD_RESTART:
+		{
+			// Completes when the executable has been started again and is ready.
+			if (Service->MxStartCount != MxStartCounts[Num] || (MxRequest.MxCommand == CONTROL_CMD_START && TempResponse.MxState == CONTROL_STATE_RUNNING))
+			{
+				if (Service->MxReady || Service->MxReadyFailed)  return (!Service->MxReadyFailed ? CONTROL_RESULT_OK : CONTROL_RESULT_FAILED);
+			}
+			else if (TempResponse.MxState == CONTROL_STATE_STOPPED)
+			{
+				return CONTROL_RESULT_FAILED;
+			}
+
+			break;
+		}
+		case CONTROL_CMD_WAITREADY:
+		{
+			// Waits across restarts.  Only gives up when the process doesn't become ready in time.
+			if (TempResponse.MxState != CONTROL_STATE_STOPPED && (Service->MxReady || Service->MxReadyFailed))  return (!Service->MxReadyFailed ? CONTROL_RESULT_OK : CONTROL_RESULT_FAILED);
+
+			break;
+		}
+		case CONTROL_CMD_RELOAD:
+		{
+			// The process deletes or writes to the reload notification file when it is done.  Restarting the process also counts.
+			if (TempResponse.MxState == CONTROL_STATE_STOPPED)  return CONTROL_RESULT_FAILED;
+
+			if (Num && MxWaitReloadPropagation && MxService->MxReloadPropagations == MxReloadPropagations)  break;
+
+			if (Service->MxStartCount != MxStartCounts[Num] || !UTF8::File::Stat(TempStat, Service->MxNotifyReloadFilename) || TempStat.st_size)  return CONTROL_RESULT_OK;
+
+			break;
+		}
+		default:
+		{
+			return CONTROL_RESULT_OK;
+		}
+	}
+
+	return -1;
+}
+
+// Restarts the copies of the executable in order, keeping at most MxMaxUnavailable of them out of service at a time.
+// Returns the result once every copy has been restarted and is ready, as soon as one fails, or -1 while still in progress.
+int ControlConnection::CheckRollingRestart()
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+	ControlResponse TempResponse;
+	size_t Num = MxService->GetNumInstances(), NumUnavailable = 0;
+
+	for (size_t x = 0; x < Num; x++)
+	{
+		ServiceRunner *Service = MxService->GetInstance(x);
+
+		if (x < MxNextInstance)
+		{
+			int Result = CheckInstance(x);
+
+			if (Result == CONTROL_RESULT_FAILED)
+			{
+				TempBuffer.SetFormattedStr("Rolling restart stopped.  '%s' failed to start or become ready.", Service->MxName);
+				MxService->Log(TempBuffer.MxStr, false);
+
+				return CONTROL_RESULT_FAILED;
+			}
+
+			if (Result < 0)  NumUnavailable++;
+		}
+		else
+		{
+			// Copies that are still starting up (e.g. restarting on their own) count too.  Stopped copies are started when their turn comes.
+			Service->GetStatus(TempResponse);
+
+			if (TempResponse.MxState != CONTROL_STATE_STOPPED && !(TempResponse.MxFlags & CONTROL_FLAG_READY))  NumUnavailable++;
+		}
+	}
+
+	while (MxNextInstance < Num && NumUnavailable < MxRequest.MxMaxUnavailable)
+	{
+		ServiceRunner *Service = MxService->GetInstance(MxNextInstance);
+
+		MxStartCounts[MxNextInstance] = Service->MxStartCount;
+		Service->RequestStop(true);
+
+		MxNextInstance++;
+		NumUnavailable++;
+	}
+
+	if (MxNextInstance < Num || NumUnavailable)  return -1;
+
+	MxService->Log("Rolling restart completed.", false);
+
+	return CONTROL_RESULT_OK;
+}
+
+bool ControlConnection::Check()
+{
+	if (MxPending)
+	{
+		// Requests to a service with several copies of the executable complete when every copy is done.
+		int Result = CONTROL_RESULT_OK;
+		size_t Num = MxService->GetNumInstances();
+
+		if (MxRequest.MxCommand == CONTROL_CMD_ROLLINGRESTART)  Result = CheckRollingRestart();
+		else
+		{
+			for (size_t x = 0; x < Num && Result > -1; x++)
+			{
+				int Result2 = CheckInstance(x);
+
+				if (Result2 < 0 || Result2 == CONTROL_RESULT_FAILED)  Result = Result2;
+			}
+		}
+
+		if (Result > -1)
+		{
+			MxPending = false;
+
+			SendResponse((std::uint8_t)Result);
+		}
+	}
+
+	return !MxClosed;
+}
+
+
+Supervisor::Supervisor() : MxSupervise(false), MxServices(NULL), MxNumServices(0), MxMaxServices(0), MxConnections(NULL), MxNumConnections(0), MxMaxConnections(0), MxNotifyFD(-1), MxStopRequested(false), MxSystemdReady(false)
+{
+}
+
+Supervisor::~Supervisor()
+{
+	for (size_t x = 0; x < MxNumConnections; x++)  delete MxConnections[x];
+	delete[] MxConnections;
+
+	for (size_t x = 0; x < MxNumServices; x++)  delete MxServices[x];
+	delete[] MxServices;
+
+	if (MxNotifyFD > -1)  close(MxNotifyFD);
+}
+
+bool Supervisor::Init(bool Supervise)
+{
+	MxSupervise = Supervise;
+
+	if (!MxEventLoop.Init())  return false;
+
+	if (!MxEventLoop.Add((GxSignalFD > -1 ? GxSignalFD : GxWakeupPipe[0]), this))  return false;
+
+#ifdef __linux__
+	MxNotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (MxNotifyFD > -1 && !MxEventLoop.Add(MxNotifyFD, this))
+	{
+		close(MxNotifyFD);
+		MxNotifyFD = -1;
+	}
+#endif
+
+	return true;
+}
+
+void Supervisor::AddService(ServiceRunner *Service)
+{
+	if (MxNumServices == MxMaxServices)
+	{
+		MxMaxServices = (MxMaxServices ? MxMaxServices * 2 : 16);
+
+		ServiceRunner **Services = new ServiceRunner *[MxMaxServices];
+		for (size_t x = 0; x < MxNumServices; x++)  Services[x] = MxServices[x];
+
+		delete[] MxServices;
+		MxServices = Services;
+	}
+
+	MxServices[MxNumServices++] = Service;
+}
+
+ServiceRunner *Supervisor::FindService(const char *Name)
+{
+	for (size_t x = 0; x < MxNumServices; x++)
+	{
+		if (!strcmp(MxServices[x]->MxName, Name))  return MxServices[x];
+	}
+
+	return NULL;
+}
+
+void Supervisor::AddConnection(ControlConnection *Connection)
+{
+	if (MxNumConnections == MxMaxConnections)
+	{
+		MxMaxConnections = (MxMaxConnections ? MxMaxConnections * 2 : 16);
+
+		ControlConnection **Connections = new ControlConnection *[MxMaxConnections];
+		for (size_t x = 0; x < MxNumConnections; x++)  Connections[x] = MxConnections[x];
+
+		delete[] MxConnections;
+		MxConnections = Connections;
+	}
+
+	MxConnections[MxNumConnections++] = Connection;
+}
+
+void Supervisor::CheckConnections()
+{
+	size_t x, x2 = 0;
+
+	for (x = 0; x < MxNumConnections; x++)
+	{
+		if (MxConnections[x]->Check())  MxConnections[x2++] = MxConnections[x];
+		else  delete MxConnections[x];
+	}
+
+	MxNumConnections = x2;
+}
+
+int Supervisor::AddNotifyWatch(const char *Filename)
+{
+#ifdef __linux__
+	if (MxNotifyFD < 0)  return -1;
+
+	StaticMixedVar<char[8192]> TempBuffer;
+	size_t x;
+
+	for (x = strlen(Filename); x && Filename[x - 1] != '/'; x--);
+
+	if (!x)  TempBuffer.SetStr(".");
+	else  TempBuffer.SetData(Filename, x);
+
+	// Watching the same directory again returns the same watch descriptor.
+	// IN_CLOSE_WRITE catches processes that acknowledge a reload by writing to the reload notification file.
+	return inotify_add_watch(MxNotifyFD, TempBuffer.MxStr, IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+#else
+	(void)Filename;
+
+	return -1;
+#endif
+}
+
+void Supervisor::HandleEvent(int FD)
+{
+	char TempBuffer[256];
+
+	if (FD == MxNotifyFD)
+	{
+		ProcessNotifyWatchEvents();
+
+		return;
+	}
+
+	if (FD == GxSignalFD)  ProcessSignalFDEvents();
+	else  while (read(GxWakeupPipe[0], TempBuffer, sizeof(TempBuffer)) > 0);
+
+	if (GxReopenLogs)
+	{
+		GxReopenLogs = 0;
+
+		for (size_t x = 0; x < MxNumServices; x++)  MxServices[x]->ReopenLogs();
+	}
+
+	// Stop everything.
+	if (!MxStopRequested && GxStopEvent.Wait(0))
+	{
+		MxStopRequested = true;
+
+		SendSystemdNotify("STOPPING=1");
+
+		for (size_t x = 0; x < MxNumServices; x++)  MxServices[x]->RequestStop();
+	}
+
+	// Without process file descriptors, SIGCHLD is the only indicator that a process exited.
+	for (size_t x = 0; x < MxNumServices; x++)
+	{
+		if (MxServices[x]->MxMainPIDFD < 0 || (MxServices[x]->MxPrevPID && MxServices[x]->MxPrevPIDFD < 0) || MxServices[x]->MxLogCompressPID || MxServices[x]->MxHealthPID)  MxServices[x]->MxCheck = true;
+	}
+}
+
+void Supervisor::ProcessNotifyWatchEvents()
+{
+#ifdef __linux__
+	char TempBuffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t y;
+	size_t x;
+
+	while ((y = read(MxNotifyFD, TempBuffer, sizeof(TempBuffer))) > 0)
+	{
+		for (char *CurrPos = TempBuffer; CurrPos < TempBuffer + y; CurrPos += sizeof(struct inotify_event) + ((struct inotify_event *)CurrPos)->len)
+		{
+			struct inotify_event *TempEvent = (struct inotify_event *)CurrPos;
+
+			for (x = 0; x < MxNumServices; x++)
+			{
+				ServiceRunner *Service = MxServices[x];
+
+				// Lost events.  Check everything.
+				if (TempEvent->mask & IN_Q_OVERFLOW)  Service->MxCheck = true;
+				else if (Service->MxNotifyWatch != TempEvent->wd)  continue;
+
+				// The directory went away.  Fall back to polling.
+				if (TempEvent->mask & IN_IGNORED)
+				{
+					Service->MxNotifyWatch = -1;
+					Service->MxCheck = true;
+				}
+				else if (TempEvent->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+				{
+					Service->MxCheck = true;
+				}
+				else if (TempEvent->len && (!strcmp(TempEvent->name, Service->MxNotifyStopName) || !strcmp(TempEvent->name, Service->MxNotifyReloadName)))
+				{
+					Service->MxCheck = true;
+				}
+			}
+		}
+	}
+#endif
+}
+
+void Supervisor::AppendMetricsData(char *&Data, size_t &DataSize, size_t &DataMax, StaticMixedVar<char[8192]> &TempBuffer)
+{
+	if (DataSize + TempBuffer.MxStrPos > DataMax)
+	{
+		size_t y;
+		for (y = DataMax * 2; y < DataSize + TempBuffer.MxStrPos; y *= 2);
+
+		char *Data2 = new char[y];
+		memcpy(Data2, Data, DataSize);
+		delete[] Data;
+		Data = Data2;
+		DataMax = y;
+	}
+
+	memcpy(Data + DataSize, TempBuffer.MxStr, TempBuffer.MxStrPos);
+	DataSize += TempBuffer.MxStrPos;
+
+	TempBuffer.SetStr("");
+}
+
+// Renders the metrics of every service that is due along with the other services that share its metrics file.
+// Only the rendering happens here.  The file is written by GxMetricsWriter.  Returns the next time metrics are due.
+std::uint64_t Supervisor::CheckMetrics(std::uint64_t CurrTS)
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+	std::uint64_t WakeupTS = 0;
+	size_t x, x2, Num, DataSize, DataMax;
+	char *Data;
+
+	for (x = 0; x < MxNumServices; x++)
+	{
+		ServiceRunner *Service = MxServices[x];
+
+		if (Service->MxMetricsFilename == NULL)  continue;
+
+		if (CurrTS >= Service->MxMetricsTS)
+		{
+			DataSize = 0;
+			DataMax = 16384;
+			Data = new char[DataMax];
+
+			for (Num = 0; Num < sizeof(GxMetricDefs) / sizeof(GxMetricDefs[0]); Num++)
+			{
+				TempBuffer.SetFormattedStr("# HELP %s %s\n# TYPE %s %s\n", GxMetricDefs[Num].MxName, GxMetricDefs[Num].MxHelp, GxMetricDefs[Num].MxName, GxMetricDefs[Num].MxType);
+
+				for (x2 = x; x2 < MxNumServices; x2++)
+				{
+					ServiceRunner *Service2 = MxServices[x2];
+
+					if (Service2->MxMetricsFilename != NULL && !strcmp(Service->MxMetricsFilename, Service2->MxMetricsFilename))
+					{
+						Service2->AppendMetric(Num, TempBuffer, CurrTS);
+
+						// Move the samples out before the buffer could fill up.
+						if (TempBuffer.MxStrPos > sizeof(TempBuffer.MxStr) / 2)  AppendMetricsData(Data, DataSize, DataMax, TempBuffer);
+					}
+				}
+
+				AppendMetricsData(Data, DataSize, DataMax, TempBuffer);
+			}
+
+			for (x2 = x; x2 < MxNumServices; x2++)
+			{
+				ServiceRunner *Service2 = MxServices[x2];
+
+				if (Service2->MxMetricsFilename != NULL && !strcmp(Service->MxMetricsFilename, Service2->MxMetricsFilename))  Service2->MxMetricsTS = CurrTS + (std::uint64_t)(Service2->MxMetricsInterval ? Service2->MxMetricsInterval : 1) * 1000;
+			}
+
+			GxMetricsWriter.Write(Service->MxMetricsFilename, Data, DataSize);
+		}
+
+		if (!WakeupTS || Service->MxMetricsTS < WakeupTS)  WakeupTS = Service->MxMetricsTS;
+	}
+
+	return WakeupTS;
+}
+
+// Starts copies 1 and up of a service that runs several copies of the executable.
+void ActivateServiceInstances(Supervisor &MainSupervisor, ServiceRunner *Service, int argc, char **argv)
+{
+	for (std::uint32_t x = 1; x < Service->MxNumInstances; x++)
+	{
+		ServiceRunner *Instance = new ServiceRunner(&MainSupervisor);
+
+		if (GxDebug ? !Instance->InitFromArgs(argc, argv) : !Instance->InitFromServiceInfo(Service->MxName))
+		{
+			delete Instance;
+
+			return;
+		}
+
+		Instance->SetInstance(Service, x);
+
+		if (!Instance->Activate())
+		{
+			printf("Skipping '%s'.\n", Instance->MxName);
+
+			delete Instance;
+
+			continue;
+		}
+
+		MainSupervisor.AddService(Instance);
+		Service->AddInstance(Instance);
+	}
+}
+
+int Supervisor::Run()
+{
+	std::uint64_t CurrTS, WakeupTS;
+	size_t x, NumActive;
+	Timer *TempTimer;
+
+	do
+	{
+		CurrTS = GetMonotonicMilliseconds();
+		NumActive = 0;
+
+		// Deadlines that have passed.
+		while ((TempTimer = MxTimers.PopExpired(CurrTS)) != NULL)  ((ServiceRunner *)TempTimer->MxData)->MxCheck = true;
+
+		for (x = 0; x < MxNumServices; x++)
+		{
+			ServiceRunner *Service = MxServices[x];
+
+			if (Service->MxCheck)
+			{
+				Service->Process(CurrTS);
+
+				MxTimers.Set(&Service->MxWakeupTimer, Service->MxWakeupTS);
+			}
+
+			if (!Service->IsStopped())  NumActive++;
+		}
+
+		WakeupTS = MxTimers.GetNextTS();
+
+		// In 'run' mode, the service manager exits when the service stops.  In 'supervise' mode, only when asked to stop.
+		if (!NumActive && (!MxSupervise || MxStopRequested))  break;
+
+		// Tell systemd (Type=notify) that startup is complete once every service is ready or has given up.
+		if (!MxSystemdReady)
+		{
+			for (x = 0; x < MxNumServices && (MxServices[x]->IsStopped() || MxServices[x]->MxReady || MxServices[x]->MxReadyFailed); x++);
+
+			if (x == MxNumServices)
+			{
+				SendSystemdNotify("READY=1");
+
+				MxSystemdReady = true;
+			}
+		}
+
+		CheckConnections();
+
+		// Rolling restarts ask services to restart from CheckConnections().  Don't wait to process them.
+		for (x = 0; x < MxNumServices && !MxServices[x]->MxCheck; x++);
+		if (x < MxNumServices)  WakeupTS = CurrTS;
+
+		std::uint64_t TempTS = CheckMetrics(CurrTS);
+		if (TempTS && (!WakeupTS || TempTS < WakeupTS))  WakeupTS = TempTS;
+
+		MxEventLoop.Wait(!WakeupTS ? INFINITE : (WakeupTS > CurrTS ? (std::uint32_t)(WakeupTS - CurrTS) : 0));
+	} while (1);
+
+	// Release the control sockets before answering outstanding stop requests so a following 'start' doesn't talk to this process.
+	for (x = 0; x < MxNumServices; x++)  MxServices[x]->CloseControlSocket();
+
+	CheckConnections();
+
+	// Final metrics.
+	for (x = 0; x < MxNumServices; x++)  MxServices[x]->MxMetricsTS = 0;
+	CheckMetrics(GetMonotonicMilliseconds());
+
+	return (MxSupervise || !MxNumServices ? 0 : MxServices[0]->MxExitCode);
+}
+
+// Connects to the control socket of a running service manager.  Returns -1 if the service manager isn't running.
+int ConnectControlSocket(const char *ServiceName)
+{
+	struct sockaddr_un TempAddr;
+	socklen_t TempAddrLen;
+
+	if (!GetControlSocketAddr(ServiceName, TempAddr, TempAddrLen))  return -1;
+
+	int TempFD = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (TempFD < 0)  return -1;
+
+	fcntl(TempFD, F_SETFD, FD_CLOEXEC);
+
+#ifdef SO_NOSIGPIPE
+	int TempOpt = 1;
+	setsockopt(TempFD, SOL_SOCKET, SO_NOSIGPIPE, &TempOpt, sizeof(TempOpt));
+#endif
+
+	if (connect(TempFD, (struct sockaddr *)&TempAddr, TempAddrLen) < 0)
+	{
+		close(TempFD);
+
+		return -1;
+	}
+
+	return TempFD;
+}
+
+// Sends a request to a service manager and waits for the response.  Prints a dot every second while waiting when ShowProgress is true.
+bool SendControlRequest(int FD, std::uint8_t Command, ControlResponse &Response, bool ShowProgress = false, std::uint16_t MaxUnavailable = 0)
+{
+	ControlRequest TempRequest;
+	struct pollfd TempPollFD;
+	size_t y = 0;
+	ssize_t Result;
+
+	memset(&TempRequest, 0, sizeof(TempRequest));
+	TempRequest.MxVersion = CONTROL_PROTOCOL_VERSION;
+	TempRequest.MxCommand = Command;
+	TempRequest.MxMaxUnavailable = MaxUnavailable;
+
+	if (send(FD, (const char *)&TempRequest, sizeof(TempRequest), MSG_NOSIGNAL) != (ssize_t)sizeof(TempRequest))  return false;
+
+	TempPollFD.fd = FD;
+	TempPollFD.events = POLLIN;
+
+	while (y < sizeof(Response))
+	{
+		TempPollFD.revents = 0;
+		Result = poll(&TempPollFD, 1, 1000);
+		if (Result < 0 && errno != EINTR)  return false;
+
+		if (Result == 0)
+		{
+			if (ShowProgress)
+			{
+				printf(".");
+				fflush(stdout);
+			}
+
+			continue;
+		}
+
+		Result = recv(FD, (char *)&Response + y, sizeof(Response) - y, 0);
+		if (Result == 0 || (Result < 0 && errno != EINTR))  return false;
+
+		if (Result > 0)  y += (size_t)Result;
+	}
+
+	return (Response.MxVersion == CONTROL_PROTOCOL_VERSION);
+}
+
+const char *GetControlStateStr(std::uint8_t State)
+{
+	const char *StateStrs[4] = { "stopped", "running", "stopping", "reloading" };
+
+	return (State < 4 ? StateStrs[State] : "unknown");
+}
+
+void DumpServiceStatus(const ControlResponse &TempResponse)
+{
+	StaticMixedVar<char[8192]> TempBuffer;
+	time_t TempTime = (time_t)TempResponse.MxStartTime;
+
+	printf("Service manager is running.\n");
+	printf("Service is %s.\n", GetControlStateStr(TempResponse.MxState));
+	if (TempResponse.MxFlags & CONTROL_FLAG_FAILED)  printf("Service failed after restarting too often.  Use start to try again.\n");
+	if (TempResponse.MxFlags & CONTROL_FLAG_BACKOFF)  printf("Service is waiting to restart the process.\n");
+
+	if (TempResponse.MxStartCount)
+	{
+		strftime(TempBuffer.MxStr, sizeof(TempBuffer.MxStr) - 1, "%c", localtime(&TempTime));
+
+		printf("Service was started %s.\n", TempBuffer.MxStr);
+		printf("Service starts:  %u\n", TempResponse.MxStartCount);
+	}
+
+	printf("Service manager PID:  %u\n", TempResponse.MxManagerPID);
+	if (TempResponse.MxServicePID)  printf("Service PID:  %u\n", TempResponse.MxServicePID);
+	if (TempResponse.MxPrevServicePID)  printf("Previous service PID:  %u (stopping)\n", TempResponse.MxPrevServicePID);
+	if (TempResponse.MxState == CONTROL_STATE_STOPPED)  printf("Last exit code:  %d\n", TempResponse.MxExitCode);
+
+	if (TempResponse.MxServicePID && TempResponse.MxState != CONTROL_STATE_STOPPED)  DumpProcessPlacement((pid_t)TempResponse.MxServicePID);
+
+	if (TempResponse.MxFlags & CONTROL_FLAG_CGROUP)
+	{
+		if (TempResponse.MxCgroupMemory != CONTROL_CGROUP_NONE)  printf("cgroup memory:  %.1f MB\n", (double)TempResponse.MxCgroupMemory / 1048576.0);
+		if (TempResponse.MxCgroupProcesses != CONTROL_CGROUP_NONE)  printf("cgroup processes:  %llu\n", (unsigned long long)TempResponse.MxCgroupProcesses);
+		if (TempResponse.MxCgroupCPUUsage != CONTROL_CGROUP_NONE)  printf("cgroup CPU time:  %.3fs\n", (double)TempResponse.MxCgroupCPUUsage / 1000000.0);
+		if (TempResponse.MxCgroupCPUThrottled != CONTROL_CGROUP_NONE)  printf("cgroup CPU throttled:  %.3fs\n", (double)TempResponse.MxCgroupCPUThrottled / 1000000.0);
+		if (TempResponse.MxCgroupOOMKills != CONTROL_CGROUP_NONE)  printf("cgroup OOM kills:  %llu\n", (unsigned long long)TempResponse.MxCgroupOOMKills);
+	}
+}
+
+// Lists the other copies of the executable of a service.  They are published to the status table as 'service-name@N'.
+void DumpServiceInstances(const char *ServiceName)
+{
+	StatusTableSlot TempSlot;
+	size_t y = strlen(ServiceName), Num = 0;
+
+	for (size_t x = 0; x < STATUS_TABLE_SLOTS; x++)
+	{
+		StatusTableSlot *Slot = GxStatusTable.GetSlot(x);
+		if (Slot == NULL || !StatusTable::Read(Slot, TempSlot))  continue;
+
+		if (strncmp(TempSlot.MxName, ServiceName, y) || TempSlot.MxName[y] != '@')  continue;
+		if (kill((pid_t)TempSlot.MxOwnerPID, 0) < 0 && errno == ESRCH)  continue;
+
+		if (!Num)  printf("\n%-16s %-10s %8s %8s\n", "Instance", "State", "PID", "Starts");
+
+		printf("%-16s %-10s %8u %8u\n", TempSlot.MxName + y, (TempSlot.MxStatus.MxFlags & CONTROL_FLAG_FAILED ? "failed" : GetControlStateStr(TempSlot.MxStatus.MxState)), TempSlot.MxStatus.MxServicePID, TempSlot.MxStatus.MxStartCount);
+
+		Num++;
+	}
+}
+
+void DumpServiceLatency(const LatencySummary *Latency)
+{
+	bool Header = false;
+
+	for (size_t x = 0; x < LATENCY_NUM; x++)
+	{
+		if (!Latency[x].MxCount)  continue;
+
+		if (!Header)
+		{
+			printf("\n%-16s %8s %9s %9s %9s %9s %9s\n", "Latency", "Count", "Min", "p50", "p90", "p99", "Max");
+
+			Header = true;
+		}
+
+		printf("%-16s %8llu %8.3fs %8.3fs %8.3fs %8.3fs %8.3fs\n", GxLatencyNames[x], (unsigned long long)Latency[x].MxCount, (double)Latency[x].MxMin / 1000000.0,
+			(double)Latency[x].MxP50 / 1000000.0, (double)Latency[x].MxP90 / 1000000.0, (double)Latency[x].MxP99 / 1000000.0, (double)Latency[x].MxMax / 1000000.0);
+	}
+}
+
+// Waits for a newly started service manager to report that the process is ready.
+// Timeout limits how long to wait for the service manager to show up.  The service manager enforces its own readiness timeout.
+bool WaitForServiceReady(std::uint32_t Timeout)
+{
+	std::uint64_t StartTS = GetMonotonicMilliseconds();
+	ControlResponse TempResponse;
+	int ControlFD;
+
+	while ((ControlFD = ConnectControlSocket(GxApp.MxServiceName)) < 0)
+	{
+		if (GetMonotonicMilliseconds() - StartTS >= Timeout)  return false;
+
+		usleep(50000);
+	}
+
+	bool Result = (SendControlRequest(ControlFD, CONTROL_CMD_WAITREADY, TempResponse, true) && TempResponse.MxResult == CONTROL_RESULT_OK);
+
+	close(ControlFD);
+
+	return Result;
+}
+
+int main(int argc, char **argv)
+{
+	if (!ProcessArgs(argc, argv))  return 1;
+
+	if (!strcasecmp(GxApp.MxMainAction, "install"))
+	{
+		if (GxDebug)
+		{
+			printf("The -debug option is not allowed for the install action.\n\n");
+
+			DumpSyntax(argv[0]);
+
+			return 1;
+		}
+
+		// Installation requires additional arguments.
+		if (GxApp.MxExeArgc + 1 >= argc)
+		{
+			printf("Missing 'NotifyFile' or 'ExecutableToRun'.\n\n");
+
+			DumpSyntax(argv[0]);
+
+			return 1;
+		}
+
+		StaticMixedVar<char[8192]> TempBuffer, TempBuffer2, TempBuffer3;
+		size_t y;
+
+		// Generate service info file.
+		y = sizeof(TempBuffer.MxStr);
+		if (!UTF8::AppInfo::GetSystemAppStorageDir(TempBuffer.MxStr, y, "servicemanager"))
+		{
+			printf("Unable to retrieve system application storage directory location.\n");
+
+			return 1;
+		}
+		TempBuffer.SetSize(y - 1);
+
+		UTF8::Dir::Mkdir(TempBuffer.MxStr, 0775, true);
+
+		TempBuffer.AppendStr(GxApp.MxServiceName);
+		TempBuffer3.SetStr(TempBuffer.MxStr);
+
+		UTF8::File TempFile;
+		if (!TempFile.Open(TempBuffer.MxStr, O_CREAT | O_WRONLY | O_TRUNC, UTF8::File::ShareBoth, 0644))
+		{
+			printf("Unable to create '%s'.\n", TempBuffer.MxStr);
+
+			return 1;
+		}
+
+		// Notify file.
+		TempBuffer.SetStr("notify=");
+		TempBuffer.AppendStr(argv[GxApp.MxExeArgc]);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// Starting directory.
+		TempBuffer.SetStr("dir=");
+		if (GxApp.MxStartDir != NULL)  TempBuffer.AppendStr(GxApp.MxStartDir);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// Command to execute.
+		TempBuffer.SetStr("cmd=");
+		for (int x = GxApp.MxExeArgc + 1; x < argc; x++)
+		{
+			if (x > GxApp.MxExeArgc + 1)  TempBuffer.AppendChar(' ');
+			TempBuffer.AppendChar('\'');
+			TempBuffer.AppendStr(argv[x]);
+			TempBuffer.AppendChar('\'');
+		}
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// PID file.
+		TempBuffer.SetStr("pid=");
+		if (GxApp.MxPIDFileStr != NULL)  TempBuffer.AppendStr(GxApp.MxPIDFileStr);
+		else if (UTF8::File::Exists("/run/"))
+		{
+			TempBuffer.AppendStr("/run/");
+			TempBuffer.AppendStr(GxApp.MxServiceName);
+			TempBuffer.AppendStr(".pid");
+		}
+		else if (UTF8::File::Exists("/var/run/"))
+		{
+			TempBuffer.AppendStr("/var/run/");
+			TempBuffer.AppendStr(GxApp.MxServiceName);
+			TempBuffer.AppendStr(".pid");
+		}
+		else
+		{
+			TempBuffer.AppendStr(TempBuffer3.MxStr);
+			TempBuffer.AppendStr(".pid");
+		}
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// Log file.
+		TempBuffer.SetStr("log=");
+		if (GxApp.MxLogFileStr != NULL)  TempBuffer.AppendStr(GxApp.MxLogFileStr);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// Wait amount.
+		TempBuffer.SetStr("wait=");
+		if (GxApp.MxWaitAmount != INFINITE)
+		{
+			Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxWaitAmount);
+			TempBuffer.AppendStr(TempBuffer2.MxStr);
+		}
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// *NIX specific option:  Username.
+		TempBuffer.SetStr("nix_user=");
+		if (GxApp.MxUserStr != NULL)  TempBuffer.AppendStr(GxApp.MxUserStr);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// *NIX specific option:  Group name.
+		TempBuffer.SetStr("nix_group=");
+		if (GxApp.MxGroupStr != NULL)  TempBuffer.AppendStr(GxApp.MxGroupStr);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// *NIX specific option:  SIGTERM to SIGKILL wait amount.
+		TempBuffer.SetStr("kill_wait=");
+		Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxKillWaitAmount);
+		TempBuffer.AppendStr(TempBuffer2.MxStr);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// *NIX specific option:  What force termination reaches.
+		TempBuffer.SetStr("kill_mode=");
+		TempBuffer.AppendStr(GxApp.MxKillModeStr != NULL ? GxApp.MxKillModeStr : "group");
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// Process placement options.
+		for (size_t x2 = 0; x2 < PLACEMENT_NUM; x2++)
+		{
+			if (GxApp.MxPlacementStrs[x2] == NULL)  continue;
+
+			TempBuffer.SetStr(GxPlacementKeys[x2]);
+			TempBuffer.AppendChar('=');
+			TempBuffer.AppendStr(GxApp.MxPlacementStrs[x2]);
+
+			TempFile.Write(TempBuffer.MxStr, y);
+			TempFile.Write("\n", y);
+		}
+
+		// *NIX specific options:  Resource limits.
+		for (size_t x2 = 0; x2 < GxNumRLimitDefs; x2++)
+		{
+			if (GxApp.MxRLimitStrs[x2] == NULL)  continue;
+
+			TempBuffer.SetStr("rlimit_");
+			TempBuffer.AppendStr(GxRLimitDefs[x2].MxName);
+			TempBuffer.AppendChar('=');
+			TempBuffer.AppendStr(GxApp.MxRLimitStrs[x2]);
+
+			TempFile.Write(TempBuffer.MxStr, y);
+			TempFile.Write("\n", y);
+		}
+
+		// Linux specific option:  OOM killer priority.
+		if (GxApp.MxOOMScoreAdjStr != NULL)
+		{
+			TempBuffer.SetStr("oom_score_adj=");
+			TempBuffer.AppendStr(GxApp.MxOOMScoreAdjStr);
+
+			TempFile.Write(TempBuffer.MxStr, y);
+			TempFile.Write("\n", y);
+		}
+
+		// Linux specific options:  cgroup v2 resource limits.
+		for (size_t x2 = 0; x2 < CGROUP_LIMIT_NUM; x2++)
+		{
+			if (GxApp.MxCgroupLimitStrs[x2] == NULL)  continue;
+
+			TempBuffer.SetStr(GxCgroupLimitDefs[x2].MxKey);
+			TempBuffer.AppendChar('=');
+			TempBuffer.AppendStr(GxApp.MxCgroupLimitStrs[x2]);
+
+			TempFile.Write(TempBuffer.MxStr, y);
+			TempFile.Write("\n", y);
+		}
+
+		// *NIX specific option:  Listening sockets.
+		TempBuffer.SetStr("listen=");
+		if (GxApp.MxListenStr != NULL)  TempBuffer.AppendStr(GxApp.MxListenStr);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// *NIX specific option:  Readiness notification timeout.
+		TempBuffer.SetStr("ready=");
+		if (GxApp.MxReadyTimeout)
+		{
+			Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxReadyTimeout);
+			TempBuffer.AppendStr(TempBuffer2.MxStr);
+		}
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// *NIX specific option:  Health checks.
+		TempBuffer.SetStr("health=");
+		if (GxApp.MxHealthStr != NULL)  TempBuffer.AppendStr(GxApp.MxHealthStr);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		TempBuffer.SetStr("health_interval=");
+		TempBuffer.AppendUInt(GxApp.MxHealthInterval);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		TempBuffer.SetStr("health_timeout=");
+		TempBuffer.AppendUInt(GxApp.MxHealthTimeout);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		TempBuffer.SetStr("health_threshold=");
+		TempBuffer.AppendUInt(GxApp.MxHealthThreshold);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// *NIX specific option:  Overlapped restarts.
+		TempBuffer.SetStr("overlap=");
+		if (GxApp.MxOverlapAmount)
+		{
+			Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxOverlapAmount);
+			TempBuffer.AppendStr(TempBuffer2.MxStr);
+		}
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// *NIX specific option:  Captured output.
+		TempBuffer.SetStr("stdout=");
+		if (GxApp.MxStdoutStr != NULL)  TempBuffer.AppendStr(GxApp.MxStdoutStr);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		TempBuffer.SetStr("stderr=");
+		if (GxApp.MxStderrStr != NULL)  TempBuffer.AppendStr(GxApp.MxStderrStr);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		TempBuffer.SetStr("timestamps=");
+		TempBuffer.AppendStr(GxApp.MxOutputTimestamps ? "1" : "0");
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
+
+		// *NIX specific option:  Copies of the executable.
+		TempBuffer.SetStr("instances=");
+		TempBuffer.AppendUInt(GxApp.MxInstances ? GxApp.MxInstances : 1);
+
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
 
-		// Installation requires additional arguments.
-		if (GxApp.MxExeArgc + 1 >= argc)
-		{
-			printf("Missing 'NotifyFile' or 'ExecutableToRun'.\n\n");
+		TempBuffer.SetStr("pin_instances=");
+		TempBuffer.AppendStr(GxApp.MxPinInstances ? "1" : "0");
 
-			DumpSyntax(argv[0]);
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
 
-			return 1;
-		}
+		// *NIX specific option:  Log rotation.
+		TempBuffer.SetStr("log_max_size=");
+		Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), GxApp.MxLogMaxSize);
+		TempBuffer.AppendStr(TempBuffer2.MxStr);
 
-		StaticMixedVar<char[8192]> TempBuffer, TempBuffer2, TempBuffer3;
-		size_t y;
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
 
-		// Generate service info file.
-		y = sizeof(TempBuffer.MxStr);
-		if (!UTF8::AppInfo::GetSystemAppStorageDir(TempBuffer.MxStr, y, "servicemanager"))
-		{
-			printf("Unable to retrieve system application storage directory location.\n");
+		TempBuffer.SetStr("log_keep=");
+		Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxLogKeep);
+		TempBuffer.AppendStr(TempBuffer2.MxStr);
 
-			return 1;
-		}
-		TempBuffer.SetSize(y - 1);
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
 
-		UTF8::Dir::Mkdir(TempBuffer.MxStr, 0775, true);
+		TempBuffer.SetStr("log_interval=");
+		Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxLogInterval);
+		TempBuffer.AppendStr(TempBuffer2.MxStr);
 
-		TempBuffer.AppendStr(GxApp.MxServiceName);
-		TempBuffer3.SetStr(TempBuffer.MxStr);
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
 
-		UTF8::File TempFile;
-		if (!TempFile.Open(TempBuffer.MxStr, O_CREAT | O_WRONLY | O_TRUNC, UTF8::File::ShareBoth, 0644))
-		{
-			printf("Unable to create '%s'.\n", TempBuffer.MxStr);
+		TempBuffer.SetStr("log_compress=");
+		TempBuffer.AppendStr(GxApp.MxLogCompress ? "1" : "0");
 
-			return 1;
-		}
+		TempFile.Write(TempBuffer.MxStr, y);
+		TempFile.Write("\n", y);
 
-		// Notify file.
-		TempBuffer.SetStr("notify=");
-		TempBuffer.AppendStr(argv[GxApp.MxExeArgc]);
+		// *NIX specific option:  Metrics.
+		TempBuffer.SetStr("metrics=");
+		if (GxApp.MxMetricsStr != NULL)  TempBuffer.AppendStr(GxApp.MxMetricsStr);
 
 		TempFile.Write(TempBuffer.MxStr, y);
 		TempFile.Write("\n", y);
 
-		// Starting directory.
-		TempBuffer.SetStr("dir=");
-		if (GxApp.MxStartDir != NULL)  TempBuffer.AppendStr(GxApp.MxStartDir);
+		TempBuffer.SetStr("metrics_interval=");
+		Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxMetricsInterval);
+		TempBuffer.AppendStr(TempBuffer2.MxStr);
 
 		TempFile.Write(TempBuffer.MxStr, y);
 		TempFile.Write("\n", y);
 
-		// Command to execute.
-		TempBuffer.SetStr("cmd=");
-		for (int x = GxApp.MxExeArgc + 1; x < argc; x++)
-		{
-			if (x > GxApp.MxExeArgc + 1)  TempBuffer.AppendChar(' ');
-			TempBuffer.AppendChar('\'');
-			TempBuffer.AppendStr(argv[x]);
-			TempBuffer.AppendChar('\'');
-		}
+		// *NIX specific option:  Restart policy.
+		TempBuffer.SetStr("restart=");
+		TempBuffer.AppendStr(GxApp.MxRestartStr != NULL ? GxApp.MxRestartStr : "fixed");
 
 		TempFile.Write(TempBuffer.MxStr, y);
 		TempFile.Write("\n", y);
 
-		// PID file.
-		TempBuffer.SetStr("pid=");
-		if (GxApp.MxPIDFileStr != NULL)  TempBuffer.AppendStr(GxApp.MxPIDFileStr);
-		else if (UTF8::File::Exists("/run/"))
-		{
-			TempBuffer.AppendStr("/run/");
-			TempBuffer.AppendStr(GxApp.MxServiceName);
-			TempBuffer.AppendStr(".pid");
-		}
-		else if (UTF8::File::Exists("/var/run/"))
-		{
-			TempBuffer.AppendStr("/var/run/");
-			TempBuffer.AppendStr(GxApp.MxServiceName);
-			TempBuffer.AppendStr(".pid");
-		}
-		else
-		{
-			TempBuffer.AppendStr(TempBuffer3.MxStr);
-			TempBuffer.AppendStr(".pid");
-		}
+		TempBuffer.SetStr("restart_delay=");
+		Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxRestartDelay);
+		TempBuffer.AppendStr(TempBuffer2.MxStr);
 
 		TempFile.Write(TempBuffer.MxStr, y);
 		TempFile.Write("\n", y);
 
-		// Log file.
-		TempBuffer.SetStr("log=");
-		if (GxApp.MxLogFileStr != NULL)  TempBuffer.AppendStr(GxApp.MxLogFileStr);
+		TempBuffer.SetStr("restart_max_delay=");
+		Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxRestartMaxDelay);
+		TempBuffer.AppendStr(TempBuffer2.MxStr);
 
 		TempFile.Write(TempBuffer.MxStr, y);
 		TempFile.Write("\n", y);
 
-		// Wait amount.
-		TempBuffer.SetStr("wait=");
-		if (GxApp.MxWaitAmount != INFINITE)
-		{
-			Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxWaitAmount);
-			TempBuffer.AppendStr(TempBuffer2.MxStr);
-		}
+		TempBuffer.SetStr("restart_limit=");
+		Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxRestartLimit);
+		TempBuffer.AppendStr(TempBuffer2.MxStr);
 
 		TempFile.Write(TempBuffer.MxStr, y);
 		TempFile.Write("\n", y);
 
-		// *NIX specific option:  Username.
-		TempBuffer.SetStr("nix_user=");
-		if (GxApp.MxUserStr != NULL)  TempBuffer.AppendStr(GxApp.MxUserStr);
+		TempBuffer.SetStr("restart_window=");
+		Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxRestartWindow);
+		TempBuffer.AppendStr(TempBuffer2.MxStr);
 
 		TempFile.Write(TempBuffer.MxStr, y);
 		TempFile.Write("\n", y);
 
-		// *NIX specific option:  Group name.
-		TempBuffer.SetStr("nix_group=");
-		if (GxApp.MxGroupStr != NULL)  TempBuffer.AppendStr(GxApp.MxGroupStr);
+		// *NIX specific option:  State transition trace.
+		TempBuffer.SetStr("trace=");
+		if (GxApp.MxTraceStr != NULL)  TempBuffer.AppendStr(GxApp.MxTraceStr);
 
 		TempFile.Write(TempBuffer.MxStr, y);
 		TempFile.Write("\n", y);
@@ -1883,7 +8975,15 @@ int main(int argc, char **argv)
 		// Detect alternatives to LSB systems (e.g. systemd).
 		UTF8::File::FileStat TempStat;
 		bool UseSystemd = UTF8::File::Stat(TempStat, "/lib/systemd/system");
-		if (UseSystemd)
+		if (UseSystemd && GxApp.MxReadyTimeout)
+		{
+			// Use the '.systemd-notify' variant.  systemd runs the service manager directly and waits for the process to be ready.
+			TempBuffer.AppendStr("servicemanager_nix.systemd-notify");
+
+			// If the service file does not exist, try /usr/share.
+			if (!UTF8::File::Exists(TempBuffer.MxStr))  TempBuffer.SetStr("/usr/share/servicemanager/servicemanager_nix.systemd-notify");
+		}
+		else if (UseSystemd)
 		{
 			// Use the '.systemd' variant.
 			TempBuffer.AppendStr("servicemanager_nix.systemd");
@@ -2069,12 +9169,59 @@ int main(int argc, char **argv)
 		}
 		#endif
 
+		ServiceRegistry::Update(GxApp.MxServiceName);
+
 		printf("Service successfully installed.\n");
 	}
 	else if (!strcasecmp(GxApp.MxMainAction, "start") || !strcasecmp(GxApp.MxMainAction, "stop") || !strcasecmp(GxApp.MxMainAction, "restart") || !strcasecmp(GxApp.MxMainAction, "uninstall"))
 	{
+		// Talk to a running service manager via its control socket.
+		ControlResponse TempResponse;
+		int ControlFD = ConnectControlSocket(GxApp.MxServiceName);
+
+		memset(&TempResponse, 0, sizeof(TempResponse));
+
+		#ifdef __APPLE__
+		// launchd restarts 'run' service managers that exit.  Only 'supervise' can be controlled via the socket.
+		if (ControlFD > -1 && (!SendControlRequest(ControlFD, CONTROL_CMD_STATUS, TempResponse) || !(TempResponse.MxFlags & CONTROL_FLAG_SUPERVISE)))
+		{
+			close(ControlFD);
+			ControlFD = -1;
+		}
+		#endif
+
 		// Stop the service manager and service/daemon.
-		if (!strcasecmp(GxApp.MxMainAction, "stop") || !strcasecmp(GxApp.MxMainAction, "restart") || !strcasecmp(GxApp.MxMainAction, "uninstall"))
+		if (ControlFD > -1 && (!strcasecmp(GxApp.MxMainAction, "stop") || !strcasecmp(GxApp.MxMainAction, "uninstall")))
+		{
+			printf("Stopping service...");
+			fflush(stdout);
+
+			if (!SendControlRequest(ControlFD, CONTROL_CMD_STOP, TempResponse, true) || TempResponse.MxResult != CONTROL_RESULT_OK)
+			{
+				printf("\nError stopping the service via service manager process %u.\n", TempResponse.MxManagerPID);
+
+				return 1;
+			}
+
+			printf("\n");
+			printf("Service successfully stopped.  Exit code %d.\n", TempResponse.MxExitCode);
+		}
+		else if (ControlFD > -1 && !strcasecmp(GxApp.MxMainAction, "restart"))
+		{
+			printf("Restarting service...");
+			fflush(stdout);
+
+			if (!SendControlRequest(ControlFD, CONTROL_CMD_RESTART, TempResponse, true) || TempResponse.MxResult != CONTROL_RESULT_OK)
+			{
+				printf("\nError restarting the service via service manager process %u.\n", TempResponse.MxManagerPID);
+
+				return 1;
+			}
+
+			printf("\n");
+			printf("Service successfully restarted.\n");
+		}
+		else if (!strcasecmp(GxApp.MxMainAction, "stop") || !strcasecmp(GxApp.MxMainAction, "restart") || !strcasecmp(GxApp.MxMainAction, "uninstall"))
 		{
 		#ifdef __APPLE__
 			// Use /bin/launchctl to disable the process (implicit SIGTERM).
@@ -2273,11 +9420,28 @@ int main(int argc, char **argv)
 
 			UTF8::File::Delete(TempBuffer.MxStr);
 
+			ServiceRegistry::Update(GxApp.MxServiceName);
+
 			printf("Service successfully uninstalled.\n");
 		}
 
 		// Start the service manager and service/daemon.
-		if (!strcasecmp(GxApp.MxMainAction, "start") || !strcasecmp(GxApp.MxMainAction, "restart"))
+		if (ControlFD > -1 && !strcasecmp(GxApp.MxMainAction, "start"))
+		{
+			printf("Starting service...");
+			fflush(stdout);
+
+			if (!SendControlRequest(ControlFD, CONTROL_CMD_START, TempResponse, true) || TempResponse.MxResult != CONTROL_RESULT_OK)
+			{
+				printf("\nError starting the service via service manager process %u.\n", TempResponse.MxManagerPID);
+
+				return 1;
+			}
+
+			printf("\n");
+			printf("Service successfully started.\n");
+		}
+		else if (ControlFD < 0 && (!strcasecmp(GxApp.MxMainAction, "start") || !strcasecmp(GxApp.MxMainAction, "restart")))
 		{
 		#ifdef __APPLE__
 			// Use /bin/launchctl to enable the process (implicit start).
@@ -2427,6 +9591,22 @@ int main(int argc, char **argv)
 				{
 					printf("Process exited with exit code %d.\n", GxApp.MxExitCode);
 				}
+				else if (GetServiceInfoStr("ready", TempBuffer2, true) && strtoul(TempBuffer2.MxStr, NULL, 0) > 0)
+				{
+					// Wait for the process to signal readiness.
+					printf("Waiting for service to be ready...");
+					fflush(stdout);
+
+					if (!WaitForServiceReady((std::uint32_t)strtoul(TempBuffer2.MxStr, NULL, 0)))
+					{
+						printf("\nService did not become ready in time.\n");
+
+						return 1;
+					}
+
+					printf("\n");
+					printf("Service successfully started.\n");
+				}
 				else
 				{
 					printf("Service successfully started.\n");
@@ -2436,6 +9616,45 @@ int main(int argc, char **argv)
 		#endif
 		}
 	}
+	else if (!strcasecmp(GxApp.MxMainAction, "rollingrestart"))
+	{
+		// Only a running service manager can restart the copies of the executable in turn.
+		ControlResponse TempResponse;
+		int ControlFD = ConnectControlSocket(GxApp.MxServiceName);
+
+		memset(&TempResponse, 0, sizeof(TempResponse));
+
+		if (GxApp.MxMaxUnavailable < 1 || GxApp.MxMaxUnavailable > 65535)
+		{
+			printf("Invalid maximum number of unavailable copies.\n\n");
+
+			DumpSyntax(argv[0]);
+
+			return 1;
+		}
+
+		if (ControlFD < 0)
+		{
+			printf("Service is not running.\n");
+
+			return 1;
+		}
+
+		printf("Restarting service...");
+		fflush(stdout);
+
+		if (!SendControlRequest(ControlFD, CONTROL_CMD_ROLLINGRESTART, TempResponse, true, (std::uint16_t)GxApp.MxMaxUnavailable) || TempResponse.MxResult != CONTROL_RESULT_OK)
+		{
+			printf("\nError restarting the service via service manager process %u.  See the log file.\n", TempResponse.MxManagerPID);
+
+			return 1;
+		}
+
+		close(ControlFD);
+
+		printf("\n");
+		printf("Service successfully restarted.\n");
+	}
 	else if (!strcasecmp(GxApp.MxMainAction, "reload"))
 	{
 		// Reload service configuration.
@@ -2484,36 +9703,174 @@ int main(int argc, char **argv)
 		}
 
 		UTF8::File::FileStat TempStat;
+		ControlResponse TempResponse;
+		int ControlFD = ConnectControlSocket(GxApp.MxServiceName);
 
 		printf("Service reloading...");
 		fflush(stdout);
-		while (UTF8::File::Stat(TempStat, TempBuffer.MxStr) && !TempStat.st_size)
+		if (ControlFD > -1)
 		{
-			sleep(1);
-			printf(".");
-			fflush(stdout);
+			// The service manager responds as soon as the process acknowledges the reload.
+			if (!SendControlRequest(ControlFD, CONTROL_CMD_RELOAD, TempResponse, true) || TempResponse.MxResult != CONTROL_RESULT_OK)
+			{
+				printf("\nService is not running.\n");
+
+				UTF8::File::Delete(TempBuffer.MxStr);
+
+				return 1;
+			}
+
+			close(ControlFD);
+		}
+		else
+		{
+			while (UTF8::File::Stat(TempStat, TempBuffer.MxStr) && !TempStat.st_size)
+			{
+				sleep(1);
+				printf(".");
+				fflush(stdout);
+			}
 		}
 		printf("\n");
 
-		UTF8::File::Delete(TempBuffer.MxStr);
+		UTF8::File::Delete(TempBuffer.MxStr);
+
+		printf("Service successfully reloaded.\n");
+	}
+	else if (!strcasecmp(GxApp.MxMainAction, "waitfor"))
+	{
+		// Wait for the service to be ready.
+		StaticMixedVar<char[8192]> TempBuffer;
+		ControlResponse TempResponse;
+		int ControlFD;
+
+		if (!GetServiceInfoStr("pid", TempBuffer))  return 1;
+
+		do
+		{
+			ControlFD = ConnectControlSocket(GxApp.MxServiceName);
+			if (ControlFD > -1)
+			{
+				bool Result = SendControlRequest(ControlFD, CONTROL_CMD_WAITREADY, TempResponse);
+
+				close(ControlFD);
+
+				if (Result)
+				{
+					if (TempResponse.MxResult == CONTROL_RESULT_OK)  break;
+
+					printf("Service did not become ready in time.\n");
+
+					return 1;
+				}
+
+				// The service manager exited.  Keep waiting for the next one.
+			}
+			else if (UTF8::File::Exists(TempBuffer.MxStr))
+			{
+				// Service manager without a control socket.  Give the service a moment to finish starting.
+				sleep(2);
+
+				break;
+			}
+
+			usleep(100000);
+		} while (1);
+	}
+	else if (!strcasecmp(GxApp.MxMainAction, "status"))
+	{
+		StaticMixedVar<char[8192]> TempBuffer, TempBuffer2;
+		StatusTableSlot TempSlot;
+
+		// 'all' lists every service published to the status table.
+		if (!strcasecmp(GxApp.MxServiceName, "all"))
+		{
+			size_t Num = 0;
+			std::uint32_t LastPID = 0;
+			bool LastAlive = false;
+
+			for (size_t x = 0; x < STATUS_TABLE_SLOTS; x++)
+			{
+				StatusTableSlot *Slot = GxStatusTable.GetSlot(x);
+				if (Slot == NULL || !StatusTable::Read(Slot, TempSlot))  continue;
+
+				// Skip slots left behind by service managers that didn't exit cleanly.  Usually one service manager owns every slot.
+				if (TempSlot.MxOwnerPID != LastPID)
+				{
+					LastPID = TempSlot.MxOwnerPID;
+					LastAlive = (kill((pid_t)LastPID, 0) == 0 || errno != ESRCH);
+				}
+				if (!LastAlive)  continue;
+
+				if (!Num)  printf("%-24s %-10s %8s %8s %8s %9s  %s\n", "Service", "State", "Manager", "PID", "Starts", "Stop p99", "Started");
+
+				TempBuffer.SetStr("-");
+				if (TempSlot.MxStatus.MxStartCount)
+				{
+					time_t TempTime = (time_t)TempSlot.MxStatus.MxStartTime;
+					strftime(TempBuffer.MxStr, sizeof(TempBuffer.MxStr) - 1, "%Y-%m-%d %H:%M:%S", localtime(&TempTime));
+				}
+
+				if (TempSlot.MxStatus.MxState == CONTROL_STATE_STOPPED)
+				{
+					TempBuffer2.SetStr("exit ");
+					TempBuffer2.AppendInt(TempSlot.MxStatus.MxExitCode);
+				}
+				else
+				{
+					TempBuffer2.SetStr("");
+					TempBuffer2.AppendUInt(TempSlot.MxStatus.MxServicePID);
+				}
+
+				// Slow stops are what hold up deployments.
+				StaticMixedVar<char[64]> TempBuffer3;
+				if (!TempSlot.MxLatency[LATENCY_STOP].MxCount)  TempBuffer3.SetStr("-");
+				else  TempBuffer3.SetFormattedStr("%.3fs", (double)TempSlot.MxLatency[LATENCY_STOP].MxP99 / 1000000.0);
+
+				printf("%-24s %-10s %8u %8s %8u %9s  %s\n", TempSlot.MxName, (TempSlot.MxStatus.MxFlags & CONTROL_FLAG_FAILED ? "failed" : GetControlStateStr(TempSlot.MxStatus.MxState)), TempSlot.MxStatus.MxManagerPID, TempBuffer2.MxStr, TempSlot.MxStatus.MxStartCount, TempBuffer3.MxStr, TempBuffer.MxStr);
+
+				Num++;
+			}
+
+			if (!Num)  printf("No running service managers found.\n");
+
+			return 0;
+		}
+
+		// The status table answers without a round trip to the service manager.  cgroup statistics are only current when asked for.
+		if (GxStatusTable.Find(GxApp.MxServiceName, TempSlot))
+		{
+			if (TempSlot.MxStatus.MxFlags & CONTROL_FLAG_CGROUP)
+			{
+				int ControlFD = ConnectControlSocket(GxApp.MxServiceName);
+
+				if (ControlFD > -1)
+				{
+					if (!SendControlRequest(ControlFD, CONTROL_CMD_STATUS, TempSlot.MxStatus))  GxStatusTable.Find(GxApp.MxServiceName, TempSlot);
+
+					close(ControlFD);
+				}
+			}
+
+			DumpServiceStatus(TempSlot.MxStatus);
+			DumpServiceLatency(TempSlot.MxLatency);
+			DumpServiceInstances(GxApp.MxServiceName);
+
+			return 0;
+		}
 
-		printf("Service successfully reloaded.\n");
-	}
-	else if (!strcasecmp(GxApp.MxMainAction, "waitfor"))
-	{
-		// Wait for PID file.
-		StaticMixedVar<char[8192]> TempBuffer;
+		// Retrieve last process restart.
+		ControlResponse TempResponse;
+		int ControlFD = ConnectControlSocket(GxApp.MxServiceName);
 
-		if (!GetServiceInfoStr("pid", TempBuffer))  return 1;
+		if (ControlFD > -1 && SendControlRequest(ControlFD, CONTROL_CMD_STATUS, TempResponse))
+		{
+			close(ControlFD);
 
-		while (!UTF8::File::Exists(TempBuffer.MxStr))  usleep(500000);
+			DumpServiceStatus(TempResponse);
 
-		sleep(2);
-	}
-	else if (!strcasecmp(GxApp.MxMainAction, "status"))
-	{
-		// Retrieve last process restart.
-		StaticMixedVar<char[8192]> TempBuffer, TempBuffer2;
+			return 0;
+		}
 
 		if (!GetServiceInfoStr("pid", TempBuffer))  return 1;
 
@@ -2552,6 +9909,11 @@ int main(int argc, char **argv)
 			printf("Service PID:  %s\n", Line);
 			delete[] Line;
 
+			// Overlapped restart in progress.
+			Line = TempFile.LineInput();
+			if (Line != NULL && Line[0])  printf("Previous service PID:  %s (stopping)\n", Line);
+			delete[] Line;
+
 			TempFile.Close();
 		}
 	}
@@ -2566,6 +9928,90 @@ int main(int argc, char **argv)
 
 		TempFile.Close();
 	}
+	else if (!strcasecmp(GxApp.MxMainAction, "trace"))
+	{
+		StaticMixedVar<char[8192]> TempBuffer;
+		UTF8::File TempFile;
+		ServiceTraceHeader TempHeader;
+		ServiceTraceRecord TempRecord;
+		std::uint64_t LastTS = 0;
+		size_t y;
+
+		if (!GetServiceInfoStr("trace", TempBuffer, true) || !TempBuffer.MxStrPos)
+		{
+			printf("Service '%s' doesn't have a trace file.  Install it with -trace.\n", GxApp.MxServiceName);
+
+			return 1;
+		}
+
+		if (!TempFile.Open(TempBuffer.MxStr, O_RDONLY))
+		{
+			printf("Unable to open '%s'.\n", TempBuffer.MxStr);
+
+			return 1;
+		}
+
+		if (!TempFile.Read((std::uint8_t *)&TempHeader, sizeof(TempHeader), y) || y != sizeof(TempHeader) || memcmp(TempHeader.MxMagic, SERVICE_TRACE_MAGIC, 8) || TempHeader.MxVersion != SERVICE_TRACE_VERSION || TempHeader.MxRecordSize != sizeof(ServiceTraceRecord))
+		{
+			printf("'%s' is not a valid trace file.\n", TempBuffer.MxStr);
+
+			return 1;
+		}
+
+		printf("%-26s %10s %8s %8s  %s\n", "Time", "Elapsed", "Starts", "PID", "Transition");
+
+		while (TempFile.Read((std::uint8_t *)&TempRecord, sizeof(TempRecord), y) && y == sizeof(TempRecord))
+		{
+			time_t TempTime = (time_t)(TempRecord.MxTimeUS / 1000000);
+			strftime(TempBuffer.MxStr, sizeof(TempBuffer.MxStr) - 1, "%Y-%m-%d %H:%M:%S", localtime(&TempTime));
+
+			// Monotonic time restarts with the system.  Only show the elapsed time between records from the same boot.
+			double Elapsed = (LastTS && TempRecord.MxMonotonicUS >= LastTS ? (double)(TempRecord.MxMonotonicUS - LastTS) / 1000000.0 : 0.0);
+			LastTS = TempRecord.MxMonotonicUS;
+
+			printf("%s.%06u %9.6fs %8u %8u  %s -> %s\n", TempBuffer.MxStr, (unsigned int)(TempRecord.MxTimeUS % 1000000), Elapsed, TempRecord.MxGeneration, TempRecord.MxPID,
+				GxMetricStateNames[GetStateIndex(TempRecord.MxFromState)], GxMetricStateNames[GetStateIndex(TempRecord.MxToState)]);
+		}
+
+		TempFile.Close();
+	}
+	else if (!strcasecmp(GxApp.MxMainAction, "registry"))
+	{
+		StaticMixedVar<char[8192]> TempBuffer;
+
+		if (!strcasecmp(GxApp.MxServiceName, "build"))
+		{
+			if (!ServiceRegistry::Update(NULL, true))  return 1;
+
+			printf("Service registry successfully built.\n");
+		}
+		else if (!strcasecmp(GxApp.MxServiceName, "remove"))
+		{
+			if (!ServiceRegistry::GetFilename(TempBuffer))
+			{
+				printf("Error:  Unable to retrieve system application storage directory location.\n");
+
+				return 1;
+			}
+
+			if (UTF8::File::Exists(TempBuffer.MxStr) && !UTF8::File::Delete(TempBuffer.MxStr))
+			{
+				printf("Unable to delete '%s'.  Are you root?\n", TempBuffer.MxStr);
+
+				return 1;
+			}
+
+			printf("Service registry successfully removed.\n");
+		}
+		else
+		{
+			printf("Specify 'build' or 'remove' for the registry action.\n\n");
+
+			DumpSyntax(argv[0]);
+
+			return 1;
+		}
+	}
 	else if (!strcasecmp(GxApp.MxMainAction, "addaction"))
 	{
 		// Running requires additional arguments.
@@ -2618,410 +10064,182 @@ int main(int argc, char **argv)
 
 		TempFile.Close();
 
+		ServiceRegistry::Update(GxApp.MxServiceName);
+
 		printf("Successfully registered the custom action.\n");
 	}
-	else if (!strcasecmp(GxApp.MxMainAction, "run"))
+	else if (!strcasecmp(GxApp.MxMainAction, "run") || !strcasecmp(GxApp.MxMainAction, "supervise"))
 	{
-		// Load configuration information.
-		StaticMixedVar<char[8192]> PIDFilename, LogFilename, NotifyStopFilename, NotifyReloadFilename, CmdLine, TempBuffer, TempBuffer2;
-		char **CmdLineArgs;
-		size_t y;
-		UTF8::File TempFile, LogFile;
-		uid_t UserID = 0;
-		gid_t GroupID = 0;
-
-		PIDFilename.SetStr("");
-		LogFilename.SetStr("");
+		bool Supervise = (!strcasecmp(GxApp.MxMainAction, "supervise"));
 
 		// Some CPU saving objects.
 		GxStopEvent.Create();
-		GxWakeupEvent.Create();
-
-		if (GxDebug)
+		sigemptyset(&GxSignalMask);
+		if (!InitWakeupPipe())
 		{
-			// Running in debug mode requires additional arguments.
-			if (GxApp.MxExeArgc + 1 >= argc)
-			{
-				printf("Missing 'NotifyFile' or 'ExecutableToRun'.\n\n");
-
-				DumpSyntax(argv[0]);
+			printf("An error occurred while attempting to create the wakeup pipe.\n");
 
-				return 1;
-			}
+			return 1;
+		}
 
-			NotifyStopFilename.SetStr(argv[GxApp.MxExeArgc]);
-			NotifyStopFilename.AppendStr(".stop");
+		if (GxDebug)
+		{
+			// Override Ctrl+C to allow for a clean shutdown.
+			SetSignalHandler(SIGINT, CtrlHandler);
+		}
+		else
+		{
+			// Override simple termination signals to allow for a clean shutdown.  Obviously can't override SIGKILL.
+			SetSignalHandler(SIGINT, CtrlHandler);
+			SetSignalHandler(SIGTERM, CtrlHandler);
+			SetSignalHandler(SIGQUIT, CtrlHandler);
+		}
 
-			NotifyReloadFilename.SetStr(argv[GxApp.MxExeArgc]);
-			NotifyReloadFilename.AppendStr(".reload");
+		// Handle expected OS events a bit differently from the default (wake up the main loop sooner).
+		// Leave unexpected OS events alone.  They'll be lonely but will probably do the right thing.
+		SetSignalHandler(SIGHUP, ReopenLogsHandler);
+		SetSignalHandler(SIGCHLD, WakeupHandler);
 
-			if (GxApp.MxPIDFileStr != NULL)  PIDFilename.SetStr(GxApp.MxPIDFileStr);
+		InitSignalFD();
 
-			if (GxApp.MxLogFileStr != NULL)  LogFilename.SetStr(GxApp.MxLogFileStr);
-			else  GetServiceInfoStr("log", LogFilename);
+		// Processes get their own NOTIFY_SOCKET (if any).  Readiness is reported to systemd by the service manager.
+		const char *TempNotifySocket = getenv("NOTIFY_SOCKET");
+		if (TempNotifySocket != NULL)
+		{
+			GxSystemdNotifySocket = CopyStr(TempNotifySocket);
 
-			// Retrieve the user.
-			if (GxApp.MxUserStr != NULL)
-			{
-				struct passwd *TempPasswd = getpwnam(GxApp.MxUserStr);
-				if (TempPasswd == NULL)
-				{
-					printf("Unknown user '%s' specified.\n", GxApp.MxUserStr);
+			unsetenv("NOTIFY_SOCKET");
+		}
 
-					return 1;
-				}
+		Supervisor MainSupervisor;
 
-				UserID = TempPasswd->pw_uid;
-			}
+		if (!MainSupervisor.Init(Supervise))
+		{
+			printf("An error occurred while attempting to initialize the event loop.\n");
 
-			// Retrieve the group.
-			if (GxApp.MxGroupStr != NULL)
-			{
-				struct group *TempGroup = getgrnam(GxApp.MxGroupStr);
-				if (TempGroup == NULL)
-				{
-					printf("Unknown group '%s' specified.\n", GxApp.MxGroupStr);
+			return 1;
+		}
 
-					return 1;
-				}
+		if (!Supervise)
+		{
+			// Load configuration information.
+			ServiceRunner *Service = new ServiceRunner(&MainSupervisor);
+			MainSupervisor.AddService(Service);
 
-				GroupID = TempGroup->gr_gid;
-			}
+			if (GxDebug ? !Service->InitFromArgs(argc, argv) : !Service->InitFromServiceInfo(GxApp.MxServiceName))  return 1;
 
-			// Parse command-line arguments.
-			CmdLineArgs = new char *[argc - GxApp.MxExeArgc];
-			y = 0;
-			for (int x = GxApp.MxExeArgc + 1; x < argc; x++)
-			{
-				CmdLineArgs[y++] = argv[x];
-			}
-			CmdLineArgs[y] = NULL;
+			if (!Service->Activate())  return 1;
 
-			// Override Ctrl+C to allow for a clean shutdown.
-			signal(SIGINT, CtrlHandler);
+			ActivateServiceInstances(MainSupervisor, Service, argc, argv);
 		}
 		else
 		{
-			if (!GetServiceInfoStr("notify", NotifyStopFilename))  return 1;
-			NotifyReloadFilename.SetStr(NotifyStopFilename.MxStr);
-
-			NotifyStopFilename.AppendStr(".stop");
-			NotifyReloadFilename.AppendStr(".reload");
-
-			GetServiceInfoStr("pid", PIDFilename);
-			GetServiceInfoStr("log", LogFilename);
-
-			if (GetServiceInfoStr("wait", TempBuffer, true) && TempBuffer.MxStrPos)  GxApp.MxWaitAmount = (std::uint32_t)strtoul(TempBuffer.MxStr, NULL, 0);
-
-			// Parse command-line arguments.
-			if (!GetServiceInfoStr("cmd", CmdLine))  return 1;
-
-			CmdLineArgs = ExtractArgs(CmdLine);
+			// Collect the service names.  'all' supervises every installed service.
+			StaticMixedVar<char[8192]> TempBuffer, TempBuffer2;
+			UTF8::Dir TempDir;
+			size_t y;
+			bool All = (!strcasecmp(GxApp.MxServiceName, "all"));
 
-			if (CmdLineArgs == NULL)
+			y = sizeof(TempBuffer2.MxStr);
+			if (!UTF8::AppInfo::GetSystemAppStorageDir(TempBuffer2.MxStr, y, "servicemanager"))
 			{
-				printf("An error occurred while attempting to extract the arguments to run the service.\n");
+				printf("Error:  Unable to retrieve system application storage directory location.\n");
 
 				return 1;
 			}
+			TempBuffer2.SetSize(y - 1);
 
-			// Retrieve the user.
-			if (GetServiceInfoStr("nix_user", TempBuffer, true) && TempBuffer.MxStrPos)
-			{
-				struct passwd *TempPasswd = getpwnam(TempBuffer.MxStr);
-				if (TempPasswd == NULL)
-				{
-					printf("Unknown user '%s' specified in configuration.\n", TempBuffer.MxStr);
+			// The compiled registry, when there is one, replaces the directory scan.
+			bool UseRegistry = (All && GxServiceRegistry.Open());
+			size_t RegistryPos = GxServiceRegistry.GetNextPos();
 
-					return 1;
-				}
+			if (All && !UseRegistry && !TempDir.Open(TempBuffer2.MxStr))
+			{
+				printf("Error:  Unable to open '%s'.\n", TempBuffer2.MxStr);
 
-				UserID = TempPasswd->pw_uid;
+				return 1;
 			}
 
-			// Retrieve the group.
-			if (GetServiceInfoStr("nix_group", TempBuffer, true) && TempBuffer.MxStrPos)
+			int x = GxApp.MxExeArgc - 1;
+			do
 			{
-				struct group *TempGroup = getgrnam(TempBuffer.MxStr);
-				if (TempGroup == NULL)
+				// Service info files don't have a file extension.
+				const char *ServiceName;
+				if (!All)
 				{
-					printf("Unknown group '%s' specified in configuration.\n", TempBuffer.MxStr);
+					if (x >= argc)  break;
 
-					return 1;
+					ServiceName = argv[x++];
 				}
-
-				GroupID = TempGroup->gr_gid;
-			}
-
-			// Override simple termination signals to allow for a clean shutdown.  Obviously can't override SIGKILL.
-			signal(SIGINT, CtrlHandler);
-			signal(SIGTERM, CtrlHandler);
-			signal(SIGQUIT, CtrlHandler);
-
-			// Finalize the service startup by adjusting standard handles to point nowhere.
-			if (freopen("/dev/null", "r", stdin) == NULL)  {}
-			if (freopen("/dev/null", "w", stdout) == NULL)  {}
-			if (freopen("/dev/null", "w", stderr) == NULL)  {}
-		}
-
-		// Handle expected OS events a bit differently from the default (wake up the main loop sooner).
-		// Leave unexpected OS events alone.  They'll be lonely but will probably do the right thing.
-		signal(SIGHUP, WakeupHandler);
-		signal(SIGCHLD, WakeupHandler);
-
-		LogFile.Open(LogFilename.MxStr, O_CREAT | O_WRONLY | O_APPEND, UTF8::File::ShareBoth, 0644);
-
-		WriteLog(LogFile, "Service manager started.");
-
-		size_t CurrState = 0, NextState = 0;
-		std::uint32_t StateTimeLeft = 0;
-		pid_t MainPID = 0;
-		int Status;
-
-		do
-		{
-			switch (CurrState)
-			{
-				case 0:
+				else if (UseRegistry)
 				{
-					// Start the service executable.
-					TempBuffer.SetStr("Starting process:  ");
-					for (int x = 0; CmdLineArgs[x] != NULL; x++)
-					{
-						if (x)  TempBuffer.AppendChar(' ');
-						TempBuffer.AppendChar('\'');
-						TempBuffer.AppendStr(CmdLineArgs[x]);
-						TempBuffer.AppendChar('\'');
-					}
-					WriteLog(LogFile, TempBuffer.MxStr, false);
-
-					if (PIDFilename.MxStrPos)  UTF8::File::Delete(PIDFilename.MxStr);
-					UTF8::File::Delete(NotifyStopFilename.MxStr);
-					UTF8::File::Delete(NotifyReloadFilename.MxStr);
-
-					MainPID = fork();
-
-					if (MainPID < 0)
-					{
-						WriteLog(LogFile, "An error occurred while attempting to fork() the process to start the service.");
+					const ServiceRegistryRecord *Record = GxServiceRegistry.Next(RegistryPos);
+					if (Record == NULL)  break;
 
-						return 1;
-					}
-					else if (MainPID == 0)
-					{
-						// Start service.
-						if (GxApp.MxStartDir != NULL)
-						{
-							if (chdir(GxApp.MxStartDir) < 0)  WriteLog(LogFile, "Unable to change directories.");
-						}
-
-						if (GroupID && setgid(GroupID) < 0)  WriteLog(LogFile, "Unable to setgid().");
-						if (UserID && setuid(UserID) < 0)  WriteLog(LogFile, "Unable to setuid().");
-
-						execv(CmdLineArgs[0], CmdLineArgs);
-
-						TempBuffer.SetStr("An error occurred while attempting to start the process.  Command = ");
-						for (int x = 0; CmdLineArgs[x] != NULL; x++)
-						{
-							if (x)  TempBuffer.AppendChar(' ');
-							TempBuffer.AppendChar('\'');
-							TempBuffer.AppendStr(CmdLineArgs[x]);
-							TempBuffer.AppendChar('\'');
-						}
-						WriteLog(LogFile, TempBuffer.MxStr);
-
-						GxApp.MxExitCode = 1;
-						CurrState = 100;
-					}
-					else
-					{
-						// Write the process IDs to the PID file.
-						if (PIDFilename.MxStrPos)
-						{
-							if (!TempFile.Open(PIDFilename.MxStr, O_CREAT | O_WRONLY | O_TRUNC, UTF8::File::ShareBoth, 0644))  WriteLog(LogFile, "Unable to create PID file.", false);
-							else
-							{
-								Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)Environment::AppInfo::GetCurrentProcessID());
-								TempFile.Write(TempBuffer2.MxStr, y);
-								TempFile.Write("\n", y);
-
-								Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)MainPID);
-								TempFile.Write(TempBuffer2.MxStr, y);
-								TempFile.Write("\n", y);
-
-								TempFile.Close();
-							}
-						}
-
-						Status = 0;
-						CurrState = 1;
-					}
-
-					break;
+					ServiceName = ServiceRegistry::GetName(Record);
 				}
-				case 1:
-				case 4:
-				case 5:
-				case 6:
+				else
 				{
-					GxWakeupEvent.Wait(CurrState == 1 || StateTimeLeft > 2000 ? 2000 : StateTimeLeft);
+					if (!TempDir.Read(TempBuffer.MxStr, sizeof(TempBuffer.MxStr)))  break;
+					if (strchr(TempBuffer.MxStr, '.') != NULL)  continue;
 
-					if (waitpid(MainPID, &Status, WNOHANG) == MainPID)
-					{
-						GxApp.MxExitCode = (WIFEXITED(Status) ? WEXITSTATUS(Status) : 0);
+					ServiceName = TempBuffer.MxStr;
+				}
 
-						// Process completed.
-						NextState = (CurrState == 4 ? 100 : 0);
-						CurrState = 3;
-					}
-					else if (CurrState != 4 && GxStopEvent.Wait(0))
-					{
-						// Service manager has been requested by the OS to terminate.
-						if (TempFile.Open(NotifyStopFilename.MxStr, O_CREAT | O_WRONLY))
-						{
-							TempFile.Close();
+				if (MainSupervisor.FindService(ServiceName) != NULL)  continue;
 
-							CurrState = 4;
-							StateTimeLeft = GxApp.MxWaitAmount;
-						}
-						else
-						{
-							// Force terminate the process since communication is not possible.
-							CurrState = 2;
-							NextState = 100;
-						}
-					}
-					else if (CurrState == 4 || CurrState == 5 || UTF8::File::Exists(NotifyStopFilename.MxStr))
-					{
-						// Stop.
-						if (CurrState != 4 && CurrState != 5)
-						{
-							CurrState = 5;
-							StateTimeLeft = GxApp.MxWaitAmount;
-						}
-						else
-						{
-							StateTimeLeft -= (StateTimeLeft > 2000 ? 2000 : StateTimeLeft);
-							if (!StateTimeLeft)
-							{
-								// Force the process to terminate since the timeout has expired.
-								NextState = (CurrState == 4 ? 100 : 0);
-								CurrState = 2;
-							}
-						}
-					}
-					else if (UTF8::File::Exists(NotifyReloadFilename.MxStr))
-					{
-						// Reload.
-						if (CurrState != 6)
-						{
-							CurrState = 6;
-							StateTimeLeft = GxApp.MxWaitAmount;
-						}
-						else
-						{
-							StateTimeLeft -= (StateTimeLeft > 2000 ? 2000 : StateTimeLeft);
-							if (!StateTimeLeft)
-							{
-								// Stop the process since it didn't respond in time to reload.
-								if (TempFile.Open(NotifyStopFilename.MxStr, O_CREAT | O_WRONLY))
-								{
-									TempFile.Close();
-
-									CurrState = 5;
-									StateTimeLeft = GxApp.MxWaitAmount;
-								}
-								else
-								{
-									// Force terminate the process since communication is not possible.
-									CurrState = 2;
-									NextState = 0;
-								}
-							}
-						}
-					}
-					else
-					{
-						CurrState = 1;
-					}
+				ServiceRunner *Service = new ServiceRunner(&MainSupervisor);
 
-					break;
-				}
-				case 2:
+				if (!Service->InitFromServiceInfo(ServiceName))
 				{
-					// Try a standard termination signal.
-					if (kill(MainPID, SIGTERM) < 0)
-					{
-						// Force terminate the process.
-						if (kill(MainPID, SIGKILL) < 0)
-						{
-							WriteLog(LogFile, "Process force termination initiation failed.");
-
-							CurrState = 100;
-
-							break;
-						}
+					delete Service;
 
-						GxApp.MxExitCode = 1;
-					}
-					else if (GxWakeupEvent.Wait(3000) && waitpid(MainPID, &Status, WNOHANG) == MainPID)
-					{
-						GxApp.MxExitCode = (WIFEXITED(Status) ? WEXITSTATUS(Status) : 0);
-					}
-					else
-					{
-						// Force terminate the process.
-						if (kill(MainPID, SIGKILL) < 0)
-						{
-							WriteLog(LogFile, "Process force termination initiation failed.");
+					return 1;
+				}
 
-							CurrState = 100;
+				// Skip services that already have a running service manager or can't listen.
+				if (!Service->Activate())
+				{
+					printf("Skipping '%s'.\n", ServiceName);
 
-							break;
-						}
+					delete Service;
 
-						GxApp.MxExitCode = 1;
-					}
+					continue;
+				}
 
-					WriteLog(LogFile, "Process force terminated.");
+				MainSupervisor.AddService(Service);
 
-					// Intentionally fall through to state 3.
-					FALL_THROUGH;
-				}
-				case 3:
-				{
-					// Process completed.
-					TempBuffer.SetStr("Process terminated with exit code ");
-					Convert::Int::ToString(TempBuffer2.MxStr, sizeof(TempBuffer2.MxStr), (std::uint64_t)GxApp.MxExitCode);
-					TempBuffer.AppendStr(TempBuffer2.MxStr);
-					TempBuffer.AppendChar('.');
+				ActivateServiceInstances(MainSupervisor, Service, argc, argv);
+			} while (1);
 
-					WriteLog(LogFile, TempBuffer.MxStr);
+			if (All && !UseRegistry)  TempDir.Close();
 
-					// Let the OS have a moment to clean up after the process before continuing.
-					sleep(1);
+			if (!MainSupervisor.GetNumServices())
+			{
+				printf("No services to supervise.\n");
 
-					// Handle the rare instance where the service was told to stop immediately after the executable happened to terminate.
-					if (GxStopEvent.Wait(0))  NextState = 100;
+				return 1;
+			}
+		}
 
-					CurrState = NextState;
+		// Finalize the service startup by adjusting standard handles to point nowhere.
+		if (!GxDebug)
+		{
+			if (freopen("/dev/null", "r", stdin) == NULL)  {}
+			if (freopen("/dev/null", "w", stdout) == NULL)  {}
+			if (freopen("/dev/null", "w", stderr) == NULL)  {}
+		}
 
-					break;
-				}
-				default:
-				{
-					if (PIDFilename.MxStrPos)  UTF8::File::Delete(PIDFilename.MxStr);
-					UTF8::File::Delete(NotifyStopFilename.MxStr);
-					UTF8::File::Delete(NotifyReloadFilename.MxStr);
+		// Log and metrics writes happen on background threads from here on.
+		GxLogWriter.Start(256 * 1024);
+		GxMetricsWriter.Start();
 
-					WriteLog(LogFile, "Service manager stopped.");
+		int TempResult = MainSupervisor.Run();
 
-					delete[] CmdLineArgs;
+		GxMetricsWriter.Stop();
+		GxLogWriter.Stop();
 
-					return (int)GxApp.MxExitCode;
-				}
-			}
-		} while (1);
+		return TempResult;
 	}
 	else
 	{